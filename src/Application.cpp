@@ -32,6 +32,7 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 #include "KeyBinds.h"
 #include "Hash.h"
 #include "Util.h"
+#include "ZipIndex.h"
 
 #include "Gl.h"
 #include "GlUtil.h"
@@ -40,6 +41,7 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <assert.h>
 #include <chrono>
+#include <thread>
 #include <time.h>
 #include <math.h>
 #include <sys/stat.h>
@@ -324,8 +326,8 @@ bool Application::init(const char* title, int width, int height)
 
   _coreName.clear();
   _gameData = NULL;
-  _validSlots = 0;
   _isDriveFloppy = false;
+  _extractionCount = 0;
   lastHardcore = hardcore();
   cancelLoad = false;
   _absViewMouseX = _absViewMouseY = 0;
@@ -444,6 +446,25 @@ void Application::pauseForBadPerformance()
   }
 }
 
+void Application::doAchievementsFrame()
+{
+  PROFILE_PHASE(AchievementsFrame);
+
+  // pick up any changes the core made to its memory map while running the frame
+  _memory.update(&_core, _system);
+
+  if (_config.getSnapshotMemory())
+  {
+    _memory.captureSnapshot();
+    RA_DoAchievementsFrame();
+    _memory.releaseSnapshot();
+  }
+  else
+  {
+    RA_DoAchievementsFrame();
+  }
+}
+
 void Application::runTurbo()
 {
   const auto tTurboStart = std::chrono::steady_clock::now();
@@ -460,12 +481,12 @@ void Application::runTurbo()
   for (int i = 0; i < nSkipFrames; i++)
   {
     _core.step(false, playAudio);
-    RA_DoAchievementsFrame();
+    doAchievementsFrame();
   }
 
   // do a final frame with video
   _core.step(true, playAudio);
-  RA_DoAchievementsFrame();
+  doAchievementsFrame();
 
   // allow normal audio processing
   _audio.setBlocking(true);
@@ -474,7 +495,10 @@ void Application::runTurbo()
   RA_ResumeRepaint();
 
   // check for periodic SRAM flush
-  _states.periodicSaveSRAM(&_core);
+  {
+    PROFILE_PHASE(SaveSRAM);
+    _states.periodicSaveSRAM(&_core);
+  }
 
   const auto tTurboEnd = std::chrono::steady_clock::now();
   const auto tTurboElapsed = std::chrono::duration_cast<std::chrono::milliseconds>(tTurboEnd - tTurboStart);
@@ -494,8 +518,17 @@ void Application::runSmoothed()
 
   do
   {
+    // show the previous frame
+    if (_video.isPerformanceOverlayVisible())
+      updatePerformanceOverlay();
+
+    PROFILE_PHASE(Frame);
+
     _processingEvents = true;
-    processEvents();
+    {
+      PROFILE_PHASE(ProcessEvents);
+      processEvents();
+    }
     _processingEvents = false;
     if (_fsm.currentState() != Fsm::State::GameRunning)
       return;
@@ -510,7 +543,7 @@ void Application::runSmoothed()
     {
       // do one frame with audio
       _core.step(true, true);
-      RA_DoAchievementsFrame();
+      doAchievementsFrame();
 
       _audioGeneratedDuringFastForward = 0;
       ++numFrames;
@@ -600,7 +633,7 @@ void Application::run()
         case Fsm::State::FrameStep:
           // do one frame without audio
           _core.step(true, false);
-          RA_DoAchievementsFrame();
+          doAchievementsFrame();
 
           // set state to GamePaused
           _fsm.resumeGame();
@@ -701,13 +734,26 @@ void Application::destroy()
 {
   _logger.info(TAG "begin shutdown");
 
+  if (!_profilePath.empty())
+  {
+    _profiler.logSummary();
+    _profiler.writeTrace(_profilePath);
+  }
+
+  _profiler.destroy();
+
   saveConfiguration();
 
+  _states.destroy();
+
   RA_Shutdown();
 
   if (_gameData)
     free(_gameData);
 
+  if (!_extractionRoot.empty())
+    RemoveDirectoryW(util::utf8ToUChar(_extractionRoot).c_str());
+
   _video.destroy();
   _keybinds.destroy();
   _input.destroy();
@@ -1019,6 +1065,9 @@ bool Application::loadGame(const std::string& path)
   bool loaded;
   bool iszip = (path.length() > 4 && stricmp(&path.at(path.length() - 4), ".zip") == 0);
   bool issupportedzip = false;
+  const char* validExtensions = getEmulatorExtensions(_coreName, _system);
+  if (validExtensions == NULL)
+    validExtensions = info->valid_extensions;
 
   /* make sure none of the forbidden settings are set */
   if (!_config.validateSettingsForHardcore(_core.getSystemInfo()->library_name, _system, true))
@@ -1030,11 +1079,8 @@ bool Application::loadGame(const std::string& path)
   /* if the core says it wants the full path, we have to see if it supports zip files */
   if (iszip && info->need_fullpath)
   {
-    ptr = getEmulatorExtensions(_coreName, _system);
-    if (ptr == NULL)
-      ptr = info->valid_extensions;
-
-    while (*ptr)
+    ptr = validExtensions;
+    while (ptr && *ptr)
     {
       if (strnicmp(ptr, "zip", 3) == 0 && (ptr[3] == '\0' || ptr[3] == '|'))
       {
@@ -1068,30 +1114,71 @@ bool Application::loadGame(const std::string& path)
     {
       _logger.info(TAG "%s requires uncompressed content - extracting", info->library_name);
 
-      data = util::loadZippedFile(&_logger, path, &size, unzippedFileName);
-      if (data == NULL)
+      std::shared_ptr<const ZipIndex> index = ZipIndex::get(&_logger, path);
+      if (!index || index->getEntries().empty())
       {
         MessageBox(g_mainWindow, "Unable to open file", "Error", MB_OK);
         return false;
       }
 
-      if (unzippedFileName.empty())
+      const ZipIndex::Entry* entry = index->select(validExtensions);
+      if (entry == NULL)
       {
         MessageBox(g_mainWindow, "Could not determine which file to extract from zip", "Error", MB_OK);
         return false;
       }
 
-      std::string newPath = util::replaceFileName(path, unzippedFileName.c_str());
-      util::saveFile(&_logger, newPath, data, size);
-      free(data);
+      /* a playlist needs the discs it references, so extract everything next to it. files in
+       * subdirectories are skipped so nothing is written outside the extraction directory */
+      std::vector<const ZipIndex::Entry*> entries;
+      if (stricmp(util::extension(entry->name).c_str(), ".m3u") == 0)
+      {
+        for (const auto& file : index->getEntries())
+        {
+          if (file.name.find_first_of("/\\") == std::string::npos)
+            entries.push_back(&file);
+        }
+      }
+      else
+      {
+        entries.push_back(entry);
+      }
 
+      /* extract into a new directory so nothing the user has is overwritten (and later deleted) */
+      const std::string extractionPath = createExtractionPath();
+      if (extractionPath.empty())
+      {
+        MessageBox(g_mainWindow, "Unable to create a directory to extract the file to", "Error", MB_OK);
+        return false;
+      }
+
+      std::vector<std::string> extractedPaths;
+      for (const auto* file : entries)
+        extractedPaths.push_back(extractionPath + util::fileNameWithExtension(file->name));
+
+      /* decompress straight to disk rather than through a buffer, several files at a time */
+      if (!index->extract(&_logger, entries, extractedPaths, std::thread::hardware_concurrency()))
+      {
+        for (const auto& extractedPath : extractedPaths)
+          util::deleteFile(extractedPath);
+        RemoveDirectoryW(util::utf8ToUChar(extractionPath).c_str());
+
+        MessageBox(g_mainWindow, "Unable to extract file", "Error", MB_OK);
+        return false;
+      }
+
+      const std::string newPath = extractionPath + util::fileNameWithExtension(entry->name);
       if (!loadGame(newPath))
       {
-        util::deleteFile(newPath);
+        for (const auto& extractedPath : extractedPaths)
+          util::deleteFile(extractedPath);
+        RemoveDirectoryW(util::utf8ToUChar(extractionPath).c_str());
+
         return false;
       }
 
-      _gamePathIsTemporary = true;
+      _temporaryFiles = extractedPaths;
+      _temporaryPath = extractionPath;
       return true;
     }
   }
@@ -1119,7 +1206,7 @@ bool Application::loadGame(const std::string& path)
       if (iszip)
       {
         /* core doesn't support zip files, unzip it into a buffer */
-        data = util::loadZippedFile(&_logger, path, &size, unzippedFileName);
+        data = util::loadZippedFile(&_logger, path, &size, unzippedFileName, validExtensions);
       }
       else
       {
@@ -1205,7 +1292,10 @@ bool Application::loadGame(const std::string& path)
 
   _gameFileName = unzippedFileName; // store for GetEstimatedTitle callback
 
-  if (!romLoaded(&_core, &_logger, _system, path, data, size, false))
+  setHashCache(&_logger, _config.getCacheHashes() ? getHashCachePath() : std::string());
+
+  /* content extracted from an archive is cached by the entry that was picked, which depends on the core */
+  if (!romLoaded(&_core, &_logger, _system, path, (iszip && data) ? unzippedFileName : std::string(), data, size, false))
   {
     _discPaths.clear();
     updateDiscMenu(true);
@@ -1261,7 +1351,8 @@ bool Application::loadGame(const std::string& path)
   }
 
   _gamePath = path;
-  _gamePathIsTemporary = false;
+  _temporaryFiles.clear();
+  _temporaryPath.clear();
 
   for (size_t i = 0; i < _recentList.size(); i++)
   {
@@ -1297,19 +1388,9 @@ bool Application::loadGame(const std::string& path)
 moved_recent_item:
   refreshMemoryMap();
 
-  _validSlots = 0;
-
   _states.migrateFiles();
   _states.loadSRAM(&_core);
 
-  for (unsigned ndx = 1; ndx <= 10; ndx++)
-  {
-    if (_states.existsState(ndx))
-    {
-      _validSlots |= 1 << ndx;
-    }
-  }
-
   _input.autoAssign();
   return true;
 }
@@ -1368,11 +1449,17 @@ bool Application::unloadGame()
 
   _video.clear();
 
-  if (_gamePathIsTemporary)
+  for (const auto& temporaryFile : _temporaryFiles)
+  {
+    _logger.debug(TAG "Deleting temporary content %s", temporaryFile.c_str());
+    util::deleteFile(temporaryFile);
+  }
+  _temporaryFiles.clear();
+
+  if (!_temporaryPath.empty())
   {
-    _logger.debug(TAG "Deleting temporary content %s", _gamePath.c_str());
-    util::deleteFile(_gamePath);
-    _gamePathIsTemporary = false;
+    RemoveDirectoryW(util::utf8ToUChar(_temporaryPath).c_str());
+    _temporaryPath.clear();
   }
 
   _gamePath.clear();
@@ -1385,7 +1472,6 @@ bool Application::unloadGame()
 
   _states.setGame(_gameFileName, 0, _coreName, &_core);
 
-  _validSlots = 0;
   enableSlots();
 
   return true;
@@ -1479,7 +1565,7 @@ void Application::s_audioCallback(void* udata, Uint8* stream, int len)
     {
       app->_fifo.read((void*)stream, avail);
       memset((void*)(stream + avail), 0, len - avail);
-      app->_logger.debug("[AUD] Audio hardware requested %d bytes, only %zu available, padding with zeroes", len, avail);
+      LOG_DEBUG(&app->_logger, "[AUD] Audio hardware requested %d bytes, only %zu available, padding with zeroes", len, avail);
 
       app->_numAudioRecoveries = 0;
       if (++app->_numAudioFaults > 200)
@@ -1521,14 +1607,14 @@ void Application::s_audioCallback(void* udata, Uint8* stream, int len)
 
       app->_fifo.read((void*)stream, len);
 #ifdef DEBUG_AUDIO
-      app->_logger.debug("[AUD] Audio hardware requested %d bytes", len);
+      LOG_DEBUG(&app->_logger, "[AUD] Audio hardware requested %d bytes", len);
 #endif
     }
   }
   else
   {
 #ifdef DEBUG_AUDIO
-    app->_logger.debug("[AUD] Audio hardware requested %d bytes, game is not running, sending silence", len);
+    LOG_DEBUG(&app->_logger, "[AUD] Audio hardware requested %d bytes, game is not running, sending silence", len);
 #endif
     memset((void*)stream, 0, len);
   }
@@ -1601,7 +1687,8 @@ void Application::enableSlots()
   
   for (unsigned ndx = 1; ndx <= 10; ndx++)
   {
-    if ((_validSlots & (1 << ndx)) != 0)
+    /* existsState is served from the slot index, so this doesn't touch the disk */
+    if (_states.existsState(ndx))
     {
       EnableMenuItem(_menu, IDM_LOAD_STATE_1 + ndx - 1, enabled);
     }
@@ -1700,13 +1787,13 @@ void Application::readyDisc(unsigned newDiscIndex)
     std::string path;
     if (_core.getDiscPath(newDiscIndex, path))
     {
-      if (!romLoaded(&_core, &_logger, _system, path, NULL, 0, true))
+      if (!romLoaded(&_core, &_logger, _system, path, std::string(), NULL, 0, true))
         return;
     }
     else if (newDiscIndex < _discPaths.size())
     {
       path = util::replaceFileName(_gamePath, _discPaths.at(newDiscIndex).c_str());
-      if (!romLoaded(&_core, &_logger, _system, path, NULL, 0, true))
+      if (!romLoaded(&_core, &_logger, _system, path, std::string(), NULL, 0, true))
         return;
     }
 
@@ -1822,6 +1909,57 @@ std::string Application::getConfigPath()
   return path;
 }
 
+std::string Application::getHashCachePath()
+{
+  std::string path = _config.getRootFolder();
+  path += "RALibretro.hashes";
+  return path;
+}
+
+std::string Application::createExtractionPath()
+{
+  if (_extractionRoot.empty())
+  {
+    wchar_t tempPath[MAX_PATH + 1];
+    const DWORD length = GetTempPathW(sizeof(tempPath) / sizeof(tempPath[0]), tempPath);
+    if (length == 0 || length > MAX_PATH)
+      return std::string();
+
+    /* the process id keeps concurrent sessions apart. CreateDirectory fails if the directory already
+     * exists, so one left behind by an earlier session is never reused */
+    for (int i = 0; i < 100; i++)
+    {
+      char name[64];
+      snprintf(name, sizeof(name), "RALibretro-%lu-%d\\", (unsigned long)GetCurrentProcessId(), i);
+
+      const std::string root = util::ucharToUtf8(tempPath) + name;
+      if (CreateDirectoryW(util::utf8ToUChar(root).c_str(), NULL))
+      {
+        _extractionRoot = root;
+        break;
+      }
+
+      if (GetLastError() != ERROR_ALREADY_EXISTS)
+        break;
+    }
+
+    if (_extractionRoot.empty())
+    {
+      _logger.error(TAG "Could not create a temporary directory in %s", util::ucharToUtf8(tempPath).c_str());
+      return std::string();
+    }
+  }
+
+  const std::string path = _extractionRoot + std::to_string(++_extractionCount) + '\\';
+  if (!CreateDirectoryW(util::utf8ToUChar(path).c_str(), NULL))
+  {
+    _logger.error(TAG "Could not create %s", path.c_str());
+    return std::string();
+  }
+
+  return path;
+}
+
 std::string Application::getCoreConfigPath(const std::string& coreName)
 {
   std::string path = _config.getRootFolder();
@@ -1874,10 +2012,7 @@ void Application::saveState(unsigned ndx)
   _video.showMessage(message, 60);
 
   if (ndx <= 10)
-  {
-    _validSlots |= 1 << ndx;
     enableSlots();
-  }
 }
 
 void Application::saveState()
@@ -1898,6 +2033,9 @@ void Application::loadState(const std::string& path)
 {
   if (_states.loadState(path))
   {
+    // the core may have reallocated its memory while restoring the state
+    _memory.update(&_core, _system);
+
     updateDiscMenu(false);
   }
 }
@@ -1915,7 +2053,7 @@ void Application::loadState(unsigned ndx)
     // we don't pre-validate the existance of save states that aren't displayed in the menu
     // also, we can't track more than 32 states that way and allow up to 99 numbered states
   }
-  else if ((_validSlots & (1 << ndx)) == 0)
+  else if (!_states.existsState(ndx))
   {
     return;
   }
@@ -1926,6 +2064,8 @@ void Application::loadState(unsigned ndx)
     snprintf(message, sizeof(message), "Loaded state %u", ndx);
     _video.showMessage(message, 60);
 
+    _memory.update(&_core, _system);
+
     updateDiscMenu(false);
   }
 }
@@ -1982,6 +2122,7 @@ void Application::screenshot()
 
 void Application::aboutDialog()
 {
+  _logger.flush();
   ::aboutDialog(_logger.contents().c_str());
 }
 
@@ -2435,6 +2576,10 @@ void Application::handle(const SDL_SysWMEvent* syswm)
       _video.showDialog();
       break;
 
+    case IDM_PERFORMANCE_OVERLAY:
+      togglePerformanceOverlay();
+      break;
+
     case IDM_EMULATOR_CONFIG:
       _config.showEmulatorSettingsDialog();
       updateMouseCapture();
@@ -2801,6 +2946,51 @@ void Application::setBackgroundInput(bool enabled)
   SetMenuItemInfo(_menu, IDM_INPUT_BACKGROUND_INPUT, false, &info);
 }
 
+void Application::togglePerformanceOverlay()
+{
+  const bool show = !_video.isPerformanceOverlayVisible();
+
+  // the overlay gets the time spent in each phase of the frame from the profiler
+  if (show && Profiler::active() == NULL)
+    _profiler.init(&_logger, 4096);
+
+  _video.showPerformanceOverlay(show);
+
+  const bool visible = _video.isPerformanceOverlayVisible();
+  // only stop the profiler, this is called while the frame's scopes are still open
+  if (!visible && _profilePath.empty() && Profiler::active() == &_profiler)
+    _profiler.stop();
+
+  MENUITEMINFO info;
+  memset(&info, 0, sizeof(info));
+  info.cbSize = sizeof(info);
+  info.fMask = MIIM_STATE;
+  info.fState = visible ? MFS_CHECKED : MFS_UNCHECKED;
+  SetMenuItemInfo(_menu, IDM_PERFORMANCE_OVERLAY, false, &info);
+}
+
+void Application::updatePerformanceOverlay()
+{
+  const Profiler* profiler = Profiler::active();
+  Profiler::FrameStats frame;
+
+  if (profiler == NULL || !profiler->getLastFrame(frame))
+    return;
+
+  Video::PerformanceStats stats;
+  stats.frameTime = frame.phases[(size_t)Profiler::Phase::Frame] / 1e6;
+  stats.coreTime = frame.phases[(size_t)Profiler::Phase::CoreStep] / 1e6;
+  stats.achievementsTime = frame.phases[(size_t)Profiler::Phase::AchievementsFrame] / 1e6;
+
+  const double fps = _core.getSystemAVInfo()->timing.fps;
+  stats.targetFrameTime = fps > 0.0 ? 1000.0 / fps : 1000.0 / 60.0;
+
+  stats.audioFill = (double)_fifo.occupied() / (double)_fifo.size();
+  stats.resamplerRatio = _audio.getResamplerRatio();
+
+  _video.updatePerformanceOverlay(stats);
+}
+
 bool Application::handleArgs(int argc, char* argv[])
 {
   std::string core; // -c or --core
@@ -2823,6 +3013,10 @@ bool Application::handleArgs(int argc, char* argv[])
       }
       else if (strcmp(currentArg, "-g") == 0 || strcmp(currentArg, "--game") == 0) {
         argCategory = 'g';
+      } else if (strcmp(currentArg, "-l") == 0 || strcmp(currentArg, "--log") == 0) {
+        argCategory = 'l';
+      } else if (strcmp(currentArg, "-p") == 0 || strcmp(currentArg, "--profile") == 0) {
+        argCategory = 'p';
       } else {
         argCategory = '\0';
       }
@@ -2846,6 +3040,17 @@ bool Application::handleArgs(int argc, char* argv[])
       case 'g':
         game.assign(currentArg);
         break;
+      case 'l':
+        if (!_logger.setLogLevels(currentArg)) {
+          _logger.error(TAG "error while parsing 'log' command line argument '%s' (i.e. \"warn,MEM=debug\" expected)", currentArg);
+        }
+        break;
+      case 'p':
+        // frames are profiled until the application exits, then the trace is written to the file
+        if (Profiler::active() == NULL)
+          _profiler.init(&_logger);
+        _profilePath.assign(currentArg);
+        break;
       
       default:
         break;
@@ -2864,7 +3069,7 @@ bool Application::handleArgs(int argc, char* argv[])
   if (!util::exists(game)) {
     std::string message = "File not found provided in 'game' command line argument '" + game + "'";
     
-    _logger.error(message.c_str());
+    _logger.error("%s", message.c_str());
 
     MessageBox(g_mainWindow, message.c_str(), "Failed to load game", MB_OK);
     return false;
@@ -2873,7 +3078,7 @@ bool Application::handleArgs(int argc, char* argv[])
   if (!doesCoreSupportSystem(core, system)) {
     std::string message = core + " core does not support system " + std::to_string(system);
     
-    _logger.error(message.c_str());
+    _logger.error("%s", message.c_str());
 
     MessageBox(g_mainWindow, message.c_str(), "Failed to load game", MB_OK);
     return false;
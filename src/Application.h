@@ -39,6 +39,7 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 #include "Emulator.h"
 #include "KeyBinds.h"
 #include "Memory.h"
+#include "Profiler.h"
 #include "States.h"
 
 class Application
@@ -91,6 +92,7 @@ protected:
 
   // Helpers
   void        processEvents();
+  void        doAchievementsFrame();
   void        runSmoothed();
   void        runTurbo();
   void        pauseForBadPerformance();
@@ -102,6 +104,8 @@ protected:
   void        updateDiscMenu(bool updateLabels);
   std::string getStatePath(unsigned ndx);
   std::string getConfigPath();
+  std::string getHashCachePath();
+  std::string createExtractionPath();
   std::string getCoreConfigPath(const std::string& coreName);
   std::string getScreenshotPath();
   void        saveState(const std::string& path);
@@ -130,6 +134,8 @@ protected:
   void        toggleFastForwarding(unsigned extra);
   void        toggleBackgroundInput();
   void        setBackgroundInput(bool enabled);
+  void        togglePerformanceOverlay();
+  void        updatePerformanceOverlay();
   void        toggleTray();
   void        readyNextDisc(int offset);
   void        readyDisc(unsigned newDiscIndex);
@@ -156,6 +162,8 @@ protected:
   Input        _input;
   Memory       _memory;
   States       _states;
+  Profiler     _profiler;
+  std::string  _profilePath;
 
   int          _numAudioFaults;
   int          _numAudioRecoveries;
@@ -176,8 +184,10 @@ protected:
   std::string _gamePath;
   std::string _gameFileName;
   void*       _gameData;
-  unsigned    _validSlots;
-  bool        _gamePathIsTemporary;
+  std::vector<std::string> _temporaryFiles; /* extracted content to delete when the game is unloaded */
+  std::string _temporaryPath;               /* directory the content was extracted to */
+  std::string _extractionRoot;              /* private directory for this session's extracted content */
+  unsigned    _extractionCount;
 
   HMENU _menu;
   HMENU _cdRomMenu;
@@ -0,0 +1,177 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Stores a sequence of save states in a chunk store the way States does for numbered slots, and
+ * reports how many bytes each state adds to the store and how long it takes to store and rebuild
+ * it. Give it the states of one game in the order they were saved, i.e. the .state files of its
+ * numbered slots. For RALibretro states only the core data (the MEM block) is stored, any other
+ * file is stored as a whole. The store directory should be empty, it's left in place so it can be
+ * inspected.
+ *
+ * usage: ChunkBenchmark <store directory> <state file>... */
+
+#include "ChunkStore.h"
+#include "Util.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_set>
+#include <vector>
+
+#define BENCHMARK_MEM_BLOCK "MEM "
+#define BENCHMARK_END_BLOCK "END "
+#define BENCHMARK_ENTRY_SIZE 20
+
+/* the core data of a RALibretro state, or the whole file */
+static void benchmark_core_data(const uint8_t* data, size_t size, const uint8_t** coreData, size_t* coreSize)
+{
+  *coreData = data;
+  *coreSize = size;
+
+  if (size < 8 || memcmp(data, "RASTATE", 7) != 0 || data[7] != 1)
+    return;
+
+  const uint8_t* input = data + 8;
+  const uint8_t* stop = data + size;
+  while (input + 8 <= stop)
+  {
+    const size_t blockSize = (input[7] << 24 | input[6] << 16 | input[5] << 8 | input[4]);
+    if (input + 8 + blockSize > stop || memcmp(input, BENCHMARK_END_BLOCK, 4) == 0)
+      break;
+
+    if (memcmp(input, BENCHMARK_MEM_BLOCK, 4) == 0)
+    {
+      *coreData = input + 8;
+      *coreSize = blockSize;
+      return;
+    }
+
+    input += 8 + ((blockSize + 7) & ~7);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 3)
+  {
+    fprintf(stderr, "usage: %s <store directory> <state file>...\n", argv[0]);
+    return 1;
+  }
+
+  Logger logger;
+  logger.init(NULL);
+  logger.setLogLevel(RETRO_LOG_WARN);
+
+  ChunkStore store;
+  store.init(&logger);
+  store.setDirectory(argv[1]);
+
+  std::vector<std::vector<uint8_t>> manifests;
+  std::vector<size_t> sizes;
+  std::unordered_set<std::string> digests;
+  size_t totalSize = 0, totalStored = 0;
+  double totalStoreTime = 0.0;
+
+  printf("%-40s %12s %12s %10s\n", "state", "core bytes", "new bytes", "store ms");
+
+  for (int i = 2; i < argc; i++)
+  {
+    size_t size;
+    uint8_t* data = (uint8_t*)util::loadFile(&logger, argv[i], &size);
+    if (data == NULL)
+    {
+      fprintf(stderr, "could not read %s\n", argv[i]);
+      return 1;
+    }
+
+    const uint8_t* coreData;
+    size_t coreSize;
+    benchmark_core_data(data, size, &coreData, &coreSize);
+
+    std::vector<uint8_t> manifest;
+    const auto start = std::chrono::steady_clock::now();
+    const bool stored = store.store(coreData, coreSize, manifest);
+    const auto end = std::chrono::steady_clock::now();
+
+    if (!stored)
+    {
+      fprintf(stderr, "could not store %s\n", argv[i]);
+      free(data);
+      return 1;
+    }
+
+    /* each manifest entry is the chunk size followed by its digest, only chunks not seen before are written */
+    size_t added = 0;
+    for (size_t j = 0; j + BENCHMARK_ENTRY_SIZE <= manifest.size(); j += BENCHMARK_ENTRY_SIZE)
+    {
+      const uint8_t* entry = &manifest[j];
+      if (digests.insert(std::string((const char*)entry + 4, BENCHMARK_ENTRY_SIZE - 4)).second)
+        added += (entry[3] << 24 | entry[2] << 16 | entry[1] << 8 | entry[0]);
+    }
+
+    totalStored += added;
+
+    const double storeTime = std::chrono::duration<double, std::milli>(end - start).count();
+    totalStoreTime += storeTime;
+    totalSize += coreSize;
+
+    printf("%-40s %12zu %12zu %10.3f\n", util::fileNameWithExtension(argv[i]).c_str(), coreSize, added, storeTime);
+
+    manifests.push_back(manifest);
+    sizes.push_back(coreSize);
+    free(data);
+  }
+
+  /* rebuild every state from its manifest, as loading a numbered slot does */
+  const auto start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < manifests.size(); i++)
+  {
+    size_t size;
+    void* data = store.load(manifests[i].data(), manifests[i].size(), &size);
+    if (data == NULL || size != sizes[i])
+    {
+      fprintf(stderr, "could not rebuild %s\n", argv[i + 2]);
+      return 1;
+    }
+
+    free(data);
+  }
+
+  const double loadTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  const size_t numStates = manifests.size();
+
+  /* collect the chunks only referenced by the other states, as if their slots had been overwritten */
+  const auto collectStart = std::chrono::steady_clock::now();
+
+  store.mark(manifests.back().data(), manifests.back().size());
+  store.sweep();
+
+  const double collectTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - collectStart).count();
+
+  printf("\n%zu states, %zu bytes of core data stored in %zu bytes (%.1f%%)\n", numStates, totalSize, totalStored,
+    totalSize ? totalStored * 100.0 / totalSize : 0.0);
+  printf("%.3f ms per store, %.3f ms per load\n", totalStoreTime / numStates, loadTime / numStates);
+  printf("%.3f ms to collect the chunks of all but the last state\n", collectTime);
+
+  logger.destroy();
+  return 0;
+}
@@ -0,0 +1,392 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ChunkStore.h"
+
+#include "Util.h"
+
+#include <libmincrypt/sha256.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+ #define WIN32_LEAN_AND_MEAN
+ #include <windows.h>
+ #define CHUNK_PATH_SEPARATOR "\\"
+#else
+ #include <dirent.h>
+ #include <sys/stat.h>
+ #define CHUNK_PATH_SEPARATOR "/"
+#endif
+
+#define TAG "[CHK] "
+
+/* chunk boundaries are placed where the rolling hash has CHUNK_MASK_BITS zero bits,
+ * giving an average chunk size of CHUNK_MIN_SIZE + (1 << CHUNK_MASK_BITS) */
+#define CHUNK_MIN_SIZE  (4 * 1024)
+#define CHUNK_MAX_SIZE  (64 * 1024)
+#define CHUNK_MASK_BITS 14
+#define CHUNK_MASK      ((((uint64_t)1 << CHUNK_MASK_BITS) - 1) << (64 - CHUNK_MASK_BITS))
+
+/* each manifest entry is a 4-byte little-endian chunk size followed by the truncated digest */
+#define CHUNK_DIGEST_SIZE 16
+#define CHUNK_ENTRY_SIZE  (4 + CHUNK_DIGEST_SIZE)
+
+static uint64_t s_gear[256];
+
+static void initGearTable()
+{
+  /* splitmix64 with a fixed seed so chunk boundaries are stable across runs */
+  uint64_t seed = 0x52414C6962726574ULL;
+  for (int i = 0; i < 256; i++)
+  {
+    uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    s_gear[i] = z ^ (z >> 31);
+  }
+}
+
+static size_t findChunkBoundary(const uint8_t* data, size_t size)
+{
+  if (size <= CHUNK_MIN_SIZE)
+    return size;
+
+  const size_t limit = (size < CHUNK_MAX_SIZE) ? size : CHUNK_MAX_SIZE;
+  uint64_t hash = 0;
+
+  for (size_t i = CHUNK_MIN_SIZE; i < limit; i++)
+  {
+    hash = (hash << 1) + s_gear[data[i]];
+    if ((hash & CHUNK_MASK) == 0)
+      return i + 1;
+  }
+
+  return limit;
+}
+
+static void ensureDirectory(const std::string& directory)
+{
+#if defined(_WINDOWS)
+  util::ensureDirectoryExists(directory);
+#elif defined(_WIN32)
+  CreateDirectoryA(directory.c_str(), NULL);
+#else
+  mkdir(directory.c_str(), 0755);
+#endif
+}
+
+static bool replaceFile(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+ #ifdef _WINDOWS
+  return MoveFileExW(util::utf8ToUChar(from).c_str(), util::utf8ToUChar(to).c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+ #else
+  return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+ #endif
+#else
+  return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+/* names of the files in directory that end with suffix, without the suffix */
+static void listFiles(const std::string& directory, const char* suffix, std::vector<std::string>& names)
+{
+  const size_t suffixLength = strlen(suffix);
+
+#if defined(_WINDOWS)
+  WIN32_FIND_DATAW fileData;
+  const std::wstring pattern = util::utf8ToUChar(directory + "\\*" + suffix);
+  HANDLE hFind = FindFirstFileW(pattern.c_str(), &fileData);
+  if (hFind != INVALID_HANDLE_VALUE)
+  {
+    do
+    {
+      std::string name = util::ucharToUtf8(fileData.cFileName);
+      name.resize(name.length() - suffixLength);
+      names.push_back(name);
+    } while (FindNextFileW(hFind, &fileData));
+
+    FindClose(hFind);
+  }
+#elif defined(_WIN32)
+  WIN32_FIND_DATAA fileData;
+  const std::string pattern = directory + "\\*" + suffix;
+  HANDLE hFind = FindFirstFileA(pattern.c_str(), &fileData);
+  if (hFind != INVALID_HANDLE_VALUE)
+  {
+    do
+    {
+      std::string name = fileData.cFileName;
+      name.resize(name.length() - suffixLength);
+      names.push_back(name);
+    } while (FindNextFileA(hFind, &fileData));
+
+    FindClose(hFind);
+  }
+#else
+  DIR* dirp = opendir(directory.c_str());
+  if (dirp)
+  {
+    struct dirent* dp;
+    while ((dp = readdir(dirp)))
+    {
+      const size_t length = strlen(dp->d_name);
+      if (length > suffixLength && memcmp(dp->d_name + length - suffixLength, suffix, suffixLength) == 0)
+        names.push_back(std::string(dp->d_name, length - suffixLength));
+    }
+
+    closedir(dirp);
+  }
+#endif
+}
+
+static std::string digestToString(const uint8_t* digest)
+{
+  static const char hex[] = "0123456789abcdef";
+  char buffer[CHUNK_DIGEST_SIZE * 2 + 1];
+
+  for (int i = 0; i < CHUNK_DIGEST_SIZE; i++)
+  {
+    buffer[i * 2] = hex[digest[i] >> 4];
+    buffer[i * 2 + 1] = hex[digest[i] & 0x0F];
+  }
+
+  buffer[CHUNK_DIGEST_SIZE * 2] = '\0';
+  return buffer;
+}
+
+bool ChunkStore::init(Logger* logger)
+{
+  _logger = logger;
+  _dirty = false;
+
+  if (s_gear[0] == 0)
+    initGearTable();
+
+  return true;
+}
+
+void ChunkStore::setDirectory(const std::string& directory)
+{
+  _directory = directory;
+  _known.clear();
+  _marked.clear();
+  _dirty = false;
+}
+
+std::string ChunkStore::chunkPath(const uint8_t* digest) const
+{
+  return _directory + CHUNK_PATH_SEPARATOR + digestToString(digest) + ".chunk";
+}
+
+bool ChunkStore::store(const void* data, size_t size, std::vector<uint8_t>& manifest)
+{
+  const clock_t start = clock();
+  const uint8_t* input = (const uint8_t*)data;
+  const uint8_t* stop = input + size;
+  unsigned numChunks = 0, numNewChunks = 0;
+  size_t bytesWritten = 0;
+
+  ensureDirectory(_directory);
+
+  manifest.clear();
+  manifest.reserve((size / CHUNK_MIN_SIZE + 1) * CHUNK_ENTRY_SIZE);
+
+  while (input < stop)
+  {
+    const size_t chunkSize = findChunkBoundary(input, stop - input);
+
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    SHA256_hash(input, (int)chunkSize, digest);
+
+    uint8_t entry[CHUNK_ENTRY_SIZE];
+    entry[0] = (chunkSize & 0xFF);
+    entry[1] = ((chunkSize >> 8) & 0xFF);
+    entry[2] = ((chunkSize >> 16) & 0xFF);
+    entry[3] = ((chunkSize >> 24) & 0xFF);
+    memcpy(&entry[4], digest, CHUNK_DIGEST_SIZE);
+    manifest.insert(manifest.end(), entry, entry + sizeof(entry));
+
+    std::string name = digestToString(digest);
+    if (_known.find(name) == _known.end())
+    {
+      const std::string path = chunkPath(digest);
+      if (!util::exists(path))
+      {
+        /* write to a temporary file first so a partially written chunk never has a valid name */
+        const std::string tempPath = path + ".tmp";
+        FILE* file = util::openFile(_logger, tempPath, "wb");
+        if (file == NULL)
+          return false;
+
+        const bool written = (fwrite(input, 1, chunkSize, file) == chunkSize);
+        fclose(file);
+
+        if (!written || !replaceFile(tempPath, path))
+        {
+          _logger->error(TAG "Error writing chunk \"%s\"", path.c_str());
+          util::deleteFile(tempPath);
+          return false;
+        }
+
+        bytesWritten += chunkSize;
+        numNewChunks++;
+        _dirty = true;
+      }
+
+      _known.insert(name);
+    }
+
+    numChunks++;
+    input += chunkSize;
+  }
+
+  const unsigned elapsed = (unsigned)((clock() - start) * 1000 / CLOCKS_PER_SEC);
+  _logger->debug(TAG "Stored %zu bytes as %u chunks (%u new, %zu bytes written) in %ums",
+    size, numChunks, numNewChunks, bytesWritten, elapsed);
+
+  return true;
+}
+
+void* ChunkStore::load(const void* manifest, size_t manifestSize, size_t* size)
+{
+  const uint8_t* entry = (const uint8_t*)manifest;
+  const uint8_t* stop = entry + (manifestSize - manifestSize % CHUNK_ENTRY_SIZE);
+
+  size_t totalSize = 0;
+  for (const uint8_t* scan = entry; scan < stop; scan += CHUNK_ENTRY_SIZE)
+    totalSize += (scan[3] << 24 | scan[2] << 16 | scan[1] << 8 | scan[0]);
+
+  uint8_t* data = (uint8_t*)malloc(totalSize ? totalSize : 1);
+  if (data == NULL)
+  {
+    _logger->error(TAG "Out of memory allocating %zu bytes for the chunked state", totalSize);
+    return NULL;
+  }
+
+  uint8_t* output = data;
+  for (; entry < stop; entry += CHUNK_ENTRY_SIZE)
+  {
+    const size_t chunkSize = (entry[3] << 24 | entry[2] << 16 | entry[1] << 8 | entry[0]);
+    const std::string path = chunkPath(&entry[4]);
+
+    FILE* file = util::openFile(_logger, path, "rb");
+    if (file == NULL)
+    {
+      free(data);
+      return NULL;
+    }
+
+    const size_t numRead = fread(output, 1, chunkSize, file);
+    fclose(file);
+
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    if (numRead != chunkSize || memcmp(SHA256_hash(output, (int)chunkSize, digest), &entry[4], CHUNK_DIGEST_SIZE) != 0)
+    {
+      _logger->error(TAG "Chunk \"%s\" is corrupt", path.c_str());
+      free(data);
+      return NULL;
+    }
+
+    output += chunkSize;
+  }
+
+  *size = totalSize;
+  return data;
+}
+
+void ChunkStore::adopt(const std::string& directory)
+{
+  if (_directory.empty() || directory == _directory)
+    return;
+
+  std::vector<std::string> names;
+  listFiles(directory, ".chunk", names);
+  if (names.empty())
+    return;
+
+  ensureDirectory(_directory);
+
+  size_t numMoved = 0;
+  for (const auto& name : names)
+  {
+    const std::string from = directory + CHUNK_PATH_SEPARATOR + name + ".chunk";
+    const std::string to = _directory + CHUNK_PATH_SEPARATOR + name + ".chunk";
+
+    /* identical names have identical contents, so an existing chunk can be kept */
+    if (util::exists(to))
+      util::deleteFile(from);
+    else if (replaceFile(from, to))
+      numMoved++;
+    else
+      _logger->warn(TAG "Error moving chunk \"%s\"", from.c_str());
+  }
+
+  _logger->info(TAG "Moved %zu chunks from \"%s\" to \"%s\"", numMoved, directory.c_str(), _directory.c_str());
+
+  /* the source store may have held chunks that no migrated state references */
+  _dirty = true;
+}
+
+void ChunkStore::mark(const void* manifest, size_t manifestSize)
+{
+  const uint8_t* entry = (const uint8_t*)manifest;
+  const uint8_t* stop = entry + (manifestSize - manifestSize % CHUNK_ENTRY_SIZE);
+
+  for (; entry < stop; entry += CHUNK_ENTRY_SIZE)
+    _marked.insert(digestToString(&entry[4]));
+}
+
+void ChunkStore::clearMarks()
+{
+  _marked.clear();
+}
+
+void ChunkStore::sweep()
+{
+  std::vector<std::string> names;
+  listFiles(_directory, ".chunk", names);
+
+  size_t numRemoved = 0;
+  for (const auto& name : names)
+  {
+    if (_marked.find(name) == _marked.end())
+    {
+      util::deleteFile(_directory + CHUNK_PATH_SEPARATOR + name + ".chunk");
+      _known.erase(name);
+      numRemoved++;
+    }
+  }
+
+  /* chunks whose write was interrupted */
+  names.clear();
+  listFiles(_directory, ".chunk.tmp", names);
+
+  for (const auto& name : names)
+    util::deleteFile(_directory + CHUNK_PATH_SEPARATOR + name + ".chunk.tmp");
+
+  _logger->info(TAG "Removed %zu unreferenced chunks and %zu incomplete chunks from \"%s\"",
+    numRemoved, names.size(), _directory.c_str());
+
+  clearMarks();
+  _dirty = false;
+}
@@ -0,0 +1,62 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "components/Logger.h"
+
+#include <stdint.h>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/* Content-addressed storage for serialized core data. The data is split into
+ * content-defined chunks, each chunk is written once to the store directory
+ * (named after its digest), and the caller keeps a manifest listing the chunks
+ * needed to rebuild the data. */
+class ChunkStore
+{
+public:
+  bool init(Logger* logger);
+
+  void setDirectory(const std::string& directory);
+  bool isDirty() const { return _dirty; }
+
+  bool  store(const void* data, size_t size, std::vector<uint8_t>& manifest);
+  void* load(const void* manifest, size_t manifestSize, size_t* size);
+
+  /* moves the chunks of the store in directory into this one, for states migrated along with them */
+  void  adopt(const std::string& directory);
+
+  /* garbage collection: mark every live manifest, then sweep the unreferenced chunks. if not all
+   * the manifests could be marked, clearMarks must be called instead of sweep */
+  void  mark(const void* manifest, size_t manifestSize);
+  void  clearMarks();
+  void  sweep();
+
+protected:
+  std::string chunkPath(const uint8_t* digest) const;
+
+  Logger* _logger;
+  std::string _directory;
+
+  std::unordered_set<std::string> _known;
+  std::unordered_set<std::string> _marked;
+  bool _dirty = false;
+};
@@ -0,0 +1,110 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CpuFeatures.h"
+
+#include <atomic>
+#include <stddef.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+ #define CPU_X86
+ #ifdef _MSC_VER
+  #include <intrin.h>
+ #else
+  #include <cpuid.h>
+ #endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+ #define CPU_ARM64
+ #if defined(_WIN32)
+  #define WIN32_LEAN_AND_MEAN
+  #include <windows.h>
+ #elif defined(__linux__)
+  #include <asm/hwcap.h>
+  #include <sys/auxv.h>
+ #endif
+#endif
+
+static std::atomic<unsigned> g_disabledFeatures(0);
+
+static unsigned cpu_detect_features()
+{
+  unsigned features = 0;
+
+#if defined(CPU_X86)
+  unsigned leaf1[4] = { 0, 0, 0, 0 }; /* eax, ebx, ecx, edx */
+  unsigned leaf7[4] = { 0, 0, 0, 0 };
+
+ #ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  const int maxLeaf = info[0];
+
+  __cpuid(info, 1);
+  leaf1[2] = (unsigned)info[2];
+
+  if (maxLeaf >= 7)
+  {
+    __cpuidex(info, 7, 0);
+    leaf7[1] = (unsigned)info[1];
+  }
+ #else
+  __get_cpuid(1, &leaf1[0], &leaf1[1], &leaf1[2], &leaf1[3]);
+  if (__get_cpuid_max(0, NULL) >= 7)
+    __cpuid_count(7, 0, leaf7[0], leaf7[1], leaf7[2], leaf7[3]);
+ #endif
+
+  const bool ssse3 = (leaf1[2] & (1 << 9)) != 0;
+  const bool sse41 = (leaf1[2] & (1 << 19)) != 0;
+  const bool aesni = (leaf1[2] & (1 << 25)) != 0;
+  const bool sha = (leaf7[1] & (1 << 29)) != 0;
+
+  if (aesni && sse41)
+    features |= CPU_FEATURE_AES;
+
+  if (sha && ssse3 && sse41)
+    features |= CPU_FEATURE_SHA256;
+#elif defined(CPU_ARM64)
+ #if defined(_WIN32)
+  if (IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE))
+    features |= CPU_FEATURE_AES | CPU_FEATURE_SHA256;
+ #elif defined(__linux__)
+  const unsigned long hwcap = getauxval(AT_HWCAP);
+  if (hwcap & HWCAP_AES)
+    features |= CPU_FEATURE_AES;
+  if (hwcap & HWCAP_SHA2)
+    features |= CPU_FEATURE_SHA256;
+ #elif defined(__APPLE__)
+  /* every arm64 Apple processor has the crypto extensions */
+  features |= CPU_FEATURE_AES | CPU_FEATURE_SHA256;
+ #endif
+#endif
+
+  return features;
+}
+
+unsigned cpu_features(void)
+{
+  static const unsigned features = cpu_detect_features();
+  return features & ~g_disabledFeatures.load(std::memory_order_relaxed);
+}
+
+void cpu_disable_features(unsigned features)
+{
+  g_disabledFeatures.fetch_or(features, std::memory_order_relaxed);
+}
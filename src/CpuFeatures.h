@@ -0,0 +1,40 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+/* Runtime detection of the instruction set extensions used by the AES and SHA-256 backends. This
+ * is also called from C code (libmincrypt), so the interface is plain C. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CPU_FEATURE_AES    0x01   /* AES-NI, or the ARMv8 AES instructions */
+#define CPU_FEATURE_SHA256 0x02   /* SHA extensions, or the ARMv8 SHA2 instructions */
+
+/* returns the features supported by the processor that haven't been disabled */
+unsigned cpu_features(void);
+
+/* makes cpu_features report the features as unavailable so the portable code is used instead */
+void cpu_disable_features(unsigned features);
+
+#ifdef __cplusplus
+}
+#endif
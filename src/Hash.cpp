@@ -19,15 +19,24 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "Hash.h"
 
+#include "CdRom.h"
 #include "Core.h"
+#include "HashCache.h"
 #include "Util.h"
 
 #include <RA_Interface.h>
 #include <rc_hash.h>
 #include <rcheevos/src/rc_libretro.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory.h>
+#include <mutex>
 #include <string.h>
+#include <thread>
+#include <vector>
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -35,9 +44,12 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 
 #ifdef HAVE_CHD
 void rc_hash_init_chd_cdreader(); /* in HashCHD.cpp */
+void rc_hash_get_chd_cdreader(struct rc_hash_cdreader* cdreader); /* in HashCHD.cpp */
 #endif
 
 void initHash3DS(const std::string& systemDir); /* in Hash3DS.cpp */
+void rc_hash_get_mapped_filereader(struct rc_hash_filereader* filereader, Logger* logger); /* in HashFileReader.cpp */
+void rc_hash_track_opened_files(std::vector<std::string>* files); /* in HashFileReader.cpp */
 
 #define TAG "[HASH]"
 
@@ -45,8 +57,50 @@ void initHash3DS(const std::string& systemDir); /* in Hash3DS.cpp */
 static int g_activeGame = 0;
 static rc_libretro_hash_set_t g_hashSet;
 
+/* rc_hash's callbacks are global. they're copied into an iterator when it's initialized, which also
+ * happens on the background hashing thread */
+static std::mutex g_rhashConfigMutex;
+
+/* Hashes the other discs of a multi-disc game on a low priority thread, so swapping discs doesn't
+ * stop the game to hash the new disc. Games can only be identified on the main thread, so the
+ * hashes are added to g_hashSet when the disc is inserted. */
+typedef struct background_hash_t
+{
+  std::string path;
+  std::string hash;   /* empty if the disc couldn't be hashed */
+  std::vector<std::string> files; /* the files the hash was generated from */
+  bool cached;        /* found in (or already added to) the hash cache */
+} background_hash_t;
+
+static struct
+{
+  std::mutex mutex;
+  std::condition_variable finished;
+  std::thread thread;
+  std::atomic<bool> stop;
+  std::deque<std::string> pending;
+  std::string current;                    /* path being hashed, empty if none */
+  std::vector<background_hash_t> results;
+  std::vector<std::string> errors;        /* logged by the main thread */
+  int consoleId;
+} g_backgroundHash;
+
+static thread_local bool g_isBackgroundHashThread = false;
+
+static void rhash_queue_background_error_message(const char* message)
+{
+  std::lock_guard<std::mutex> lock(g_backgroundHash.mutex);
+  g_backgroundHash.errors.push_back(message);
+}
+
 static void rhash_display_error_message(const char* message)
 {
+  if (g_isBackgroundHashThread)
+  {
+    rhash_queue_background_error_message(message);
+    return;
+  }
+
 #ifdef _WINDOWS
   extern HWND g_mainWindow;
   MessageBoxA(g_mainWindow, (LPCSTR)message, "Unable to identify game", MB_OK);
@@ -55,16 +109,16 @@ static void rhash_display_error_message(const char* message)
 #endif
 }
 
+static HashCache g_hashCache;
+
 static Logger* g_logger = NULL;
 static libretro::Core* g_core = NULL;
-static void* rhash_file_open(const char* path)
-{
-  return util::openFile(g_logger, path, "rb");
-}
-
 void rhash_log_error_message(const char* message)
 {
-  g_logger->warn(TAG "%s", message);
+  if (g_isBackgroundHashThread)
+    rhash_queue_background_error_message(message);
+  else
+    g_logger->warn(TAG "%s", message);
 }
 
 static int rhash_get_image_path(unsigned index, char* buffer, size_t buffer_size)
@@ -77,7 +131,229 @@ static int rhash_get_image_path(unsigned index, char* buffer, size_t buffer_size
   return 1;
 }
 
-bool romLoaded(libretro::Core* core, Logger* logger, int system, const std::string& path, void* rom, size_t size, bool changingDiscs)
+/* reads are abandoned if the game is unloaded, so it doesn't have to wait for the hash to finish */
+static struct rc_hash_filereader g_backgroundFileReader;
+static struct rc_hash_cdreader g_backgroundCdReader;
+
+static size_t rhash_background_read(void* file_handle, void* buffer, size_t requested_bytes)
+{
+  if (g_backgroundHash.stop)
+    return 0;
+
+  return g_backgroundFileReader.read(file_handle, buffer, requested_bytes);
+}
+
+static size_t rhash_background_read_sector(void* track_handle, uint32_t sector, void* buffer, size_t requested_bytes)
+{
+  if (g_backgroundHash.stop)
+    return 0;
+
+  return g_backgroundCdReader.read_sector(track_handle, sector, buffer, requested_bytes);
+}
+
+static bool rhash_generate_in_background(int consoleId, const std::string& path, char hash[33], std::vector<std::string>& files)
+{
+  rc_hash_iterator_t iterator;
+  const std::string ext = util::extension(path);
+
+  {
+    std::lock_guard<std::mutex> lock(g_rhashConfigMutex);
+    rc_hash_initialize_iterator(&iterator, path.c_str(), NULL, 0);
+  }
+
+  rc_hash_get_mapped_filereader(&g_backgroundFileReader, g_logger);
+  iterator.callbacks.filereader = g_backgroundFileReader;
+  iterator.callbacks.filereader.read = rhash_background_read;
+
+  if (ext.length() == 4 && tolower(ext[1]) == 'c' && tolower(ext[2]) == 'h' && tolower(ext[3]) == 'd')
+  {
+#ifdef HAVE_CHD
+    rc_hash_get_chd_cdreader(&g_backgroundCdReader);
+#else
+    rc_hash_destroy_iterator(&iterator);
+    return false;
+#endif
+  }
+  else
+  {
+    rc_hash_get_default_cdreader(&g_backgroundCdReader);
+  }
+
+  iterator.callbacks.cdreader = g_backgroundCdReader;
+  iterator.callbacks.cdreader.read_sector = rhash_background_read_sector;
+
+  rc_hash_track_opened_files(&files);
+  const bool result = rc_hash_generate(hash, consoleId, &iterator) != 0;
+  rc_hash_track_opened_files(NULL);
+  rc_hash_destroy_iterator(&iterator);
+
+  /* a partial read because the game was unloaded may have produced a hash */
+  return result && !g_backgroundHash.stop;
+}
+
+static void rhash_background_hash_thread()
+{
+  /* also lowers the I/O priority, so reading the discs doesn't stall the game's own reads */
+  SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+  g_isBackgroundHashThread = true;
+
+  std::unique_lock<std::mutex> lock(g_backgroundHash.mutex);
+  while (!g_backgroundHash.stop && !g_backgroundHash.pending.empty())
+  {
+    background_hash_t result;
+    result.path = g_backgroundHash.current = g_backgroundHash.pending.front();
+    g_backgroundHash.pending.pop_front();
+    const int consoleId = g_backgroundHash.consoleId;
+    lock.unlock();
+
+    char hash[33];
+    result.cached = g_hashCache.lookup(result.path, std::string(), consoleId, NULL, 0, hash);
+    if (result.cached || rhash_generate_in_background(consoleId, result.path, hash, result.files))
+      result.hash = hash;
+
+    lock.lock();
+    g_backgroundHash.current.clear();
+    if (!g_backgroundHash.stop)
+      g_backgroundHash.results.push_back(std::move(result));
+    g_backgroundHash.finished.notify_all();
+  }
+}
+
+static void rhash_start_background_hashing(libretro::Core* core, int consoleId, const std::string& path)
+{
+  std::vector<std::string> discPaths;
+
+  const unsigned numDiscs = core->getNumDiscs();
+  for (unsigned i = 0; i < numDiscs; i++)
+  {
+    std::string discPath;
+    if (core->getDiscPath(i, discPath))
+      discPaths.push_back(discPath);
+  }
+
+  if (discPaths.empty())
+  {
+    /* the core doesn't expose the paths, see if the discs are listed in a playlist */
+    std::vector<std::string> names;
+    const std::string ext = util::extension(path);
+    if (ext.length() == 4 && tolower(ext[1]) == 'm' && tolower(ext[2]) == '3' && tolower(ext[3]) == 'u' &&
+        cdrom_get_cd_names(path.c_str(), &names, g_logger) > 1)
+    {
+      for (auto& name : names)
+      {
+        while (!name.empty() && isspace((unsigned char)name.back()))
+          name.pop_back();
+
+        if (!name.empty() && name[0] != '#')
+          discPaths.push_back(util::replaceFileName(path, name.c_str()));
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(g_backgroundHash.mutex);
+  for (const auto& discPath : discPaths)
+  {
+    /* the loaded disc and any save disks are already in the hash set */
+    if (rc_libretro_hash_set_get_hash(&g_hashSet, discPath.c_str()))
+      continue;
+
+    if (std::find(g_backgroundHash.pending.begin(), g_backgroundHash.pending.end(), discPath) == g_backgroundHash.pending.end())
+      g_backgroundHash.pending.push_back(discPath);
+  }
+
+  if (g_backgroundHash.pending.empty())
+    return;
+
+  g_logger->info(TAG "Hashing %zu other discs in the background", g_backgroundHash.pending.size());
+
+  g_backgroundHash.consoleId = consoleId;
+  g_backgroundHash.stop = false;
+  g_backgroundHash.thread = std::thread(rhash_background_hash_thread);
+}
+
+/* logs the errors from the background thread and caches the hashes it generated. if the hash for
+ * path is available, it's added to g_hashSet. must be called on the main thread */
+static void rhash_collect_background_hashes(const std::string& path)
+{
+  std::vector<background_hash_t> results;
+  std::vector<std::string> errors;
+
+  {
+    std::unique_lock<std::mutex> lock(g_backgroundHash.mutex);
+
+    if (!path.empty())
+    {
+      /* if the disc is being hashed, wait for it. if it hasn't been started, the caller will hash it */
+      g_backgroundHash.finished.wait(lock, [&path]() { return g_backgroundHash.current != path; });
+
+      const auto iter = std::find(g_backgroundHash.pending.begin(), g_backgroundHash.pending.end(), path);
+      if (iter != g_backgroundHash.pending.end())
+        g_backgroundHash.pending.erase(iter);
+    }
+
+    errors.swap(g_backgroundHash.errors);
+
+    /* only the disc being inserted is identified, the others are kept until they're needed */
+    for (auto& result : g_backgroundHash.results)
+    {
+      if (!result.cached && !result.hash.empty())
+      {
+        g_hashCache.store(result.path, std::string(), g_backgroundHash.consoleId, NULL, 0, result.files, result.hash.c_str());
+        result.cached = true;
+      }
+    }
+
+    for (auto iter = g_backgroundHash.results.begin(); iter != g_backgroundHash.results.end(); ++iter)
+    {
+      if (iter->path == path)
+      {
+        results.push_back(std::move(*iter));
+        g_backgroundHash.results.erase(iter);
+        break;
+      }
+    }
+  }
+
+  for (const auto& error : errors)
+    g_logger->warn(TAG "%s", error.c_str());
+
+  for (const auto& result : results)
+  {
+    const unsigned gameId = result.hash.empty() ? 0 : RA_IdentifyHash(result.hash.c_str());
+    rc_libretro_hash_set_add(&g_hashSet, result.path.c_str(), gameId, result.hash.c_str());
+  }
+}
+
+static void rhash_stop_background_hashing()
+{
+  {
+    std::lock_guard<std::mutex> lock(g_backgroundHash.mutex);
+    g_backgroundHash.stop = true;
+    g_backgroundHash.pending.clear();
+  }
+
+  if (g_backgroundHash.thread.joinable())
+    g_backgroundHash.thread.join();
+
+  /* keep the hashes of the discs that weren't inserted for next time */
+  rhash_collect_background_hashes(std::string());
+
+  std::lock_guard<std::mutex> lock(g_backgroundHash.mutex);
+  g_backgroundHash.results.clear();
+}
+
+void setHashCache(Logger* logger, const std::string& path)
+{
+  if (path == g_hashCache.getPath())
+    return;
+
+  if (path.empty())
+    g_hashCache.destroy();
+  else
+    g_hashCache.init(logger, path);
+}
+
+bool romLoaded(libretro::Core* core, Logger* logger, int system, const std::string& path, const std::string& entryName, void* rom, size_t size, bool changingDiscs)
 {
   unsigned int gameId = 0;
   char hash[33];
@@ -85,16 +361,26 @@ bool romLoaded(libretro::Core* core, Logger* logger, int system, const std::stri
 
   g_logger = logger;
 
-  /* don't pop up error message when changing discs */
-  if (changingDiscs)
-    rc_hash_init_error_message_callback(rhash_log_error_message);
-  else
-    rc_hash_init_error_message_callback(rhash_display_error_message);
+  if (!changingDiscs)
+    rhash_stop_background_hashing();
+
+  {
+    std::lock_guard<std::mutex> lock(g_rhashConfigMutex);
+
+    /* don't pop up error message when changing discs */
+    if (changingDiscs)
+      rc_hash_init_error_message_callback(rhash_log_error_message);
+    else
+      rc_hash_init_error_message_callback(rhash_display_error_message);
+  }
 
   hash[0] = '\0';
 
   if (changingDiscs)
   {
+    /* use the hash from the background thread if it's hashed (or hashing) the disc */
+    rhash_collect_background_hashes(path);
+
     const char* existingHash = rc_libretro_hash_set_get_hash(&g_hashSet, path.c_str());
     if (existingHash)
     {
@@ -107,7 +393,7 @@ bool romLoaded(libretro::Core* core, Logger* logger, int system, const std::stri
   {
     rc_hash_iterator_t hash_iterator;
     rc_hash_initialize_iterator(&hash_iterator, NULL, NULL, 0);
-    hash_iterator.callbacks.filereader.open = rhash_file_open;
+    rc_hash_get_mapped_filereader(&hash_iterator.callbacks.filereader, logger);
 
     g_core = core;
     rc_libretro_hash_set_init(&g_hashSet, path.c_str(), rhash_get_image_path, &hash_iterator.callbacks.filereader);
@@ -124,9 +410,10 @@ bool romLoaded(libretro::Core* core, Logger* logger, int system, const std::stri
       rc_hash_iterator_t hash_iterator;
       std::string ext = util::extension(path);
 
-      /* register a custom file_open handler for unicode support. use the default implementation for the other methods */
-      memset(&filereader, 0, sizeof(filereader));
-      filereader.open = rhash_file_open;
+      std::unique_lock<std::mutex> configLock(g_rhashConfigMutex);
+
+      /* read files through memory mapped views. this also handles unicode paths */
+      rc_hash_get_mapped_filereader(&filereader, logger);
       rc_hash_init_custom_filereader(&filereader);
 
       if (ext.length() == 4 && tolower(ext[1]) == 'c' && tolower(ext[2]) == 'h' && tolower(ext[3]) == 'd')
@@ -148,19 +435,37 @@ bool romLoaded(libretro::Core* core, Logger* logger, int system, const std::stri
           {
             std::string discPath;
             if (core->getDiscPath(core->getCurrentDiscIndex(), discPath) && discPath != path)
-              return romLoaded(core, logger, system, discPath, rom, size, changingDiscs);
+            {
+              configLock.unlock();
+              return romLoaded(core, logger, system, discPath, std::string(), rom, size, changingDiscs);
+            }
           }
         }
 
         rc_hash_init_default_cdreader();
       }
 
+      configLock.unlock();
+
       if (system == RC_CONSOLE_NINTENDO_3DS)
         initHash3DS(core->getSystemDirectory());
 
       /* generate a hash for the new content */
-      rc_hash_initialize_iterator(&hash_iterator, path.c_str(), (const uint8_t*)rom, size);
-      rc_hash_generate(hash, (int)system, &hash_iterator);
+      if (g_hashCache.lookup(path, entryName, system, rom, size, hash))
+      {
+        logger->info(TAG "Using cached hash %s", hash);
+      }
+      else
+      {
+        std::vector<std::string> files;
+        rc_hash_initialize_iterator(&hash_iterator, path.c_str(), (const uint8_t*)rom, size);
+        rc_hash_track_opened_files(&files);
+        const bool generated = rc_hash_generate(hash, (int)system, &hash_iterator) != 0;
+        rc_hash_track_opened_files(NULL);
+
+        if (generated)
+          g_hashCache.store(path, entryName, system, rom, size, files, hash);
+      }
     }
 
     /* identify the game associated to the hash */
@@ -175,6 +480,9 @@ bool romLoaded(libretro::Core* core, Logger* logger, int system, const std::stri
     /* when not changing discs, just activate the new game */
     g_activeGame = gameId;
     RA_ActivateGame(gameId);
+
+    /* hash the other discs now, so swapping discs doesn't have to */
+    rhash_start_background_hashing(core, system, path);
   }
   else if (gameId != 0)
   {
@@ -201,6 +509,8 @@ bool romLoaded(libretro::Core* core, Logger* logger, int system, const std::stri
 
 void romUnloaded(Logger* logger)
 {
+  rhash_stop_background_hashing();
+
   rc_libretro_hash_set_destroy(&g_hashSet);
   g_activeGame = 0;
   RA_ActivateGame(0);
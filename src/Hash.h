@@ -38,5 +38,9 @@ namespace libretro
   class Core;
 }
 
-bool   romLoaded(libretro::Core* core, Logger* logger, int consoleId, const std::string& path, void* rom, size_t size, bool changingDiscs);
+/* enables the on-disk hash cache used by romLoaded, or disables it if path is empty */
+void   setHashCache(Logger* logger, const std::string& path);
+
+/* entryName is the file rom was extracted from when path is an archive, or empty */
+bool   romLoaded(libretro::Core* core, Logger* logger, int consoleId, const std::string& path, const std::string& entryName, void* rom, size_t size, bool changingDiscs);
 void   romUnloaded(Logger* logger);
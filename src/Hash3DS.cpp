@@ -25,14 +25,18 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <libmincrypt/sha256.h>
 
+#include <algorithm>
+#include <array>
 #include <string.h>
+#include <unordered_map>
+#include <vector>
 
 void rhash_log_error_message(const char* message); /* in Hash.c */
 
 #undef DEBUG_AES_KEYS
 
-/* for finding aes_keys.txt and seeddb.bin */
-static std::string g_systemDir = ".";
+/* where aes_keys.txt and seeddb.bin were loaded from */
+static std::string g_systemDir;
 
 static void rhash_read_128bit_hex(const char* hex, uint8_t key[16])
 {
@@ -110,92 +114,159 @@ static int rhash_3ds_normalize_keys(uint8_t keyX[16], uint8_t keyY[16], uint8_t
   return 0;
 }
 
-static int rhash_3ds_lookup_cia_normal_key(uint8_t index, uint8_t key[16])
+/* aes_keys.txt and seeddb.bin are parsed once by initHash3DS and shared by all hashing threads */
+typedef std::array<uint8_t, 16> rhash_3ds_key_t;
+
+typedef struct rhash_3ds_seed_t
+{
+  uint8_t programId[8];
+  uint8_t seed[16];
+} rhash_3ds_seed_t;
+
+static bool g_aesKeysLoaded = false;
+static time_t g_aesKeysTime = 0;
+static std::unordered_map<std::string, rhash_3ds_key_t> g_aesKeys; /* "slot0x2CKeyX" => key */
+static std::unordered_map<uint8_t, rhash_3ds_key_t> g_ciaNormalKeys; /* common key index => normalized key */
+
+static bool g_seedsLoaded = false;
+static time_t g_seedsTime = 0;
+static std::vector<rhash_3ds_seed_t> g_seeds; /* sorted by programId */
+
+static bool rhash_3ds_compare_seed(const rhash_3ds_seed_t& seed, const uint8_t* programId)
+{
+  return memcmp(seed.programId, programId, sizeof(seed.programId)) < 0;
+}
+
+static void rhash_3ds_load_aes_keys(const std::string& path)
 {
-  char scan[16];
-  size_t scan_len;
   char buffer[128];
-  uint8_t keyX[16];
-  uint8_t keyY[16];
   char* line;
 
-  FILE* fp = util::openFile(nullptr, g_systemDir + "/aes_keys.txt", "r");
+  g_aesKeys.clear();
+  g_ciaNormalKeys.clear();
+
+  FILE* fp = util::openFile(nullptr, path, "r");
+  g_aesKeysLoaded = (fp != NULL);
   if (!fp)
+    return;
+
+  while ((line = fgets(buffer, sizeof(buffer), fp)))
   {
-    rhash_log_error_message("Could not open aes_keys.txt");
-    return 0;
+    const char* separator = strchr(line, '=');
+    if (!separator || strspn(separator + 1, "0123456789ABCDEFabcdef") < 32)
+      continue;
+
+    /* if a key is listed more than once, the first one is used */
+    rhash_3ds_key_t key;
+    rhash_read_128bit_hex(separator + 1, key.data());
+    g_aesKeys.emplace(std::string(line, separator - line), key);
   }
 
-  keyX[0] = 0;
-  keyY[0] = 0;
-  scan_len = snprintf(scan, sizeof(scan), "common%u=", index);
+  fclose(fp);
 
-  while ((line = fgets(buffer, sizeof(buffer), fp)))
+  /* the CIA keys only depend on aes_keys.txt, so normalize them now */
+  const auto keyX = g_aesKeys.find("slot0x3DKeyX");
+  if (keyX != g_aesKeys.end())
   {
-    if (memcmp(line, scan, scan_len) == 0)
+    for (unsigned index = 0; index < 256; ++index)
     {
-      rhash_read_128bit_hex(line + scan_len, keyY);
-      if (keyX[0])
-        break;
+      const auto keyY = g_aesKeys.find("common" + std::to_string(index));
+      if (keyY == g_aesKeys.end())
+        continue;
+
+      rhash_3ds_key_t x = keyX->second, y = keyY->second, normalKey;
+      if (rhash_3ds_normalize_keys(x.data(), y.data(), normalKey.data()))
+        g_ciaNormalKeys.emplace((uint8_t)index, normalKey);
     }
-    else if (memcmp(line, "slot0x3DKeyX=", 13) == 0)
+  }
+}
+
+static void rhash_3ds_load_seeds(const std::string& path)
+{
+  uint8_t header[16];
+  uint8_t record[32];
+  uint32_t count;
+
+  g_seeds.clear();
+
+  FILE* fp = util::openFile(nullptr, path, "rb");
+  g_seedsLoaded = (fp != NULL);
+  if (!fp)
+    return;
+
+  /* seeddb.bin's layout is simply the first 4 bytes indicate the amount of seeds in the
+   * file, followed by 12 bytes of padding. Then a collection of seeds in the format of
+   * 8 bytes for the program id, then 16 bytes for the seed, then 8 bytes of padding */
+  if (fread(header, 1, sizeof(header), fp) == sizeof(header))
+  {
+    memcpy(&count, header, sizeof(count));
+    g_seeds.reserve(count < 0x10000 ? count : 0x10000);
+
+    for (; count > 0; count--)
     {
-      rhash_read_128bit_hex(line + 13, keyX);
-      if (keyY[0])
+      if (fread(record, 1, sizeof(record), fp) != sizeof(record))
         break;
+
+      rhash_3ds_seed_t seed;
+      memcpy(seed.programId, &record[0], sizeof(seed.programId));
+      memcpy(seed.seed, &record[8], sizeof(seed.seed));
+      g_seeds.push_back(seed);
     }
   }
 
   fclose(fp);
 
-  return rhash_3ds_normalize_keys(keyX, keyY, key);
+  /* stable, so the first entry for a programId is found, as when the file was scanned */
+  std::stable_sort(g_seeds.begin(), g_seeds.end(), [](const rhash_3ds_seed_t& a, const rhash_3ds_seed_t& b)
+  {
+    return memcmp(a.programId, b.programId, sizeof(a.programId)) < 0;
+  });
+}
+
+/* copies the key from aes_keys.txt. if the key isn't present, key[0] is set to 0 */
+static void rhash_3ds_get_aes_key(const std::string& name, uint8_t key[16])
+{
+  const auto iter = g_aesKeys.find(name);
+  if (iter != g_aesKeys.end())
+    memcpy(key, iter->second.data(), 16);
+  else
+    key[0] = 0;
+}
+
+static int rhash_3ds_lookup_cia_normal_key(uint8_t index, uint8_t key[16])
+{
+  if (!g_aesKeysLoaded)
+  {
+    rhash_log_error_message("Could not open aes_keys.txt");
+    return 0;
+  }
+
+  const auto iter = g_ciaNormalKeys.find(index);
+  if (iter == g_ciaNormalKeys.end())
+    return 0;
+
+  memcpy(key, iter->second.data(), 16);
+  return 1;
 }
 
 static int rhash_3ds_lookup_ncch_normal_key(uint8_t primaryKeyY[16],
   uint8_t secondaryKeyXSlot, uint8_t* programId,
   uint8_t primaryKeyOut[16], uint8_t secondaryKeyOut[16])
 {
-  char scan[16];
-  char buffer[128];
+  char name[16];
   uint8_t primaryKeyX[16];
   uint8_t secondaryKeyX[16];
   uint8_t secondaryKeyY[16];
-  char* line;
 
-  FILE* fp = util::openFile(nullptr, g_systemDir + "/aes_keys.txt", "r");
-  if (!fp)
+  if (!g_aesKeysLoaded)
   {
     rhash_log_error_message("Could not open aes_keys.txt");
     return 0;
   }
 
-  primaryKeyX[0] = 0;
-  secondaryKeyX[0] = 0;
-  snprintf(scan, sizeof(scan), "slot0x%02XKeyX=", secondaryKeyXSlot);
-
-  while ((line = fgets(buffer, sizeof(buffer), fp)))
-  {
-    if (memcmp(line, "slot0x2CKeyX=", 13) == 0)
-    {
-      rhash_read_128bit_hex(line + 13, primaryKeyX);
-      if (secondaryKeyX[0])
-        break;
-
-      if (secondaryKeyXSlot == 0x2C)
-      {
-        memcpy(secondaryKeyX, primaryKeyX, sizeof(secondaryKeyX));
-        break;
-      }
-    }
-    else if (memcmp(line, scan, 13) == 0)
-    {
-      rhash_read_128bit_hex(line + 13, secondaryKeyX);
-      if (primaryKeyX[0])
-        break;
-    }
-  }
-
-  fclose(fp);
+  rhash_3ds_get_aes_key("slot0x2CKeyX", primaryKeyX);
+  snprintf(name, sizeof(name), "slot0x%02XKeyX", secondaryKeyXSlot);
+  rhash_3ds_get_aes_key(name, secondaryKeyX);
 
   if (!rhash_3ds_normalize_keys(primaryKeyX, primaryKeyY, primaryKeyOut))
     return 0;
@@ -210,44 +281,24 @@ static int rhash_3ds_lookup_ncch_normal_key(uint8_t primaryKeyY[16],
   }
   else
   {
-    uint32_t count;
     SHA256_CTX ctx;
 
     /* find the seed for the programId */
-    fp = util::openFile(nullptr, g_systemDir + "/seeddb.bin", "rb");
-    if (!fp)
+    if (!g_seedsLoaded)
     {
       rhash_log_error_message("Could not open seeddb.bin");
       return 0;
     }
 
-    /* seeddb.bin's layout is simply the first 4 bytes indicate the amount of seeds in the
-     * file, followed by 12 bytes of padding. Then a collection of seeds in the format of
-     * 8 bytes for the program id, then 16 bytes for the seed, then 8 bytes of padding */
-    fread(&count, sizeof(count), 1, fp);
-    fseek(fp, 12, SEEK_CUR);
-
-    for (; count > 0; count--)
-    {
-      fread(buffer, sizeof(uint8_t), 8, fp);
-      if (memcmp(buffer, programId, 8) == 0)
-      {
-        fread(secondaryKeyY, sizeof(uint8_t), sizeof(secondaryKeyY), fp);
-        break;
-      }
-      fseek(fp, 16 + 8, SEEK_CUR);
-    }
-
-    fclose(fp);
-
-    if (count == 0) /* did not find programId in seeddb.bin */
-      return 0;
+    const auto seed = std::lower_bound(g_seeds.begin(), g_seeds.end(), programId, rhash_3ds_compare_seed);
+    if (seed == g_seeds.end() || memcmp(seed->programId, programId, sizeof(seed->programId)) != 0)
+      return 0; /* did not find programId in seeddb.bin */
 
     /* the actual secondaryKeyY used to generate the normalized key is the first 16 bytes
      * of the SHA256 of the primaryKeyY and the seed pulled from seeddb.bin */
     SHA256_init(&ctx);
     SHA256_update(&ctx, primaryKeyY, 16);
-    SHA256_update(&ctx, secondaryKeyY, 16);
+    SHA256_update(&ctx, seed->seed, 16);
     memcpy(secondaryKeyY, SHA256_final(&ctx), sizeof(secondaryKeyY));
   }
 
@@ -263,6 +314,24 @@ static int rhash_3ds_lookup_ncch_normal_key(uint8_t primaryKeyY[16],
 
 void initHash3DS(const std::string& systemDir)
 {
+  const std::string aesKeysPath = systemDir + "/aes_keys.txt";
+  const std::string seedsPath = systemDir + "/seeddb.bin";
+
+  /* only parse the files again if they've changed */
+  const time_t aesKeysTime = util::fileTime(aesKeysPath);
+  if (systemDir != g_systemDir || !g_aesKeysLoaded || aesKeysTime != g_aesKeysTime)
+  {
+    rhash_3ds_load_aes_keys(aesKeysPath);
+    g_aesKeysTime = aesKeysTime;
+  }
+
+  const time_t seedsTime = util::fileTime(seedsPath);
+  if (systemDir != g_systemDir || !g_seedsLoaded || seedsTime != g_seedsTime)
+  {
+    rhash_3ds_load_seeds(seedsPath);
+    g_seedsTime = seedsTime;
+  }
+
   g_systemDir = systemDir;
 
   rc_hash_init_3ds_get_cia_normal_key_func(rhash_3ds_lookup_cia_normal_key);
@@ -0,0 +1,517 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Replaces rcheevos' aes.c, which the 3DS hashing uses to decrypt CIA and NCCH content. The same
+ * functions are implemented with AES-NI or the ARMv8 AES instructions when the processor has them,
+ * falling back to portable code otherwise. */
+
+#include "CpuFeatures.h"
+
+extern "C" {
+#include "rcheevos/src/rhash/aes.h"
+}
+
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+ #define HAVE_AES_X86
+ #include <immintrin.h>
+ #include <wmmintrin.h>
+
+ #ifdef __GNUC__
+  #define AES_TARGET __attribute__((target("aes,sse4.1")))
+ #else
+  #define AES_TARGET
+ #endif
+#elif defined(_M_ARM64) || defined(__ARM_FEATURE_AES) || defined(__ARM_FEATURE_CRYPTO)
+ /* gcc and clang only provide the intrinsics if the crypto extension is enabled for the file */
+ #define HAVE_AES_ARM64
+ #include <arm_neon.h>
+#endif
+
+#define AES_ROUNDS 10
+
+static const uint8_t s_sbox[256] = {
+  0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+  0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+  0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+  0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+  0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+  0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+  0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+  0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+  0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+  0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+  0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+  0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+  0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+  0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+  0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+  0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static const uint8_t s_rsbox[256] = {
+  0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38, 0xbf, 0x40, 0xa3, 0x9e, 0x81, 0xf3, 0xd7, 0xfb,
+  0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87, 0x34, 0x8e, 0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb,
+  0x54, 0x7b, 0x94, 0x32, 0xa6, 0xc2, 0x23, 0x3d, 0xee, 0x4c, 0x95, 0x0b, 0x42, 0xfa, 0xc3, 0x4e,
+  0x08, 0x2e, 0xa1, 0x66, 0x28, 0xd9, 0x24, 0xb2, 0x76, 0x5b, 0xa2, 0x49, 0x6d, 0x8b, 0xd1, 0x25,
+  0x72, 0xf8, 0xf6, 0x64, 0x86, 0x68, 0x98, 0x16, 0xd4, 0xa4, 0x5c, 0xcc, 0x5d, 0x65, 0xb6, 0x92,
+  0x6c, 0x70, 0x48, 0x50, 0xfd, 0xed, 0xb9, 0xda, 0x5e, 0x15, 0x46, 0x57, 0xa7, 0x8d, 0x9d, 0x84,
+  0x90, 0xd8, 0xab, 0x00, 0x8c, 0xbc, 0xd3, 0x0a, 0xf7, 0xe4, 0x58, 0x05, 0xb8, 0xb3, 0x45, 0x06,
+  0xd0, 0x2c, 0x1e, 0x8f, 0xca, 0x3f, 0x0f, 0x02, 0xc1, 0xaf, 0xbd, 0x03, 0x01, 0x13, 0x8a, 0x6b,
+  0x3a, 0x91, 0x11, 0x41, 0x4f, 0x67, 0xdc, 0xea, 0x97, 0xf2, 0xcf, 0xce, 0xf0, 0xb4, 0xe6, 0x73,
+  0x96, 0xac, 0x74, 0x22, 0xe7, 0xad, 0x35, 0x85, 0xe2, 0xf9, 0x37, 0xe8, 0x1c, 0x75, 0xdf, 0x6e,
+  0x47, 0xf1, 0x1a, 0x71, 0x1d, 0x29, 0xc5, 0x89, 0x6f, 0xb7, 0x62, 0x0e, 0xaa, 0x18, 0xbe, 0x1b,
+  0xfc, 0x56, 0x3e, 0x4b, 0xc6, 0xd2, 0x79, 0x20, 0x9a, 0xdb, 0xc0, 0xfe, 0x78, 0xcd, 0x5a, 0xf4,
+  0x1f, 0xdd, 0xa8, 0x33, 0x88, 0x07, 0xc7, 0x31, 0xb1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xec, 0x5f,
+  0x60, 0x51, 0x7f, 0xa9, 0x19, 0xb5, 0x4a, 0x0d, 0x2d, 0xe5, 0x7a, 0x9f, 0x93, 0xc9, 0x9c, 0xef,
+  0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0, 0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
+  0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26, 0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d
+};
+
+static const uint8_t s_rcon[AES_ROUNDS] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+
+/* portable implementation */
+
+static uint8_t aes_xtime(uint8_t value)
+{
+  return (uint8_t)((value << 1) ^ ((value >> 7) * 0x1b));
+}
+
+static void aes_add_round_key(uint8_t state[16], const uint8_t* roundKey)
+{
+  for (int i = 0; i < 16; i++)
+    state[i] ^= roundKey[i];
+}
+
+static void aes_encrypt_block(const uint8_t* roundKeys, uint8_t state[16])
+{
+  uint8_t copy[16];
+
+  aes_add_round_key(state, roundKeys);
+
+  for (int round = 1; round <= AES_ROUNDS; round++)
+  {
+    /* SubBytes and ShiftRows. the state is stored by column, so row r of column c is state[c * 4 + r] */
+    memcpy(copy, state, sizeof(copy));
+    for (int column = 0; column < 4; column++)
+    {
+      for (int row = 0; row < 4; row++)
+        state[column * 4 + row] = s_sbox[copy[((column + row) & 3) * 4 + row]];
+    }
+
+    if (round < AES_ROUNDS)
+    {
+      for (int column = 0; column < 16; column += 4)
+      {
+        uint8_t* a = &state[column];
+        const uint8_t a0 = a[0];
+        const uint8_t all = a[0] ^ a[1] ^ a[2] ^ a[3];
+        a[0] ^= all ^ aes_xtime(a[0] ^ a[1]);
+        a[1] ^= all ^ aes_xtime(a[1] ^ a[2]);
+        a[2] ^= all ^ aes_xtime(a[2] ^ a[3]);
+        a[3] ^= all ^ aes_xtime(a[3] ^ a0);
+      }
+    }
+
+    aes_add_round_key(state, roundKeys + round * 16);
+  }
+}
+
+static void aes_decrypt_block(const uint8_t* roundKeys, uint8_t state[16])
+{
+  uint8_t copy[16];
+
+  aes_add_round_key(state, roundKeys + AES_ROUNDS * 16);
+
+  for (int round = AES_ROUNDS - 1; round >= 0; round--)
+  {
+    /* InvShiftRows and InvSubBytes */
+    memcpy(copy, state, sizeof(copy));
+    for (int column = 0; column < 4; column++)
+    {
+      for (int row = 0; row < 4; row++)
+        state[column * 4 + row] = s_rsbox[copy[((column - row) & 3) * 4 + row]];
+    }
+
+    aes_add_round_key(state, roundKeys + round * 16);
+
+    if (round > 0)
+    {
+      /* InvMixColumns is MixColumns after multiplying the column by {04}x^2 + {05} */
+      for (int column = 0; column < 16; column += 4)
+      {
+        uint8_t* a = &state[column];
+        const uint8_t u = aes_xtime(aes_xtime(a[0] ^ a[2]));
+        const uint8_t v = aes_xtime(aes_xtime(a[1] ^ a[3]));
+        a[0] ^= u;
+        a[1] ^= v;
+        a[2] ^= u;
+        a[3] ^= v;
+
+        const uint8_t a0 = a[0];
+        const uint8_t all = a[0] ^ a[1] ^ a[2] ^ a[3];
+        a[0] ^= all ^ aes_xtime(a[0] ^ a[1]);
+        a[1] ^= all ^ aes_xtime(a[1] ^ a[2]);
+        a[2] ^= all ^ aes_xtime(a[2] ^ a[3]);
+        a[3] ^= all ^ aes_xtime(a[3] ^ a0);
+      }
+    }
+  }
+}
+
+/* the counter is a 128-bit big endian number */
+static void aes_increment_counter(uint8_t counter[16])
+{
+  for (int i = 15; i >= 0; i--)
+  {
+    if (++counter[i] != 0)
+      break;
+  }
+}
+
+static void aes_ctr_portable(struct AES_ctx* ctx, uint8_t* buf, size_t length)
+{
+  uint8_t keystream[16];
+
+  while (length > 0)
+  {
+    memcpy(keystream, ctx->Iv, sizeof(keystream));
+    aes_encrypt_block(ctx->RoundKey, keystream);
+    aes_increment_counter(ctx->Iv);
+
+    const size_t count = (length < 16) ? length : 16;
+    for (size_t i = 0; i < count; i++)
+      buf[i] ^= keystream[i];
+
+    buf += count;
+    length -= count;
+  }
+}
+
+static void aes_cbc_decrypt_portable(struct AES_ctx* ctx, uint8_t* buf, size_t length)
+{
+  uint8_t ciphertext[16];
+
+  for (; length >= 16; length -= 16, buf += 16)
+  {
+    memcpy(ciphertext, buf, sizeof(ciphertext));
+    aes_decrypt_block(ctx->RoundKey, buf);
+    aes_add_round_key(buf, ctx->Iv);
+    memcpy(ctx->Iv, ciphertext, sizeof(ciphertext));
+  }
+}
+
+/* AES-NI */
+
+#ifdef HAVE_AES_X86
+
+/* blocks are processed in groups, as each instruction has several cycles of latency */
+#define AES_X86_PARALLEL_BLOCKS 4
+
+AES_TARGET static void aes_x86_load_keys(const struct AES_ctx* ctx, __m128i roundKeys[AES_ROUNDS + 1])
+{
+  for (int round = 0; round <= AES_ROUNDS; round++)
+    roundKeys[round] = _mm_loadu_si128((const __m128i*)&ctx->RoundKey[round * 16]);
+}
+
+/* the equivalent inverse cipher uses the round keys in reverse order, passed through InvMixColumns */
+AES_TARGET static void aes_x86_load_decrypt_keys(const struct AES_ctx* ctx, __m128i roundKeys[AES_ROUNDS + 1])
+{
+  roundKeys[0] = _mm_loadu_si128((const __m128i*)&ctx->RoundKey[AES_ROUNDS * 16]);
+  for (int round = 1; round < AES_ROUNDS; round++)
+    roundKeys[round] = _mm_aesimc_si128(_mm_loadu_si128((const __m128i*)&ctx->RoundKey[(AES_ROUNDS - round) * 16]));
+  roundKeys[AES_ROUNDS] = _mm_loadu_si128((const __m128i*)&ctx->RoundKey[0]);
+}
+
+AES_TARGET static __m128i aes_x86_encrypt(const __m128i roundKeys[AES_ROUNDS + 1], __m128i block)
+{
+  block = _mm_xor_si128(block, roundKeys[0]);
+  for (int round = 1; round < AES_ROUNDS; round++)
+    block = _mm_aesenc_si128(block, roundKeys[round]);
+
+  return _mm_aesenclast_si128(block, roundKeys[AES_ROUNDS]);
+}
+
+AES_TARGET static __m128i aes_x86_decrypt(const __m128i roundKeys[AES_ROUNDS + 1], __m128i block)
+{
+  block = _mm_xor_si128(block, roundKeys[0]);
+  for (int round = 1; round < AES_ROUNDS; round++)
+    block = _mm_aesdec_si128(block, roundKeys[round]);
+
+  return _mm_aesdeclast_si128(block, roundKeys[AES_ROUNDS]);
+}
+
+AES_TARGET static void aes_ctr_x86(struct AES_ctx* ctx, uint8_t* buf, size_t length)
+{
+  const __m128i byteSwap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  const __m128i one = _mm_set_epi64x(0, 1);
+  const __m128i carry = _mm_set_epi64x(1, 0);
+  const __m128i lowMask = _mm_set_epi64x(0, -1);
+  __m128i roundKeys[AES_ROUNDS + 1];
+  __m128i blocks[AES_X86_PARALLEL_BLOCKS];
+
+  aes_x86_load_keys(ctx, roundKeys);
+
+  /* the counter is kept as a little endian number, so it can be incremented with 64-bit adds */
+  __m128i counter = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)ctx->Iv), byteSwap);
+
+#define AES_X86_NEXT_COUNTER(block) \
+  block = _mm_shuffle_epi8(counter, byteSwap); \
+  counter = _mm_add_epi64(counter, one); \
+  if (_mm_testz_si128(counter, lowMask)) \
+    counter = _mm_add_epi64(counter, carry);
+
+  for (; length >= AES_X86_PARALLEL_BLOCKS * 16; length -= AES_X86_PARALLEL_BLOCKS * 16, buf += AES_X86_PARALLEL_BLOCKS * 16)
+  {
+    for (int i = 0; i < AES_X86_PARALLEL_BLOCKS; i++)
+    {
+      AES_X86_NEXT_COUNTER(blocks[i]);
+      blocks[i] = _mm_xor_si128(blocks[i], roundKeys[0]);
+    }
+
+    for (int round = 1; round < AES_ROUNDS; round++)
+    {
+      for (int i = 0; i < AES_X86_PARALLEL_BLOCKS; i++)
+        blocks[i] = _mm_aesenc_si128(blocks[i], roundKeys[round]);
+    }
+
+    for (int i = 0; i < AES_X86_PARALLEL_BLOCKS; i++)
+    {
+      const __m128i keystream = _mm_aesenclast_si128(blocks[i], roundKeys[AES_ROUNDS]);
+      const __m128i data = _mm_loadu_si128((const __m128i*)(buf + i * 16));
+      _mm_storeu_si128((__m128i*)(buf + i * 16), _mm_xor_si128(data, keystream));
+    }
+  }
+
+  while (length > 0)
+  {
+    __m128i block;
+    AES_X86_NEXT_COUNTER(block);
+    const __m128i keystream = aes_x86_encrypt(roundKeys, block);
+
+    if (length >= 16)
+    {
+      const __m128i data = _mm_loadu_si128((const __m128i*)buf);
+      _mm_storeu_si128((__m128i*)buf, _mm_xor_si128(data, keystream));
+      buf += 16;
+      length -= 16;
+    }
+    else
+    {
+      /* the rest of the block's keystream is discarded, like the portable implementation */
+      uint8_t bytes[16];
+      _mm_storeu_si128((__m128i*)bytes, keystream);
+      for (size_t j = 0; j < length; j++)
+        buf[j] ^= bytes[j];
+
+      length = 0;
+    }
+  }
+
+#undef AES_X86_NEXT_COUNTER
+
+  _mm_storeu_si128((__m128i*)ctx->Iv, _mm_shuffle_epi8(counter, byteSwap));
+}
+
+AES_TARGET static void aes_cbc_decrypt_x86(struct AES_ctx* ctx, uint8_t* buf, size_t length)
+{
+  __m128i roundKeys[AES_ROUNDS + 1];
+  __m128i blocks[AES_X86_PARALLEL_BLOCKS];
+  __m128i ciphertext[AES_X86_PARALLEL_BLOCKS];
+
+  aes_x86_load_decrypt_keys(ctx, roundKeys);
+
+  __m128i iv = _mm_loadu_si128((const __m128i*)ctx->Iv);
+
+  for (; length >= AES_X86_PARALLEL_BLOCKS * 16; length -= AES_X86_PARALLEL_BLOCKS * 16, buf += AES_X86_PARALLEL_BLOCKS * 16)
+  {
+    for (int i = 0; i < AES_X86_PARALLEL_BLOCKS; i++)
+    {
+      ciphertext[i] = _mm_loadu_si128((const __m128i*)(buf + i * 16));
+      blocks[i] = _mm_xor_si128(ciphertext[i], roundKeys[0]);
+    }
+
+    for (int round = 1; round < AES_ROUNDS; round++)
+    {
+      for (int i = 0; i < AES_X86_PARALLEL_BLOCKS; i++)
+        blocks[i] = _mm_aesdec_si128(blocks[i], roundKeys[round]);
+    }
+
+    for (int i = 0; i < AES_X86_PARALLEL_BLOCKS; i++)
+    {
+      blocks[i] = _mm_aesdeclast_si128(blocks[i], roundKeys[AES_ROUNDS]);
+      _mm_storeu_si128((__m128i*)(buf + i * 16), _mm_xor_si128(blocks[i], iv));
+      iv = ciphertext[i];
+    }
+  }
+
+  for (; length >= 16; length -= 16, buf += 16)
+  {
+    const __m128i block = _mm_loadu_si128((const __m128i*)buf);
+    _mm_storeu_si128((__m128i*)buf, _mm_xor_si128(aes_x86_decrypt(roundKeys, block), iv));
+    iv = block;
+  }
+
+  _mm_storeu_si128((__m128i*)ctx->Iv, iv);
+}
+
+#endif /* HAVE_AES_X86 */
+
+/* ARMv8 */
+
+#ifdef HAVE_AES_ARM64
+
+static uint8x16_t aes_arm64_encrypt(const uint8x16_t roundKeys[AES_ROUNDS + 1], uint8x16_t block)
+{
+  for (int round = 0; round < AES_ROUNDS - 1; round++)
+    block = vaesmcq_u8(vaeseq_u8(block, roundKeys[round]));
+
+  block = vaeseq_u8(block, roundKeys[AES_ROUNDS - 1]);
+  return veorq_u8(block, roundKeys[AES_ROUNDS]);
+}
+
+static void aes_ctr_arm64(struct AES_ctx* ctx, uint8_t* buf, size_t length)
+{
+  uint8x16_t roundKeys[AES_ROUNDS + 1];
+
+  for (int round = 0; round <= AES_ROUNDS; round++)
+    roundKeys[round] = vld1q_u8(&ctx->RoundKey[round * 16]);
+
+  while (length > 0)
+  {
+    const uint8x16_t keystream = aes_arm64_encrypt(roundKeys, vld1q_u8(ctx->Iv));
+    aes_increment_counter(ctx->Iv);
+
+    if (length >= 16)
+    {
+      vst1q_u8(buf, veorq_u8(vld1q_u8(buf), keystream));
+      buf += 16;
+      length -= 16;
+    }
+    else
+    {
+      uint8_t bytes[16];
+      vst1q_u8(bytes, keystream);
+      for (size_t j = 0; j < length; j++)
+        buf[j] ^= bytes[j];
+
+      length = 0;
+    }
+  }
+}
+
+static void aes_cbc_decrypt_arm64(struct AES_ctx* ctx, uint8_t* buf, size_t length)
+{
+  uint8x16_t roundKeys[AES_ROUNDS + 1];
+
+  /* the equivalent inverse cipher uses the round keys in reverse order, passed through InvMixColumns */
+  roundKeys[0] = vld1q_u8(&ctx->RoundKey[AES_ROUNDS * 16]);
+  for (int round = 1; round < AES_ROUNDS; round++)
+    roundKeys[round] = vaesimcq_u8(vld1q_u8(&ctx->RoundKey[(AES_ROUNDS - round) * 16]));
+  roundKeys[AES_ROUNDS] = vld1q_u8(&ctx->RoundKey[0]);
+
+  uint8x16_t iv = vld1q_u8(ctx->Iv);
+
+  for (; length >= 16; length -= 16, buf += 16)
+  {
+    const uint8x16_t ciphertext = vld1q_u8(buf);
+    uint8x16_t block = ciphertext;
+
+    for (int round = 0; round < AES_ROUNDS - 1; round++)
+      block = vaesimcq_u8(vaesdq_u8(block, roundKeys[round]));
+
+    block = vaesdq_u8(block, roundKeys[AES_ROUNDS - 1]);
+    block = veorq_u8(block, roundKeys[AES_ROUNDS]);
+
+    vst1q_u8(buf, veorq_u8(block, iv));
+    iv = ciphertext;
+  }
+
+  vst1q_u8(ctx->Iv, iv);
+}
+
+#endif /* HAVE_AES_ARM64 */
+
+/* rcheevos interface */
+
+void AES_init_ctx_iv(struct AES_ctx* ctx, const uint8_t* key, const uint8_t* iv)
+{
+  uint8_t* roundKeys = ctx->RoundKey;
+  memcpy(roundKeys, key, 16);
+
+  /* the key schedule is the same for every implementation */
+  for (int i = 16; i < (AES_ROUNDS + 1) * 16; i += 4)
+  {
+    uint8_t word[4];
+    memcpy(word, &roundKeys[i - 4], sizeof(word));
+
+    if ((i & 15) == 0)
+    {
+      const uint8_t first = word[0];
+      word[0] = (uint8_t)(s_sbox[word[1]] ^ s_rcon[i / 16 - 1]);
+      word[1] = s_sbox[word[2]];
+      word[2] = s_sbox[word[3]];
+      word[3] = s_sbox[first];
+    }
+
+    for (int j = 0; j < 4; j++)
+      roundKeys[i + j] = roundKeys[i - 16 + j] ^ word[j];
+  }
+
+  memcpy(ctx->Iv, iv, sizeof(ctx->Iv));
+}
+
+void AES_CTR_xcrypt_buffer(struct AES_ctx* ctx, uint8_t* buf, size_t length)
+{
+#if defined(HAVE_AES_X86)
+  if (cpu_features() & CPU_FEATURE_AES)
+  {
+    aes_ctr_x86(ctx, buf, length);
+    return;
+  }
+#elif defined(HAVE_AES_ARM64)
+  if (cpu_features() & CPU_FEATURE_AES)
+  {
+    aes_ctr_arm64(ctx, buf, length);
+    return;
+  }
+#endif
+
+  aes_ctr_portable(ctx, buf, length);
+}
+
+void AES_CBC_decrypt_buffer(struct AES_ctx* ctx, uint8_t* buf, size_t length)
+{
+#if defined(HAVE_AES_X86)
+  if (cpu_features() & CPU_FEATURE_AES)
+  {
+    aes_cbc_decrypt_x86(ctx, buf, length);
+    return;
+  }
+#elif defined(HAVE_AES_ARM64)
+  if (cpu_features() & CPU_FEATURE_AES)
+  {
+    aes_cbc_decrypt_arm64(ctx, buf, length);
+    return;
+  }
+#endif
+
+  aes_cbc_decrypt_portable(ctx, buf, length);
+}
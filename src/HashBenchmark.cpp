@@ -0,0 +1,192 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Measures how fast encrypted content is hashed with the hardware and portable implementations
+ * of AES and SHA-256. A synthetic image is decrypted and hashed in chunks, the same way the 3DS
+ * hashing processes CIA and NCCH content, and the results of each implementation are compared.
+ *
+ * usage: RAHasherBenchmark [size in MB] */
+
+#include "CpuFeatures.h"
+
+#include <libmincrypt/sha256.h>
+
+extern "C" {
+#include "rcheevos/src/rhash/aes.h"
+#include "rcheevos/src/rhash/md5.h"
+}
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define BENCHMARK_CHUNK_SIZE (64 * 1024)
+
+enum benchmark_mode
+{
+  BENCHMARK_AES_CTR,
+  BENCHMARK_AES_CBC,
+  BENCHMARK_SHA256
+};
+
+static const char* benchmark_mode_name(benchmark_mode mode)
+{
+  switch (mode)
+  {
+    case BENCHMARK_AES_CTR: return "AES-CTR + MD5";
+    case BENCHMARK_AES_CBC: return "AES-CBC + MD5";
+    default: return "SHA-256";
+  }
+}
+
+/* returns the time taken in seconds, and the hash of the decrypted image */
+static double benchmark_run(benchmark_mode mode, const std::vector<uint8_t>& image, std::string& hash)
+{
+  static const uint8_t key[16] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+  static const uint8_t iv[16] = { 0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff };
+  std::vector<uint8_t> chunk(BENCHMARK_CHUNK_SIZE);
+  uint8_t digest[SHA256_DIGEST_SIZE];
+  size_t digestSize;
+  struct AES_ctx aes;
+  md5_state_t md5;
+  SHA256_CTX sha256;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  AES_init_ctx_iv(&aes, key, iv);
+  md5_init(&md5);
+  SHA256_init(&sha256);
+
+  for (size_t offset = 0; offset < image.size(); offset += BENCHMARK_CHUNK_SIZE)
+  {
+    const size_t size = (image.size() - offset < BENCHMARK_CHUNK_SIZE) ? image.size() - offset : BENCHMARK_CHUNK_SIZE;
+
+    switch (mode)
+    {
+      case BENCHMARK_AES_CTR:
+        memcpy(chunk.data(), &image[offset], size);
+        AES_CTR_xcrypt_buffer(&aes, chunk.data(), size);
+        md5_append(&md5, chunk.data(), (int)size);
+        break;
+
+      case BENCHMARK_AES_CBC:
+        memcpy(chunk.data(), &image[offset], size);
+        AES_CBC_decrypt_buffer(&aes, chunk.data(), size);
+        md5_append(&md5, chunk.data(), (int)size);
+        break;
+
+      case BENCHMARK_SHA256:
+        SHA256_update(&sha256, &image[offset], (int)size);
+        break;
+    }
+  }
+
+  if (mode == BENCHMARK_SHA256)
+  {
+    memcpy(digest, SHA256_final(&sha256), SHA256_DIGEST_SIZE);
+    digestSize = SHA256_DIGEST_SIZE;
+  }
+  else
+  {
+    md5_finish(&md5, digest);
+    digestSize = 16;
+  }
+
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  hash.clear();
+  for (size_t i = 0; i < digestSize; i++)
+  {
+    char hex[3];
+    snprintf(hex, sizeof(hex), "%02x", digest[i]);
+    hash += hex;
+  }
+
+  return std::chrono::duration<double>(elapsed).count();
+}
+
+int main(int argc, char* argv[])
+{
+  const benchmark_mode modes[] = { BENCHMARK_AES_CTR, BENCHMARK_AES_CBC, BENCHMARK_SHA256 };
+  const unsigned modeFeatures[] = { CPU_FEATURE_AES, CPU_FEATURE_AES, CPU_FEATURE_SHA256 };
+  const size_t numModes = sizeof(modes) / sizeof(modes[0]);
+  std::string hardwareHashes[numModes];
+  double hardwareTimes[numModes];
+  int result = 0;
+
+  int sizeMB = (argc > 1) ? atoi(argv[1]) : 64;
+  if (sizeMB < 1)
+    sizeMB = 1;
+
+  /* the content of the image doesn't matter, it just has to be the same for each run */
+  std::vector<uint8_t> image((size_t)sizeMB * 1024 * 1024);
+  uint32_t seed = 0x12345678;
+  for (size_t i = 0; i < image.size(); i++)
+  {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    image[i] = (uint8_t)seed;
+  }
+
+  const unsigned features = cpu_features();
+  printf("%d MB image, AES: %s, SHA-256: %s\n\n", sizeMB,
+         (features & CPU_FEATURE_AES) ? "hardware" : "portable",
+         (features & CPU_FEATURE_SHA256) ? "hardware" : "portable");
+  printf("%-16s %-10s %10s  %s\n", "test", "backend", "MB/s", "hash");
+
+  /* run everything with the hardware implementations first, then disable them */
+  for (size_t i = 0; i < numModes; i++)
+  {
+    if (!(features & modeFeatures[i]))
+      continue;
+
+    hardwareTimes[i] = benchmark_run(modes[i], image, hardwareHashes[i]);
+    printf("%-16s %-10s %10.1f  %s\n", benchmark_mode_name(modes[i]), "hardware", sizeMB / hardwareTimes[i], hardwareHashes[i].c_str());
+  }
+
+  cpu_disable_features(CPU_FEATURE_AES | CPU_FEATURE_SHA256);
+
+  for (size_t i = 0; i < numModes; i++)
+  {
+    std::string hash;
+    const double time = benchmark_run(modes[i], image, hash);
+    printf("%-16s %-10s %10.1f  %s", benchmark_mode_name(modes[i]), "portable", sizeMB / time, hash.c_str());
+
+    if (features & modeFeatures[i])
+    {
+      if (hash != hardwareHashes[i])
+      {
+        printf("  MISMATCH");
+        result = 1;
+      }
+      else
+      {
+        printf("  (%.1fx)", time / hardwareTimes[i]);
+      }
+    }
+
+    printf("\n");
+  }
+
+  return result;
+}
@@ -28,17 +28,64 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 #include <string.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+void rc_hash_add_opened_file(const char* path); /* in HashFileReader.cpp */
+
+#define CHD_HUNK_CACHE_SIZE 32             /* Number of decompressed hunks kept for each track */
+#define CHD_MAX_READ_AHEAD_THREADS 8       /* Maximum number of threads decompressing ahead of a reader */
+#define CHD_READ_AHEAD_HUNKS_PER_THREAD 2  /* Number of hunks to decompress ahead of a reader for each thread */
+#define CHD_READ_AHEAD_RAMP_HUNKS 4        /* Number of hunks read sequentially before each read-ahead thread is added */
+
+typedef enum chd_hunk_state
+{
+  CHD_HUNK_EMPTY,
+  CHD_HUNK_LOADING,
+  CHD_HUNK_READY,
+  CHD_HUNK_FAILED
+} chd_hunk_state;
+
+typedef struct chd_cached_hunk_t
+{
+  uint8_t* data;               /* Decompressed hunk data */
+  uint32_t hunknum;            /* Hunk number of the data */
+  uint32_t last_used;          /* Value of use_counter when the hunk was last used */
+  chd_hunk_state state;
+} chd_cached_hunk_t;
+
 typedef struct chd_track_handle_t
 {
   chd_file* file;              /* CHD file handle */
-  uint8_t *hunkmem;            /* Loaded hunk data */
-  uint32_t hunknum;            /* Loaded hunk number */
+  std::string path;            /* Path of the CHD file */
+  uint32_t hunkbytes;          /* Number of bytes in each hunk */
+  uint32_t num_hunks;          /* Number of hunks in the CHD file */
   uint32_t frames_per_hunk;    /* Number of frames per hunk */
   uint32_t first_sector;       /* First sector associated to the track */
   uint32_t first_frame;        /* First CHD frame associated to the track */
   uint32_t frames_in_track;    /* Number of frames in the track */
   uint32_t sector_data_size;   /* Number of data bytes in each sector */
   uint32_t sector_header_size; /* Size of header data for each sector */
+
+  /* everything below is protected by mutex */
+  std::mutex mutex;
+  std::condition_variable hunk_loaded;
+  chd_cached_hunk_t hunks[CHD_HUNK_CACHE_SIZE];
+  uint32_t use_counter;        /* Incremented each time a hunk is used */
+  uint32_t last_hunk;          /* Hunk most recently returned to the reader, -1 if none */
+  uint32_t sequential_hunks;   /* Number of hunks read in order since the last seek */
+
+  /* each read-ahead thread opens its own file handle as chd_file isn't thread safe */
+  std::vector<std::thread> readahead_threads;
+  std::condition_variable readahead_wake;
+  uint32_t readahead_hunks;    /* Number of hunks to decompress ahead of the reader */
+  uint32_t readahead_next;     /* Next hunk a read-ahead thread should decompress */
+  uint32_t readahead_end;      /* Hunk the read-ahead threads should stop at */
+  bool readahead_stop;         /* Set when the track is being closed */
 } chd_track_handle_t;
 
 typedef struct metadata
@@ -180,11 +227,231 @@ static bool rc_hash_find_chd_track(chd_file* file, uint32_t track, metadata_t* m
   }
 }
 
+/* returns the cached entry for a hunk. mutex must be held */
+static chd_cached_hunk_t* rc_hash_chd_find_hunk(chd_track_handle_t* chd_track, uint32_t hunknum)
+{
+  chd_cached_hunk_t* hunk = &chd_track->hunks[0];
+  chd_cached_hunk_t* stop = hunk + CHD_HUNK_CACHE_SIZE;
+  for (; hunk < stop; ++hunk)
+  {
+    if (hunk->state != CHD_HUNK_EMPTY && hunk->hunknum == hunknum)
+      return hunk;
+  }
+
+  return NULL;
+}
+
+/* returns the least recently used entry that's not being loaded or read. mutex must be held */
+static chd_cached_hunk_t* rc_hash_chd_evict_hunk(chd_track_handle_t* chd_track)
+{
+  chd_cached_hunk_t* hunk = &chd_track->hunks[0];
+  chd_cached_hunk_t* stop = hunk + CHD_HUNK_CACHE_SIZE;
+  chd_cached_hunk_t* oldest = NULL;
+
+  for (; hunk < stop; ++hunk)
+  {
+    if (hunk->state == CHD_HUNK_LOADING)
+      continue;
+
+    /* the reader copies out of the last hunk it was given without holding the mutex */
+    if (hunk->state == CHD_HUNK_READY && hunk->hunknum == chd_track->last_hunk)
+      continue;
+
+    if (!oldest || hunk->last_used < oldest->last_used)
+      oldest = hunk;
+  }
+
+  if (oldest && !oldest->data)
+  {
+    oldest->data = (uint8_t*)malloc(chd_track->hunkbytes);
+    if (!oldest->data)
+      return NULL;
+  }
+
+  return oldest;
+}
+
+/* decompresses a hunk into an entry marked as loading. mutex must be held, and is released while decompressing */
+static bool rc_hash_chd_load_hunk(chd_track_handle_t* chd_track, std::unique_lock<std::mutex>& lock,
+      chd_file* file, chd_cached_hunk_t* hunk, uint32_t hunknum)
+{
+  chd_error err;
+
+  hunk->hunknum = hunknum;
+  hunk->state = CHD_HUNK_LOADING;
+  hunk->last_used = ++chd_track->use_counter;
+
+  lock.unlock();
+  err = chd_read(file, hunknum, hunk->data);
+  lock.lock();
+
+  hunk->state = (err == CHDERR_NONE) ? CHD_HUNK_READY : CHD_HUNK_FAILED;
+  chd_track->hunk_loaded.notify_all();
+
+  return (err == CHDERR_NONE);
+}
+
+/* number of read-ahead threads for all open tracks, so hashing several files at once doesn't oversubscribe the CPU */
+static std::atomic<unsigned> g_chd_readahead_threads(0);
+
+static bool rc_hash_chd_reserve_readahead_thread(bool first)
+{
+  unsigned max_threads = std::thread::hardware_concurrency();
+  unsigned current = g_chd_readahead_threads.load();
+
+  if (max_threads == 0)
+    max_threads = 2;
+
+  do
+  {
+    /* leave a core for the thread doing the hashing, but always allow one thread per track so
+     * decompression still overlaps with hashing */
+    if (!first && current + 1 >= max_threads)
+      return false;
+  } while (!g_chd_readahead_threads.compare_exchange_weak(current, current + 1));
+
+  return true;
+}
+
+static void rc_hash_chd_readahead(chd_track_handle_t* chd_track)
+{
+  chd_file* file;
+
+  if (chd_open(chd_track->path.c_str(), CHD_OPEN_READ, NULL, &file) == CHDERR_NONE)
+  {
+    std::unique_lock<std::mutex> lock(chd_track->mutex);
+
+    while (!chd_track->readahead_stop)
+    {
+      if (chd_track->readahead_next >= chd_track->readahead_end)
+      {
+        chd_track->readahead_wake.wait(lock);
+        continue;
+      }
+
+      const uint32_t hunknum = chd_track->readahead_next++;
+
+      /* already cached, being loaded by another thread, or failed (the reader will report it) */
+      if (rc_hash_chd_find_hunk(chd_track, hunknum))
+        continue;
+
+      /* the hunks are claimed in order, but may finish out of order. the reader waits for the
+       * one it needs, so they're still consumed in order */
+      chd_cached_hunk_t* hunk = rc_hash_chd_evict_hunk(chd_track);
+      if (hunk)
+        rc_hash_chd_load_hunk(chd_track, lock, file, hunk, hunknum);
+    }
+
+    lock.unlock();
+    chd_close(file);
+  }
+
+  --g_chd_readahead_threads;
+}
+
+/* adds a read-ahead thread once the reader has been reading in order for long enough. short reads, like
+ * the ones that look for the executable, never pay for the extra threads and file handles */
+static void rc_hash_chd_grow_readahead(chd_track_handle_t* chd_track)
+{
+  const size_t count = chd_track->readahead_threads.size();
+  if (count >= CHD_MAX_READ_AHEAD_THREADS || chd_track->sequential_hunks < (count + 1) * CHD_READ_AHEAD_RAMP_HUNKS)
+    return;
+
+  if (!rc_hash_chd_reserve_readahead_thread(count == 0))
+    return;
+
+  try
+  {
+    chd_track->readahead_threads.push_back(std::thread(rc_hash_chd_readahead, chd_track));
+  }
+  catch (...)
+  {
+    --g_chd_readahead_threads;
+  }
+
+  chd_track->readahead_hunks = (uint32_t)chd_track->readahead_threads.size() * CHD_READ_AHEAD_HUNKS_PER_THREAD;
+}
+
+/* asks the read-ahead threads to decompress the hunks following the one being read. mutex must be held */
+static void rc_hash_chd_schedule_readahead(chd_track_handle_t* chd_track, uint32_t hunknum)
+{
+  uint32_t end;
+
+  rc_hash_chd_grow_readahead(chd_track);
+
+  end = hunknum + chd_track->readahead_hunks;
+  if (end > chd_track->num_hunks)
+    end = chd_track->num_hunks;
+  if (hunknum >= end)
+    return;
+
+  /* if the reader skipped past the read-ahead window, start over from the reader */
+  if (chd_track->readahead_next < hunknum || chd_track->readahead_next > end)
+    chd_track->readahead_next = hunknum;
+  chd_track->readahead_end = end;
+
+  chd_track->readahead_wake.notify_all();
+}
+
+/* returns the decompressed data for a hunk. the data remains valid until the next call */
+static const uint8_t* rc_hash_chd_get_hunk(chd_track_handle_t* chd_track, uint32_t hunknum)
+{
+  std::unique_lock<std::mutex> lock(chd_track->mutex);
+  chd_cached_hunk_t* hunk;
+
+  if (hunknum != chd_track->last_hunk)
+  {
+    if (chd_track->last_hunk != (uint32_t)-1 && hunknum == chd_track->last_hunk + 1)
+    {
+      chd_track->sequential_hunks++;
+      rc_hash_chd_schedule_readahead(chd_track, hunknum + 1);
+    }
+    else
+    {
+      chd_track->sequential_hunks = 0;
+    }
+
+    chd_track->last_hunk = hunknum;
+  }
+
+  do
+  {
+    hunk = rc_hash_chd_find_hunk(chd_track, hunknum);
+    if (!hunk)
+      break;
+
+    if (hunk->state == CHD_HUNK_READY)
+    {
+      hunk->last_used = ++chd_track->use_counter;
+      return hunk->data;
+    }
+
+    /* if a read-ahead thread failed to decompress the hunk, try again so the error is reported normally */
+    if (hunk->state == CHD_HUNK_FAILED)
+      break;
+
+    chd_track->hunk_loaded.wait(lock);
+  } while (true);
+
+  if (!hunk)
+  {
+    hunk = rc_hash_chd_evict_hunk(chd_track);
+    if (!hunk)
+      return NULL;
+  }
+
+  if (!rc_hash_chd_load_hunk(chd_track, lock, chd_track->file, hunk, hunknum))
+    return NULL;
+
+  return hunk->data;
+}
+
 static size_t rc_hash_handle_chd_read_sector(void* track_handle, uint32_t sector,
       void* buffer, size_t requested_bytes)
 {
   chd_track_handle_t* chd_track = (chd_track_handle_t*)track_handle;
   const chd_header* header = chd_get_header(chd_track->file);
+  const uint8_t* hunkmem = NULL;
   uint32_t hunk, offset, chd_frame;
   size_t bytes_read = 0;
 
@@ -201,30 +468,30 @@ static size_t rc_hash_handle_chd_read_sector(void* track_handle, uint32_t sector
   offset = (chd_frame % chd_track->frames_per_hunk) * header->unitbytes + chd_track->sector_header_size;
 
   do {
-    if (hunk != chd_track->hunknum)
+    if (!hunkmem)
     {
-      if (chd_read(chd_track->file, hunk, chd_track->hunkmem) != CHDERR_NONE)
+      hunkmem = rc_hash_chd_get_hunk(chd_track, hunk);
+      if (!hunkmem)
         return bytes_read;
-
-      chd_track->hunknum = hunk;
     }
 
     if (requested_bytes <= chd_track->sector_data_size)
     {
-      memcpy(buffer, &chd_track->hunkmem[offset], requested_bytes);
+      memcpy(buffer, &hunkmem[offset], requested_bytes);
       bytes_read += requested_bytes;
       break;
     }
 
-    memcpy(buffer, &chd_track->hunkmem[offset], chd_track->sector_data_size);
+    memcpy(buffer, &hunkmem[offset], chd_track->sector_data_size);
     bytes_read += chd_track->sector_data_size;
     buffer = ((uint8_t*)buffer) + chd_track->sector_data_size;
     requested_bytes -= chd_track->sector_data_size;
 
     offset += header->unitbytes;
-    if (offset > header->hunkbytes)
+    if (offset - chd_track->sector_header_size >= header->hunkbytes)
     {
       offset = chd_track->sector_header_size;
+      hunkmem = NULL;
       hunk++;
     }
   } while (true);
@@ -243,11 +510,23 @@ static void rc_hash_handle_chd_close_track(void* track_handle)
   chd_track_handle_t* chd_track = (chd_track_handle_t*)track_handle;
   if (chd_track)
   {
-    if (chd_track->hunkmem)
-      free(chd_track->hunkmem);
+    {
+      std::lock_guard<std::mutex> lock(chd_track->mutex);
+      chd_track->readahead_stop = true;
+    }
+
+    chd_track->readahead_wake.notify_all();
+    for (size_t i = 0; i < chd_track->readahead_threads.size(); ++i)
+      chd_track->readahead_threads[i].join();
+
+    for (int i = 0; i < CHD_HUNK_CACHE_SIZE; ++i)
+    {
+      if (chd_track->hunks[i].data)
+        free(chd_track->hunks[i].data);
+    }
 
     chd_close(chd_track->file);
-    free(chd_track);
+    delete chd_track;
   }
 }
 
@@ -265,6 +544,8 @@ static void* rc_hash_handle_chd_open_track(const char* path, uint32_t track, con
     return NULL;
   }
 
+  rc_hash_add_opened_file(path);
+
   memset(&metadata, 0, sizeof(metadata));
   if (!rc_hash_find_chd_track(file, track, &metadata))
   {
@@ -274,10 +555,12 @@ static void* rc_hash_handle_chd_open_track(const char* path, uint32_t track, con
 
   header = chd_get_header(file);
 
-  chd_track = (chd_track_handle_t*)calloc(1, sizeof(chd_track_handle_t));
+  chd_track = new chd_track_handle_t();
   chd_track->file = file;
-  chd_track->hunknum = (uint32_t)-1;
-  chd_track->hunkmem = (uint8_t*)malloc(header->hunkbytes);
+  chd_track->path = path;
+  chd_track->hunkbytes = header->hunkbytes;
+  chd_track->num_hunks = header->totalhunks;
+  chd_track->last_hunk = (uint32_t)-1;
   chd_track->frames_per_hunk = header->hunkbytes / header->unitbytes;
   chd_track->first_sector = metadata.sector_offset;
   chd_track->first_frame = metadata.frame_offset;
@@ -374,15 +657,19 @@ static void* rc_hash_handle_chd_open_track(const char* path, uint32_t track, con
   return chd_track;
 }
 
+void rc_hash_get_chd_cdreader(struct rc_hash_cdreader* cdreader)
+{
+  memset(cdreader, 0, sizeof(*cdreader));
+  cdreader->open_track_iterator = rc_hash_handle_chd_open_track;
+  cdreader->read_sector = rc_hash_handle_chd_read_sector;
+  cdreader->close_track = rc_hash_handle_chd_close_track;
+  cdreader->first_track_sector = rc_hash_handle_chd_first_track_sector;
+}
+
 void rc_hash_init_chd_cdreader()
 {
   struct rc_hash_cdreader cdreader;
-
-  memset(&cdreader, 0, sizeof(cdreader));
-  cdreader.open_track_iterator = rc_hash_handle_chd_open_track;
-  cdreader.read_sector = rc_hash_handle_chd_read_sector;
-  cdreader.close_track = rc_hash_handle_chd_close_track;
-  cdreader.first_track_sector = rc_hash_handle_chd_first_track_sector;
+  rc_hash_get_chd_cdreader(&cdreader);
   rc_hash_init_custom_cdreader(&cdreader);
 }
 
@@ -0,0 +1,564 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "HashCache.h"
+
+#include "Util.h"
+
+#include <rcheevos/include/rc_version.h>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#ifdef _WIN32
+ #define WIN32_LEAN_AND_MEAN
+ #include <windows.h>
+#endif
+
+#define TAG "[HCH] "
+
+#define HASHCACHE_MAGIC   "RAHC"
+#define HASHCACHE_VERSION 3
+
+/* the header is the magic, the format version and the version of the hashing code that generated the
+ * entries. a cache written by a different version of rcheevos may hold hashes that are no longer
+ * correct, so it's discarded as a whole.
+ * each record is a 4-byte payload length, the payload, and a 4-byte checksum of the payload.
+ * the payload is the console id (4), size (8), time (8), fingerprint (8), md5 (16), files stamp (8),
+ * the path, and the other files the hash was generated from, each preceded by a null */
+#define HASHCACHE_HEADER_SIZE  12
+#define HASHCACHE_FIXED_SIZE   52
+#define HASHCACHE_MAX_PATHS    (64 * 1024)
+
+/* content larger than this isn't fingerprinted, it's cheaper to key it by the file alone */
+#define HASHCACHE_MAX_FINGERPRINT_SIZE (64 * 1024 * 1024)
+
+static void write32(uint8_t* out, uint32_t value)
+{
+  out[0] = (uint8_t)value;
+  out[1] = (uint8_t)(value >> 8);
+  out[2] = (uint8_t)(value >> 16);
+  out[3] = (uint8_t)(value >> 24);
+}
+
+static void write64(uint8_t* out, uint64_t value)
+{
+  write32(out, (uint32_t)value);
+  write32(out + 4, (uint32_t)(value >> 32));
+}
+
+static uint32_t read32(const uint8_t* in)
+{
+  return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+static uint64_t read64(const uint8_t* in)
+{
+  return (uint64_t)read32(in) | (uint64_t)read32(in + 4) << 32;
+}
+
+static uint32_t checksum(const uint8_t* data, size_t size)
+{
+  /* FNV-1a */
+  uint32_t hash = 0x811C9DC5;
+  for (size_t i = 0; i < size; i++)
+    hash = (hash ^ data[i]) * 0x01000193;
+
+  return hash;
+}
+
+static uint64_t fingerprint(const void* data, size_t size)
+{
+  /* multiply-rotate over 8-byte words. this only has to tell different content apart, so it
+   * doesn't need to be cryptographic, but it does need to be much faster than the real hash */
+  const uint8_t* input = (const uint8_t*)data;
+  const uint8_t* stop = input + (size & ~(size_t)7);
+  uint64_t hash = 0x9E3779B97F4A7C15ULL ^ size;
+
+  for (; input < stop; input += 8)
+  {
+    uint64_t word;
+    memcpy(&word, input, sizeof(word));
+    hash = (hash ^ (word * 0xC2B2AE3D27D4EB4FULL)) * 0x9E3779B97F4A7C15ULL;
+    hash = (hash << 31) | (hash >> 33);
+  }
+
+  for (size_t i = 0; i < (size & 7); i++)
+    hash = (hash ^ input[i]) * 0x100000001B3ULL;
+
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  hash ^= hash >> 33;
+  return hash ? hash : 1; /* zero means "no fingerprint" */
+}
+
+static bool hexToMd5(const char* hash, uint8_t md5[16])
+{
+  for (int i = 0; i < 32; i++)
+  {
+    const char c = (char)tolower(hash[i]);
+    uint8_t nibble;
+
+    if (c >= '0' && c <= '9')
+      nibble = c - '0';
+    else if (c >= 'a' && c <= 'f')
+      nibble = c - 'a' + 10;
+    else
+      return false;
+
+    if (i & 1)
+      md5[i / 2] |= nibble;
+    else
+      md5[i / 2] = nibble << 4;
+  }
+
+  return true;
+}
+
+static void md5ToHex(const uint8_t md5[16], char hash[33])
+{
+  static const char hex[] = "0123456789abcdef";
+
+  for (int i = 0; i < 16; i++)
+  {
+    hash[i * 2] = hex[md5[i] >> 4];
+    hash[i * 2 + 1] = hex[md5[i] & 0x0F];
+  }
+
+  hash[32] = '\0';
+}
+
+static std::string canonicalPath(const std::string& path)
+{
+  std::string canonical = util::fullPath(path);
+
+#ifdef _WIN32
+  /* paths are case-insensitive on Windows */
+  for (auto& c : canonical)
+    c = (char)tolower((unsigned char)c);
+#endif
+
+  return canonical;
+}
+
+/* combines the sizes and modification times of files. false if any of them can't be found */
+static bool filesStamp(const std::vector<std::string>& files, uint64_t* stamp)
+{
+  /* FNV-1a over the size and time of each file */
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for (const auto& file : files)
+  {
+    time_t time;
+    size_t size;
+    if (!util::fileInfo(file, &time, &size))
+      return false;
+
+    uint8_t buffer[16];
+    write64(buffer, (uint64_t)size);
+    write64(buffer + 8, (uint64_t)time);
+    for (size_t i = 0; i < sizeof(buffer); i++)
+      hash = (hash ^ buffer[i]) * 0x100000001B3ULL;
+  }
+
+  *stamp = hash ? hash : 1; /* zero means "no other files" */
+  return true;
+}
+
+bool HashCache::init(Logger* logger, const std::string& path)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  _logger = logger;
+  _path = path;
+  _records.clear();
+  _byPath.clear();
+  _byFingerprint.clear();
+  _numAppended = 0;
+
+  if (!util::exists(path))
+    return true;
+
+  size_t size;
+  uint8_t* data = (uint8_t*)util::loadFile(_logger, path, &size);
+  if (data == NULL)
+    return false;
+
+  if (size < 8 || memcmp(data, HASHCACHE_MAGIC, 4) != 0)
+  {
+    /* don't overwrite something that isn't a hash cache */
+    _logger->error(TAG "%s is not a hash cache", path.c_str());
+    free(data);
+    _path.clear();
+    return false;
+  }
+
+  if (size < HASHCACHE_HEADER_SIZE || read32(data + 4) != HASHCACHE_VERSION || read32(data + 8) != RCHEEVOS_VERSION)
+  {
+    _logger->info(TAG "Discarding hashes cached by a different version in %s", path.c_str());
+    free(data);
+
+    /* don't append to a file with a header we can't update */
+    if (!rewrite())
+    {
+      _path.clear();
+      return false;
+    }
+
+    return true;
+  }
+
+  const size_t validSize = parse(data, size);
+  free(data);
+
+  _logger->info(TAG "Loaded %zu cached hashes from %s", _records.size(), path.c_str());
+
+  /* rewrite the file if the tail is damaged (so new records don't end up after garbage) or if
+   * it's mostly made of records that have since been replaced */
+  if (validSize != size || _numAppended > _records.size() * 2 + 64)
+    rewrite();
+
+  return true;
+}
+
+void HashCache::destroy()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  _path.clear();
+  _records.clear();
+  _byPath.clear();
+  _byFingerprint.clear();
+  _numAppended = 0;
+}
+
+std::string HashCache::pathKey(const std::string& path, int consoleId)
+{
+  return std::to_string(consoleId) + ':' + path;
+}
+
+std::string HashCache::entryPath(const std::string& canonical, const std::string& entryName)
+{
+  /* the same pseudo path the core gets for content extracted from an archive */
+  return entryName.empty() ? canonical : canonical + '#' + entryName;
+}
+
+std::string HashCache::fingerprintKey(uint64_t fingerprint, uint64_t size, int consoleId)
+{
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%d:%llx:%llx", consoleId, (unsigned long long)size, (unsigned long long)fingerprint);
+  return buffer;
+}
+
+void HashCache::add(int consoleId, const std::string& path, const std::vector<std::string>& files, const Entry& entry)
+{
+  size_t index = _records.size();
+
+  if (!path.empty())
+  {
+    auto it = _byPath.find(pathKey(path, consoleId));
+    if (it != _byPath.end())
+      index = it->second;
+    else
+      _byPath[pathKey(path, consoleId)] = index;
+  }
+
+  if (index == _records.size())
+    _records.push_back(Record());
+
+  Record& record = _records[index];
+  record.consoleId = consoleId;
+  record.path = path;
+  record.files = files;
+  record.entry = entry;
+
+  if (entry.fingerprint)
+    _byFingerprint[fingerprintKey(entry.fingerprint, entry.size, consoleId)] = index;
+}
+
+size_t HashCache::parse(const uint8_t* data, size_t size)
+{
+  size_t offset = HASHCACHE_HEADER_SIZE;
+  while (offset + 4 <= size)
+  {
+    const size_t payloadSize = read32(data + offset);
+    if (payloadSize < HASHCACHE_FIXED_SIZE || payloadSize > HASHCACHE_FIXED_SIZE + HASHCACHE_MAX_PATHS ||
+        offset + 4 + payloadSize + 4 > size)
+    {
+      break;
+    }
+
+    const uint8_t* payload = data + offset + 4;
+    if (read32(payload + payloadSize) != checksum(payload, payloadSize))
+      break;
+
+    Entry entry;
+    const int consoleId = (int)read32(payload);
+    entry.size = read64(payload + 4);
+    entry.time = (int64_t)read64(payload + 12);
+    entry.fingerprint = read64(payload + 20);
+    memcpy(entry.md5, payload + 28, sizeof(entry.md5));
+    entry.filesStamp = read64(payload + 44);
+
+    const char* paths = (const char*)payload + HASHCACHE_FIXED_SIZE;
+    const char* pathsEnd = (const char*)payload + payloadSize;
+    const char* separator = std::find(paths, pathsEnd, '\0');
+    const std::string path(paths, separator);
+
+    std::vector<std::string> files;
+    while (separator < pathsEnd)
+    {
+      const char* file = separator + 1;
+      separator = std::find(file, pathsEnd, '\0');
+      files.push_back(std::string(file, separator));
+    }
+
+    add(consoleId, path, files, entry);
+
+    _numAppended++;
+    offset += 4 + payloadSize + 4;
+  }
+
+  if (offset != size)
+    _logger->warn(TAG "Discarding %zu damaged bytes at the end of %s", size - offset, _path.c_str());
+
+  return offset;
+}
+
+void HashCache::encode(std::vector<uint8_t>& buffer, int consoleId, const std::string& path, const std::vector<std::string>& files, const Entry& entry) const
+{
+  size_t payloadSize = HASHCACHE_FIXED_SIZE + path.length();
+  for (const auto& file : files)
+    payloadSize += 1 + file.length();
+
+  const size_t start = buffer.size();
+  buffer.resize(start + 4 + payloadSize + 4);
+
+  uint8_t* out = &buffer[start];
+  write32(out, (uint32_t)payloadSize);
+
+  uint8_t* payload = out + 4;
+  write32(payload, (uint32_t)consoleId);
+  write64(payload + 4, entry.size);
+  write64(payload + 12, (uint64_t)entry.time);
+  write64(payload + 20, entry.fingerprint);
+  memcpy(payload + 28, entry.md5, sizeof(entry.md5));
+  write64(payload + 44, entry.filesStamp);
+
+  uint8_t* paths = payload + HASHCACHE_FIXED_SIZE;
+  memcpy(paths, path.c_str(), path.length());
+  paths += path.length();
+
+  for (const auto& file : files)
+  {
+    *paths++ = '\0';
+    memcpy(paths, file.c_str(), file.length());
+    paths += file.length();
+  }
+
+  write32(payload + payloadSize, checksum(payload, payloadSize));
+}
+
+bool HashCache::append(int consoleId, const std::string& path, const std::vector<std::string>& files, const Entry& entry)
+{
+  std::vector<uint8_t> buffer;
+  const bool isNew = !util::exists(_path);
+  if (isNew)
+  {
+    buffer.resize(HASHCACHE_HEADER_SIZE);
+    memcpy(&buffer[0], HASHCACHE_MAGIC, 4);
+    write32(&buffer[4], HASHCACHE_VERSION);
+    write32(&buffer[8], RCHEEVOS_VERSION);
+  }
+
+  encode(buffer, consoleId, path, files, entry);
+
+  /* a single write per record, so a crash leaves at most one partial record at the end of the
+   * file, which fails its checksum and gets dropped on the next load */
+  FILE* file = util::openFile(_logger, _path, "ab");
+  if (file == NULL)
+    return false;
+
+  const bool written = (fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size());
+  fclose(file);
+
+  _numAppended++;
+  return written;
+}
+
+bool HashCache::rewrite()
+{
+  std::vector<uint8_t> buffer(HASHCACHE_HEADER_SIZE);
+  memcpy(&buffer[0], HASHCACHE_MAGIC, 4);
+  write32(&buffer[4], HASHCACHE_VERSION);
+  write32(&buffer[8], RCHEEVOS_VERSION);
+
+  for (const auto& record : _records)
+    encode(buffer, record.consoleId, record.path, record.files, record.entry);
+
+  const std::string tempPath = _path + ".tmp";
+  if (!util::saveFile(_logger, tempPath, buffer.data(), buffer.size()))
+    return false;
+
+#ifdef _WIN32
+ #ifdef _WINDOWS
+  const bool renamed = MoveFileExW(util::utf8ToUChar(tempPath).c_str(), util::utf8ToUChar(_path).c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+ #else
+  const bool renamed = MoveFileExA(tempPath.c_str(), _path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+ #endif
+#else
+  const bool renamed = rename(tempPath.c_str(), _path.c_str()) == 0;
+#endif
+
+  if (!renamed)
+  {
+    _logger->error(TAG "Error replacing %s", _path.c_str());
+    util::deleteFile(tempPath);
+    return false;
+  }
+
+  _numAppended = _records.size();
+  return true;
+}
+
+bool HashCache::lookup(const std::string& path, const std::string& entryName, int consoleId, const void* data, size_t dataSize, char hash[33])
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_path.empty())
+    return false;
+
+  time_t time;
+  size_t size;
+  if (!path.empty() && util::fileInfo(path, &time, &size))
+  {
+    auto it = _byPath.find(pathKey(entryPath(canonicalPath(path), entryName), consoleId));
+    if (it != _byPath.end())
+    {
+      const Record& record = _records[it->second];
+      const Entry& entry = record.entry;
+      uint64_t stamp = 0;
+      if (entry.size == size && entry.time == (int64_t)time &&
+          (record.files.empty() || filesStamp(record.files, &stamp)) && stamp == entry.filesStamp)
+      {
+        md5ToHex(entry.md5, hash);
+        return true;
+      }
+    }
+  }
+
+  if (data != NULL && dataSize <= HASHCACHE_MAX_FINGERPRINT_SIZE)
+  {
+    auto it = _byFingerprint.find(fingerprintKey(fingerprint(data, dataSize), dataSize, consoleId));
+    if (it != _byFingerprint.end())
+    {
+      md5ToHex(_records[it->second].entry.md5, hash);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void HashCache::store(const std::string& path, const std::string& entryName, int consoleId, const void* data, size_t dataSize,
+                      const std::vector<std::string>& files, const char* hash)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_path.empty())
+    return;
+
+  Entry entry;
+  memset(&entry, 0, sizeof(entry));
+  if (!hexToMd5(hash, entry.md5))
+    return;
+
+  std::string canonical;
+  std::vector<std::string> otherFiles;
+  time_t time;
+  size_t size;
+  if (!path.empty() && util::fileInfo(path, &time, &size))
+  {
+    const std::string canonicalFile = canonicalPath(path);
+    canonical = entryPath(canonicalFile, entryName);
+    entry.size = size;
+    entry.time = time;
+
+    for (const auto& file : files)
+    {
+      std::string canonicalOther = canonicalPath(file);
+      if (canonicalOther != canonicalFile)
+        otherFiles.push_back(std::move(canonicalOther));
+    }
+
+    std::sort(otherFiles.begin(), otherFiles.end());
+    otherFiles.erase(std::unique(otherFiles.begin(), otherFiles.end()), otherFiles.end());
+
+    size_t pathsSize = canonical.length();
+    for (const auto& file : otherFiles)
+      pathsSize += 1 + file.length();
+
+    if (pathsSize > HASHCACHE_MAX_PATHS)
+    {
+      _logger->warn(TAG "Not caching the hash of %s, it was generated from too many files", path.c_str());
+      canonical.clear();
+    }
+    else if (!otherFiles.empty() && !filesStamp(otherFiles, &entry.filesStamp))
+    {
+      /* one of the files has gone away since it was hashed */
+      canonical.clear();
+    }
+  }
+
+  if (data != NULL && dataSize <= HASHCACHE_MAX_FINGERPRINT_SIZE)
+  {
+    /* the fingerprint is keyed by the size of the content, which isn't necessarily the size of the file */
+    if (canonical.empty())
+      entry.size = dataSize;
+
+    if (entry.size == dataSize)
+      entry.fingerprint = fingerprint(data, dataSize);
+  }
+
+  if (canonical.empty() && entry.fingerprint == 0)
+    return;
+
+  /* don't grow the file with records that are already there */
+  if (!canonical.empty())
+  {
+    auto it = _byPath.find(pathKey(canonical, consoleId));
+    if (it != _byPath.end() && memcmp(&_records[it->second].entry, &entry, sizeof(entry)) == 0)
+      return;
+  }
+  else
+  {
+    auto it = _byFingerprint.find(fingerprintKey(entry.fingerprint, entry.size, consoleId));
+    if (it != _byFingerprint.end() && memcmp(_records[it->second].entry.md5, entry.md5, sizeof(entry.md5)) == 0)
+      return;
+  }
+
+  if (canonical.empty())
+  {
+    otherFiles.clear();
+    entry.filesStamp = 0;
+  }
+
+  add(consoleId, canonical, otherFiles, entry);
+  append(consoleId, canonical, otherFiles, entry);
+}
@@ -0,0 +1,88 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "components/Logger.h"
+
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* On-disk cache of previously generated hashes. Entries are keyed by the canonical path, size and
+ * modification time of the file, the archive entry the content was extracted from, and the console id.
+ * When the hash was generated from other files too (the tracks of a cue sheet, the discs of a
+ * playlist), their sizes and modification times must also match. Entries for content that was hashed
+ * from memory can also be found by a fingerprint of the content. New entries are appended to the
+ * cache file as self-checking records, so an interrupted write only loses the record being written. */
+class HashCache
+{
+public:
+  bool init(Logger* logger, const std::string& path);
+  void destroy();
+
+  const std::string& getPath() const { return _path; }
+
+  /* entryName is the file that was extracted from path when it's an archive, or empty.
+   * data is optional. if provided, it's used to find entries by content when the file doesn't match.
+   * files are the files that were opened to generate the hash (see rc_hash_track_opened_files) */
+  bool lookup(const std::string& path, const std::string& entryName, int consoleId, const void* data, size_t dataSize, char hash[33]);
+  void store(const std::string& path, const std::string& entryName, int consoleId, const void* data, size_t dataSize,
+             const std::vector<std::string>& files, const char* hash);
+
+protected:
+  struct Entry
+  {
+    uint64_t size;
+    int64_t time;
+    uint64_t fingerprint;
+    uint8_t md5[16];
+    uint64_t filesStamp;   /* sizes and times of the other files, 0 if there are none */
+  };
+
+  static std::string pathKey(const std::string& path, int consoleId);
+  static std::string entryPath(const std::string& canonical, const std::string& entryName);
+  static std::string fingerprintKey(uint64_t fingerprint, uint64_t size, int consoleId);
+
+  void   add(int consoleId, const std::string& path, const std::vector<std::string>& files, const Entry& entry);
+  size_t parse(const uint8_t* data, size_t size);
+  void   encode(std::vector<uint8_t>& buffer, int consoleId, const std::string& path, const std::vector<std::string>& files, const Entry& entry) const;
+  bool   append(int consoleId, const std::string& path, const std::vector<std::string>& files, const Entry& entry);
+  bool   rewrite();
+
+  Logger* _logger = NULL;
+  std::string _path;
+
+  struct Record
+  {
+    int consoleId;
+    std::string path;
+    std::vector<std::string> files;
+    Entry entry;
+  };
+
+  std::vector<Record> _records;
+  std::unordered_map<std::string, size_t> _byPath;
+  std::unordered_map<std::string, size_t> _byFingerprint;
+  size_t _numAppended = 0;
+
+  std::mutex _mutex;
+};
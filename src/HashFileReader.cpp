@@ -0,0 +1,493 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "components/Logger.h"
+
+#include <rc_hash.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#ifndef NO_MINIZ
+ #include "ZipIndex.h"
+#endif
+
+#ifdef _WIN32
+ #define WIN32_LEAN_AND_MEAN
+ #include <windows.h>
+#else
+ #include <fcntl.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+#endif
+
+/* files are mapped in windows so disc images larger than the address space still work in 32-bit
+ * builds. windows are aligned to their size, which is a multiple of the mapping granularity on
+ * every platform. */
+#define MAPPED_WINDOW_SIZE ((uint64_t)(sizeof(void*) >= 8 ? 1024 : 64) * 1024 * 1024)
+
+#define TAG "[HFR] "
+
+static Logger* s_logger = NULL;
+
+/* the files opened on each thread while a hash is generated. content like a cue sheet or a playlist
+ * is hashed from other files, so a cached hash has to be checked against all of them */
+static thread_local std::vector<std::string>* s_openedFiles = NULL;
+
+void rc_hash_track_opened_files(std::vector<std::string>* files)
+{
+  s_openedFiles = files;
+}
+
+void rc_hash_add_opened_file(const char* path)
+{
+  if (s_openedFiles)
+    s_openedFiles->push_back(path);
+}
+
+typedef struct mapped_file_t
+{
+#ifdef _WIN32
+  HANDLE file;
+  HANDLE mapping;
+#else
+  int fd;
+#endif
+  uint64_t size;
+  uint64_t position;
+  uint8_t* view;               /* currently mapped window, NULL if none */
+  uint64_t view_offset;        /* file offset of the window */
+  size_t view_size;            /* size of the window */
+} mapped_file_t;
+
+static void rc_hash_mapped_unmap(mapped_file_t* file)
+{
+  if (file->view)
+  {
+#ifdef _WIN32
+    UnmapViewOfFile(file->view);
+#else
+    munmap(file->view, file->view_size);
+#endif
+    file->view = NULL;
+    file->view_size = 0;
+  }
+}
+
+static bool rc_hash_mapped_map(mapped_file_t* file, uint64_t offset)
+{
+  const uint64_t view_offset = offset & ~(MAPPED_WINDOW_SIZE - 1);
+  if (file->view && file->view_offset == view_offset)
+    return true;
+
+  rc_hash_mapped_unmap(file);
+
+  uint64_t view_size = file->size - view_offset;
+  if (view_size > MAPPED_WINDOW_SIZE)
+    view_size = MAPPED_WINDOW_SIZE;
+
+#ifdef _WIN32
+  if (!file->mapping)
+    return false;
+
+  void* view = MapViewOfFile(file->mapping, FILE_MAP_READ, (DWORD)(view_offset >> 32), (DWORD)view_offset, (SIZE_T)view_size);
+  if (!view)
+    return false;
+#else
+  void* view = mmap(NULL, (size_t)view_size, PROT_READ, MAP_SHARED, file->fd, (off_t)view_offset);
+  if (view == MAP_FAILED)
+    return false;
+
+  /* hashing reads the file front to back, let the kernel read ahead aggressively and drop pages behind */
+  madvise(view, (size_t)view_size, MADV_SEQUENTIAL);
+#endif
+
+  file->view = (uint8_t*)view;
+  file->view_offset = view_offset;
+  file->view_size = (size_t)view_size;
+  return true;
+}
+
+/* copies from the current view. a read through a view raises an exception instead of failing if the
+ * file is truncated by another process or its drive goes away, so it's caught where the compiler allows */
+static bool rc_hash_mapped_copy(void* buffer, const uint8_t* view, size_t bytes)
+{
+#ifdef _MSC_VER
+  __try
+  {
+    memcpy(buffer, view, bytes);
+  }
+  __except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+  {
+    return false;
+  }
+#else
+  memcpy(buffer, view, bytes);
+#endif
+
+  return true;
+}
+
+/* the rest of the file is read directly */
+static void rc_hash_mapped_stop_mapping(mapped_file_t* file)
+{
+  rc_hash_mapped_unmap(file);
+
+#ifdef _WIN32
+  if (file->mapping)
+  {
+    CloseHandle(file->mapping);
+    file->mapping = NULL;
+  }
+#endif
+}
+
+/* used if a window can't be mapped (i.e. address space exhausted or the file isn't on a local drive) */
+static size_t rc_hash_mapped_read_direct(mapped_file_t* file, void* buffer, size_t requested_bytes)
+{
+#ifdef _WIN32
+  OVERLAPPED overlapped;
+  DWORD bytes_read = 0;
+
+  memset(&overlapped, 0, sizeof(overlapped));
+  overlapped.Offset = (DWORD)file->position;
+  overlapped.OffsetHigh = (DWORD)(file->position >> 32);
+
+  if (requested_bytes > 0x7FFFFFFF)
+    requested_bytes = 0x7FFFFFFF;
+
+  if (!ReadFile(file->file, buffer, (DWORD)requested_bytes, &bytes_read, &overlapped))
+    return 0;
+
+  return bytes_read;
+#else
+  const ssize_t bytes_read = pread(file->fd, buffer, requested_bytes, (off_t)file->position);
+  return (bytes_read > 0) ? (size_t)bytes_read : 0;
+#endif
+}
+
+static void rc_hash_mapped_log_error(const char* action, const char* path)
+{
+  if (!s_logger)
+    return;
+
+#ifdef _WIN32
+  const DWORD error = GetLastError();
+  if (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND)
+    s_logger->warn(TAG "File not found: %s", path);
+  else
+    s_logger->error(TAG "Error %s \"%s\": %lu", action, path, (unsigned long)error);
+#else
+  if (errno == ENOENT)
+    s_logger->warn(TAG "File not found: %s", path);
+  else
+    s_logger->error(TAG "Error %s \"%s\": %s", action, path, strerror(errno));
+#endif
+}
+
+static void* rc_hash_mapped_open(const char* path)
+{
+  mapped_file_t* file = (mapped_file_t*)calloc(1, sizeof(mapped_file_t));
+  if (!file)
+    return NULL;
+
+#ifdef _WIN32
+  /* path is UTF-8 */
+  const int length = MultiByteToWideChar(CP_UTF8, 0, path, -1, NULL, 0);
+  WCHAR* wpath = (length > 0) ? (WCHAR*)malloc(length * sizeof(WCHAR)) : NULL;
+  if (!wpath)
+  {
+    free(file);
+    return NULL;
+  }
+
+  MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, length);
+  file->file = CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+  /* only files on local fixed drives are mapped. network and removable drives can go away while the
+   * file is being read, which faults the read instead of failing it */
+  WCHAR volume[MAX_PATH];
+  const bool fixed_drive = GetVolumePathNameW(wpath, volume, MAX_PATH) && GetDriveTypeW(volume) == DRIVE_FIXED;
+  free(wpath);
+
+  if (file->file == INVALID_HANDLE_VALUE)
+  {
+    rc_hash_mapped_log_error("opening", path);
+    free(file);
+    return NULL;
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file->file, &size))
+  {
+    rc_hash_mapped_log_error("reading the size of", path);
+    CloseHandle(file->file);
+    free(file);
+    return NULL;
+  }
+
+  file->size = (uint64_t)size.QuadPart;
+
+  /* an empty file can't be mapped. reads will just return nothing */
+  if (file->size > 0 && fixed_drive)
+    file->mapping = CreateFileMappingW(file->file, NULL, PAGE_READONLY, 0, 0, NULL);
+#else
+  file->fd = open(path, O_RDONLY);
+  if (file->fd < 0)
+  {
+    rc_hash_mapped_log_error("opening", path);
+    free(file);
+    return NULL;
+  }
+
+  struct stat filestat;
+  if (fstat(file->fd, &filestat) != 0)
+  {
+    rc_hash_mapped_log_error("reading the size of", path);
+    close(file->fd);
+    free(file);
+    return NULL;
+  }
+
+  if (!S_ISREG(filestat.st_mode))
+  {
+    if (s_logger)
+      s_logger->error(TAG "Error opening \"%s\": not a file", path);
+
+    close(file->fd);
+    free(file);
+    return NULL;
+  }
+
+  file->size = (uint64_t)filestat.st_size;
+#endif
+
+  rc_hash_add_opened_file(path);
+  return file;
+}
+
+static void rc_hash_mapped_seek(void* file_handle, int64_t offset, int origin)
+{
+  mapped_file_t* file = (mapped_file_t*)file_handle;
+  int64_t position;
+
+  switch (origin)
+  {
+    case SEEK_SET: position = offset; break;
+    case SEEK_CUR: position = (int64_t)file->position + offset; break;
+    case SEEK_END: position = (int64_t)file->size + offset; break;
+    default: return;
+  }
+
+  file->position = (position < 0) ? 0 : (uint64_t)position;
+}
+
+static int64_t rc_hash_mapped_tell(void* file_handle)
+{
+  return (int64_t)((mapped_file_t*)file_handle)->position;
+}
+
+static size_t rc_hash_mapped_read(void* file_handle, void* buffer, size_t requested_bytes)
+{
+  mapped_file_t* file = (mapped_file_t*)file_handle;
+  uint8_t* output = (uint8_t*)buffer;
+  size_t total = 0;
+
+  if (file->position >= file->size)
+    return 0;
+
+  if (requested_bytes > file->size - file->position)
+    requested_bytes = (size_t)(file->size - file->position);
+
+  while (total < requested_bytes)
+  {
+    size_t bytes;
+
+    if (rc_hash_mapped_map(file, file->position))
+    {
+      const size_t offset = (size_t)(file->position - file->view_offset);
+      bytes = file->view_size - offset;
+      if (bytes > requested_bytes - total)
+        bytes = requested_bytes - total;
+
+      if (!rc_hash_mapped_copy(output + total, file->view + offset, bytes))
+      {
+        if (s_logger)
+          s_logger->warn(TAG "Error reading a mapped view of the file, reading it directly");
+
+        rc_hash_mapped_stop_mapping(file);
+        continue;
+      }
+    }
+    else
+    {
+      bytes = rc_hash_mapped_read_direct(file, output + total, requested_bytes - total);
+      if (bytes == 0)
+        break;
+    }
+
+    file->position += bytes;
+    total += bytes;
+  }
+
+  return total;
+}
+
+static void rc_hash_mapped_close(void* file_handle)
+{
+  mapped_file_t* file = (mapped_file_t*)file_handle;
+
+  rc_hash_mapped_unmap(file);
+
+#ifdef _WIN32
+  if (file->mapping)
+    CloseHandle(file->mapping);
+  CloseHandle(file->file);
+#else
+  close(file->fd);
+#endif
+
+  free(file);
+}
+
+void rc_hash_get_mapped_filereader(struct rc_hash_filereader* filereader, Logger* logger)
+{
+  s_logger = logger;
+
+  memset(filereader, 0, sizeof(*filereader));
+  filereader->open = rc_hash_mapped_open;
+  filereader->seek = rc_hash_mapped_seek;
+  filereader->tell = rc_hash_mapped_tell;
+  filereader->read = rc_hash_mapped_read;
+  filereader->close = rc_hash_mapped_close;
+}
+
+#ifndef NO_MINIZ
+
+/* files in zips are referenced as "archive.zip#file", the same as the paths passed to cores. the file
+ * is decompressed in chunks as it's read, so it never has to be loaded into memory. the archive's
+ * index is cached, so opening several files from the same archive only reads its directory once */
+typedef struct zip_entry_file_t
+{
+  std::shared_ptr<const ZipIndex> index;
+  const ZipIndex::Entry* entry;
+  ZipIndex::Reader reader;
+  uint64_t position;           /* position requested by the caller */
+} zip_entry_file_t;
+
+static void* rc_hash_zip_open(const char* path)
+{
+  std::string zip_path, file_name;
+  if (!ZipIndex::splitPath(path, zip_path, file_name))
+    return NULL;
+
+  std::shared_ptr<const ZipIndex> index = ZipIndex::get(NULL, zip_path);
+  if (!index)
+    return NULL;
+
+  const ZipIndex::Entry* entry = index->find(file_name);
+  if (!entry)
+    return NULL;
+
+  zip_entry_file_t* file = new zip_entry_file_t();
+  file->index = index;
+  file->entry = entry;
+  file->position = 0;
+
+  if (!file->reader.open(*index, *entry))
+  {
+    delete file;
+    return NULL;
+  }
+
+  rc_hash_add_opened_file(zip_path.c_str());
+  return file;
+}
+
+static void rc_hash_zip_seek(void* file_handle, int64_t offset, int origin)
+{
+  zip_entry_file_t* file = (zip_entry_file_t*)file_handle;
+  int64_t position;
+
+  /* only remember the position. seeking to the end to find the size is free, and the data is
+   * only decompressed when it's read */
+  switch (origin)
+  {
+    case SEEK_SET: position = offset; break;
+    case SEEK_CUR: position = (int64_t)file->position + offset; break;
+    case SEEK_END: position = (int64_t)file->entry->size + offset; break;
+    default: return;
+  }
+
+  file->position = (position < 0) ? 0 : (uint64_t)position;
+}
+
+static int64_t rc_hash_zip_tell(void* file_handle)
+{
+  return (int64_t)((zip_entry_file_t*)file_handle)->position;
+}
+
+static size_t rc_hash_zip_read(void* file_handle, void* buffer, size_t requested_bytes)
+{
+  zip_entry_file_t* file = (zip_entry_file_t*)file_handle;
+  uint8_t* output = (uint8_t*)buffer;
+  size_t total = 0;
+
+  if (file->position >= file->entry->size)
+    return 0;
+
+  if (file->reader.tell() != file->position && !file->reader.seek(file->position))
+    return 0;
+
+  while (total < requested_bytes)
+  {
+    const size_t bytes = file->reader.read(output + total, requested_bytes - total);
+    if (bytes == 0)
+      break;
+
+    total += bytes;
+  }
+
+  file->position += total;
+  return total;
+}
+
+static void rc_hash_zip_close(void* file_handle)
+{
+  delete (zip_entry_file_t*)file_handle;
+}
+
+void rc_hash_get_zip_filereader(struct rc_hash_filereader* filereader)
+{
+  memset(filereader, 0, sizeof(*filereader));
+  filereader->open = rc_hash_zip_open;
+  filereader->seek = rc_hash_zip_seek;
+  filereader->tell = rc_hash_zip_tell;
+  filereader->read = rc_hash_zip_read;
+  filereader->close = rc_hash_zip_close;
+}
+
+#endif /* NO_MINIZ */
@@ -0,0 +1,146 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Measures how long the calling thread spends logging a message: filtered out by the log level,
+ * written synchronously (before the writer thread is started), formatted by the caller and queued,
+ * and queued with its arguments to be formatted by the writer thread. The console output is sent
+ * to the null device so only the cost of the logger is measured.
+ *
+ * usage: LoggerBenchmark [number of messages] */
+
+#include "components/Logger.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+ #define NULL_DEVICE "NUL"
+#else
+ #define NULL_DEVICE "/dev/null"
+#endif
+
+enum benchmark_mode
+{
+  BENCHMARK_FILTERED,
+  BENCHMARK_SYNCHRONOUS,
+  BENCHMARK_FORMATTED,
+  BENCHMARK_DEFERRED
+};
+
+static const char* benchmark_mode_name(benchmark_mode mode)
+{
+  switch (mode)
+  {
+    case BENCHMARK_FILTERED: return "filtered";
+    case BENCHMARK_SYNCHRONOUS: return "synchronous";
+    case BENCHMARK_FORMATTED: return "formatted";
+    default: return "deferred";
+  }
+}
+
+/* messages like the ones logged every frame by the core, the audio and the configuration */
+static void benchmark_log(Logger& logger, benchmark_mode mode, int i)
+{
+  static const char* variables[] = { "beetle_psx_hw_renderer", "beetle_psx_hw_internal_resolution", "beetle_psx_hw_cd_fastload" };
+  const char* variable = variables[i % 3];
+
+  if (mode == BENCHMARK_FORMATTED)
+  {
+    logger.printf(RETRO_LOG_INFO, "[COR] Calling %s", "RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE");
+    logger.printf(RETRO_LOG_INFO, "[AUD] Processing %zu audio frames", (size_t)(735 + (i & 1)));
+    logger.printf(RETRO_LOG_INFO, "[CFG] Variable %s found in selections, value is \"%s\"", variable, "hardware");
+    logger.printf(RETRO_LOG_INFO, "[VID] Frame %d took %.3f ms", i, 16.667);
+  }
+  else
+  {
+    logger.info("[COR] Calling %s", "RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE");
+    logger.info("[AUD] Processing %zu audio frames", (size_t)(735 + (i & 1)));
+    logger.info("[CFG] Variable %s found in selections, value is \"%s\"", variable, "hardware");
+    logger.info("[VID] Frame %d took %.3f ms", i, 16.667);
+  }
+}
+
+#define BENCHMARK_MESSAGES_PER_CALL 4
+
+/* returns the time spent by the caller and the time until everything was written, in seconds */
+static void benchmark_run(benchmark_mode mode, int count, double& callerTime, double& totalTime)
+{
+  Logger logger;
+
+  if (mode != BENCHMARK_SYNCHRONOUS)
+    logger.init(NULL);
+
+  if (mode == BENCHMARK_FILTERED)
+    logger.setLogLevel(RETRO_LOG_WARN);
+  else
+    logger.setLogLevel(RETRO_LOG_INFO);
+
+  const auto start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < count; i++)
+    benchmark_log(logger, mode, i);
+
+  const auto called = std::chrono::steady_clock::now();
+
+  logger.flush();
+
+  const auto written = std::chrono::steady_clock::now();
+
+  logger.destroy();
+
+  callerTime = std::chrono::duration<double>(called - start).count();
+  totalTime = std::chrono::duration<double>(written - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+  const benchmark_mode modes[] = { BENCHMARK_FILTERED, BENCHMARK_SYNCHRONOUS, BENCHMARK_FORMATTED, BENCHMARK_DEFERRED };
+  const size_t numModes = sizeof(modes) / sizeof(modes[0]);
+
+  int count = 100000;
+  if (argc > 1)
+    count = atoi(argv[1]);
+
+  if (count <= 0)
+  {
+    fprintf(stderr, "usage: %s [number of messages]\n", argv[0]);
+    return 1;
+  }
+
+  if (!freopen(NULL_DEVICE, "w", stdout))
+  {
+    fprintf(stderr, "could not redirect the console output to " NULL_DEVICE "\n");
+    return 1;
+  }
+
+  fprintf(stderr, "%d messages\n\n", count * BENCHMARK_MESSAGES_PER_CALL);
+  fprintf(stderr, "%-12s %14s %14s\n", "mode", "caller ns/msg", "total ns/msg");
+
+  for (size_t i = 0; i < numModes; i++)
+  {
+    double callerTime, totalTime;
+    benchmark_run(modes[i], count, callerTime, totalTime);
+
+    const double scale = 1e9 / ((double)count * BENCHMARK_MESSAGES_PER_CALL);
+    fprintf(stderr, "%-12s %14.1f %14.1f\n", benchmark_mode_name(modes[i]), callerTime * scale, totalTime * scale);
+  }
+
+  return 0;
+}
@@ -18,6 +18,7 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "Memory.h"
+#include "MemoryPageTable.h"
 
 #include "Application.h"
 
@@ -25,234 +26,212 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 #include <rcheevos.h>
 #include <rcheevos/src/rc_libretro.h>
 
-#include <time.h>
-
 #define TAG "[MEM] "
 
+#define MAX_MEMORY_BANKS 64
+
 static rc_libretro_memory_regions_t g_memoryRegions;
-static int g_memoryBankFirstRegion[16];
+static unsigned g_memoryBankStart[MAX_MEMORY_BANKS];
+
+/* reads go through g_readPages, which is either the live memory or, while achievements are being
+ * evaluated in snapshot mode, a copy of it taken right after the frame. writes always go to the
+ * live memory */
+static MemoryPageTable g_livePages;
+static MemoryPageTable g_snapshotPages;
+static const MemoryPageTable* g_readPages = &g_livePages;
 
-static unsigned char memoryRead(unsigned addr, int firstRegion)
+static rc_libretro_memory_regions_t g_snapshotRegions;
+static uint8_t* g_snapshotBuffer = NULL;
+
+static void destroySnapshot()
 {
-  unsigned i;
-  for (i = firstRegion; i < g_memoryRegions.count; ++i)
-  {
-    const size_t size = g_memoryRegions.size[i];
-    if (addr < size)
-    {
-      if (g_memoryRegions.data[i] == NULL)
-        break;
+  g_readPages = &g_livePages;
 
-      return g_memoryRegions.data[i][addr];
-    }
+  g_snapshotPages.destroy();
 
-    addr -= size;
-  }
+  free(g_snapshotBuffer);
+  g_snapshotBuffer = NULL;
+}
 
-  return 0;
+static void buildPageTable()
+{
+  /* the snapshot mirrors the old layout, it'll be rebuilt on the next capture */
+  destroySnapshot();
+
+  g_livePages.build(&g_memoryRegions);
 }
 
-static unsigned memoryReadBlock(unsigned addr, uint8_t* buffer, unsigned count, int firstRegion)
+static void destroyPageTable()
 {
-  unsigned provided = 0;
-  unsigned i;
-  for (i = firstRegion; i < g_memoryRegions.count; ++i)
+  destroySnapshot();
+
+  g_livePages.destroy();
+}
+
+static bool buildSnapshot()
+{
+  size_t snapshotSize = 0;
+  for (unsigned i = 0; i < g_memoryRegions.count; ++i)
   {
-    const size_t size = g_memoryRegions.size[i];
-    if (addr < size)
-    {
-      if (g_memoryRegions.data[i] == NULL)
-        break;
+    if (g_memoryRegions.data[i])
+      snapshotSize += g_memoryRegions.size[i];
+  }
 
-      const size_t avail = std::min(size - addr, (size_t)count);
-      memcpy(buffer, &g_memoryRegions.data[i][addr], avail);
+  if (snapshotSize == 0 || g_livePages.getPageCount() == 0)
+    return false;
 
-      provided += avail;
-      count -= avail;
-      if (count == 0)
-        break;
+  g_snapshotBuffer = (uint8_t*)malloc(snapshotSize);
+  if (g_snapshotBuffer == NULL)
+    return false;
 
-      buffer += avail;
-      addr += avail;
+  /* same layout as the live regions, but the valid regions are packed into one buffer */
+  memcpy(&g_snapshotRegions, &g_memoryRegions, sizeof(g_snapshotRegions));
+  uint8_t* data = g_snapshotBuffer;
+  for (unsigned i = 0; i < g_snapshotRegions.count; ++i)
+  {
+    if (g_snapshotRegions.data[i])
+    {
+      g_snapshotRegions.data[i] = data;
+      data += g_snapshotRegions.size[i];
     }
+  }
 
-    addr -= size;
+  if (!g_snapshotPages.build(&g_snapshotRegions))
+  {
+    destroySnapshot();
+    return false;
   }
 
-  return provided;
+  return true;
 }
 
-static void memoryWrite(unsigned addr, int firstRegion, unsigned char value)
+static inline unsigned char memoryRead(unsigned addr, unsigned bankStart)
 {
-  unsigned i;
-  for (i = firstRegion; i < g_memoryRegions.count; ++i)
-  {
-    const size_t size = g_memoryRegions.size[i];
-    if (addr < size)
-    {
-      if (g_memoryRegions.data[i])
-        g_memoryRegions.data[i][addr] = value;
-
-      break;
-    }
+  return g_readPages->read(addr + bankStart);
+}
 
-    addr -= size;
-  }
+static unsigned memoryReadBlock(unsigned addr, uint8_t* buffer, unsigned count, unsigned bankStart)
+{
+  return g_readPages->readBlock(addr + bankStart, buffer, count);
 }
 
-static unsigned char memoryRead0(unsigned addr) { return memoryRead(addr, g_memoryBankFirstRegion[0]); }
-static unsigned char memoryRead1(unsigned addr) { return memoryRead(addr, g_memoryBankFirstRegion[1]); }
-static unsigned char memoryRead2(unsigned addr) { return memoryRead(addr, g_memoryBankFirstRegion[2]); }
-static unsigned char memoryRead3(unsigned addr) { return memoryRead(addr, g_memoryBankFirstRegion[3]); }
-static unsigned char memoryRead4(unsigned addr) { return memoryRead(addr, g_memoryBankFirstRegion[4]); }
-static unsigned char memoryRead5(unsigned addr) { return memoryRead(addr, g_memoryBankFirstRegion[5]); }
-static unsigned char memoryRead6(unsigned addr) { return memoryRead(addr, g_memoryBankFirstRegion[6]); }
-static unsigned char memoryRead7(unsigned addr) { return memoryRead(addr, g_memoryBankFirstRegion[7]); }
-static unsigned char memoryRead8(unsigned addr) { return memoryRead(addr, g_memoryBankFirstRegion[8]); }
-static unsigned char memoryRead9(unsigned addr) { return memoryRead(addr, g_memoryBankFirstRegion[9]); }
-static unsigned char memoryRead10(unsigned addr) { return memoryRead(addr, g_memoryBankFirstRegion[10]); }
-static unsigned char memoryRead11(unsigned addr) { return memoryRead(addr, g_memoryBankFirstRegion[11]); }
-static unsigned char memoryRead12(unsigned addr) { return memoryRead(addr, g_memoryBankFirstRegion[12]); }
-static unsigned char memoryRead13(unsigned addr) { return memoryRead(addr, g_memoryBankFirstRegion[13]); }
-static unsigned char memoryRead14(unsigned addr) { return memoryRead(addr, g_memoryBankFirstRegion[14]); }
-static unsigned char memoryRead15(unsigned addr) { return memoryRead(addr, g_memoryBankFirstRegion[15]); }
-
-static unsigned memoryReadBlock0(unsigned addr, uint8_t* buffer, unsigned count) { return memoryReadBlock(addr, buffer, count, g_memoryBankFirstRegion[0]); }
-static unsigned memoryReadBlock1(unsigned addr, uint8_t* buffer, unsigned count) { return memoryReadBlock(addr, buffer, count, g_memoryBankFirstRegion[1]); }
-static unsigned memoryReadBlock2(unsigned addr, uint8_t* buffer, unsigned count) { return memoryReadBlock(addr, buffer, count, g_memoryBankFirstRegion[2]); }
-static unsigned memoryReadBlock3(unsigned addr, uint8_t* buffer, unsigned count) { return memoryReadBlock(addr, buffer, count, g_memoryBankFirstRegion[3]); }
-static unsigned memoryReadBlock4(unsigned addr, uint8_t* buffer, unsigned count) { return memoryReadBlock(addr, buffer, count, g_memoryBankFirstRegion[4]); }
-static unsigned memoryReadBlock5(unsigned addr, uint8_t* buffer, unsigned count) { return memoryReadBlock(addr, buffer, count, g_memoryBankFirstRegion[5]); }
-static unsigned memoryReadBlock6(unsigned addr, uint8_t* buffer, unsigned count) { return memoryReadBlock(addr, buffer, count, g_memoryBankFirstRegion[6]); }
-static unsigned memoryReadBlock7(unsigned addr, uint8_t* buffer, unsigned count) { return memoryReadBlock(addr, buffer, count, g_memoryBankFirstRegion[7]); }
-static unsigned memoryReadBlock8(unsigned addr, uint8_t* buffer, unsigned count) { return memoryReadBlock(addr, buffer, count, g_memoryBankFirstRegion[8]); }
-static unsigned memoryReadBlock9(unsigned addr, uint8_t* buffer, unsigned count) { return memoryReadBlock(addr, buffer, count, g_memoryBankFirstRegion[9]); }
-static unsigned memoryReadBlock10(unsigned addr, uint8_t* buffer, unsigned count) { return memoryReadBlock(addr, buffer, count, g_memoryBankFirstRegion[10]); }
-static unsigned memoryReadBlock11(unsigned addr, uint8_t* buffer, unsigned count) { return memoryReadBlock(addr, buffer, count, g_memoryBankFirstRegion[11]); }
-static unsigned memoryReadBlock12(unsigned addr, uint8_t* buffer, unsigned count) { return memoryReadBlock(addr, buffer, count, g_memoryBankFirstRegion[12]); }
-static unsigned memoryReadBlock13(unsigned addr, uint8_t* buffer, unsigned count) { return memoryReadBlock(addr, buffer, count, g_memoryBankFirstRegion[13]); }
-static unsigned memoryReadBlock14(unsigned addr, uint8_t* buffer, unsigned count) { return memoryReadBlock(addr, buffer, count, g_memoryBankFirstRegion[14]); }
-static unsigned memoryReadBlock15(unsigned addr, uint8_t* buffer, unsigned count) { return memoryReadBlock(addr, buffer, count, g_memoryBankFirstRegion[15]); }
-
-static void memoryWrite0(unsigned addr, unsigned char value) { memoryWrite(addr, g_memoryBankFirstRegion[0], value); }
-static void memoryWrite1(unsigned addr, unsigned char value) { memoryWrite(addr, g_memoryBankFirstRegion[1], value); }
-static void memoryWrite2(unsigned addr, unsigned char value) { memoryWrite(addr, g_memoryBankFirstRegion[2], value); }
-static void memoryWrite3(unsigned addr, unsigned char value) { memoryWrite(addr, g_memoryBankFirstRegion[3], value); }
-static void memoryWrite4(unsigned addr, unsigned char value) { memoryWrite(addr, g_memoryBankFirstRegion[4], value); }
-static void memoryWrite5(unsigned addr, unsigned char value) { memoryWrite(addr, g_memoryBankFirstRegion[5], value); }
-static void memoryWrite6(unsigned addr, unsigned char value) { memoryWrite(addr, g_memoryBankFirstRegion[6], value); }
-static void memoryWrite7(unsigned addr, unsigned char value) { memoryWrite(addr, g_memoryBankFirstRegion[7], value); }
-static void memoryWrite8(unsigned addr, unsigned char value) { memoryWrite(addr, g_memoryBankFirstRegion[8], value); }
-static void memoryWrite9(unsigned addr, unsigned char value) { memoryWrite(addr, g_memoryBankFirstRegion[9], value); }
-static void memoryWrite10(unsigned addr, unsigned char value) { memoryWrite(addr, g_memoryBankFirstRegion[10], value); }
-static void memoryWrite11(unsigned addr, unsigned char value) { memoryWrite(addr, g_memoryBankFirstRegion[11], value); }
-static void memoryWrite12(unsigned addr, unsigned char value) { memoryWrite(addr, g_memoryBankFirstRegion[12], value); }
-static void memoryWrite13(unsigned addr, unsigned char value) { memoryWrite(addr, g_memoryBankFirstRegion[13], value); }
-static void memoryWrite14(unsigned addr, unsigned char value) { memoryWrite(addr, g_memoryBankFirstRegion[14], value); }
-static void memoryWrite15(unsigned addr, unsigned char value) { memoryWrite(addr, g_memoryBankFirstRegion[15], value); }
-
-static void installMemoryBank(int bankId, int validBankId, int firstRegion, size_t bankSize, libretro::LoggerComponent* logger)
+static inline void memoryWrite(unsigned addr, unsigned bankStart, unsigned char value)
 {
-  switch (validBankId)
-  {
-    case 0:
-      RA_InstallMemoryBank(bankId, memoryRead0, memoryWrite0, bankSize);
-      RA_InstallMemoryBankBlockReader(bankId, memoryReadBlock0);
-      break;
-    case 1:
-      RA_InstallMemoryBank(bankId, memoryRead1, memoryWrite1, bankSize);
-      RA_InstallMemoryBankBlockReader(bankId, memoryReadBlock1);
-      break;
-    case 2:
-      RA_InstallMemoryBank(bankId, memoryRead2, memoryWrite2, bankSize);
-      RA_InstallMemoryBankBlockReader(bankId, memoryReadBlock2);
-      break;
-    case 3:
-      RA_InstallMemoryBank(bankId, memoryRead3, memoryWrite3, bankSize);
-      RA_InstallMemoryBankBlockReader(bankId, memoryReadBlock3);
-      break;
-    case 4:
-      RA_InstallMemoryBank(bankId, memoryRead4, memoryWrite4, bankSize);
-      RA_InstallMemoryBankBlockReader(bankId, memoryReadBlock4);
-      break;
-    case 5:
-      RA_InstallMemoryBank(bankId, memoryRead5, memoryWrite5, bankSize);
-      RA_InstallMemoryBankBlockReader(bankId, memoryReadBlock5);
-      break;
-    case 6:
-      RA_InstallMemoryBank(bankId, memoryRead6, memoryWrite6, bankSize);
-      RA_InstallMemoryBankBlockReader(bankId, memoryReadBlock6);
-      break;
-    case 7:
-      RA_InstallMemoryBank(bankId, memoryRead7, memoryWrite7, bankSize);
-      RA_InstallMemoryBankBlockReader(bankId, memoryReadBlock7);
-      break;
-    case 8:
-      RA_InstallMemoryBank(bankId, memoryRead8, memoryWrite8, bankSize);
-      RA_InstallMemoryBankBlockReader(bankId, memoryReadBlock8);
-      break;
-    case 9:
-      RA_InstallMemoryBank(bankId, memoryRead9, memoryWrite9, bankSize);
-      RA_InstallMemoryBankBlockReader(bankId, memoryReadBlock9);
-      break;
-    case 10:
-      RA_InstallMemoryBank(bankId, memoryRead10, memoryWrite10, bankSize);
-      RA_InstallMemoryBankBlockReader(bankId, memoryReadBlock10);
-      break;
-    case 11:
-      RA_InstallMemoryBank(bankId, memoryRead11, memoryWrite11, bankSize);
-      RA_InstallMemoryBankBlockReader(bankId, memoryReadBlock11);
-      break;
-    case 12:
-      RA_InstallMemoryBank(bankId, memoryRead12, memoryWrite12, bankSize);
-      RA_InstallMemoryBankBlockReader(bankId, memoryReadBlock12);
-      break;
-    case 13:
-      RA_InstallMemoryBank(bankId, memoryRead13, memoryWrite13, bankSize);
-      RA_InstallMemoryBankBlockReader(bankId, memoryReadBlock13);
-      break;
-    case 14:
-      RA_InstallMemoryBank(bankId, memoryRead14, memoryWrite14, bankSize);
-      RA_InstallMemoryBankBlockReader(bankId, memoryReadBlock14);
-      break;
-    case 15:
-      RA_InstallMemoryBank(bankId, memoryRead15, memoryWrite15, bankSize);
-      RA_InstallMemoryBankBlockReader(bankId, memoryReadBlock15);
-      break;
-    default: logger->warn(TAG "Too many unsupported memory regions"); return;
-  }
+  addr += bankStart;
+  g_livePages.write(addr, value);
 
-  g_memoryBankFirstRegion[validBankId] = firstRegion;
+  /* keep the snapshot consistent so the write is visible to subsequent reads */
+  if (g_readPages != &g_livePages)
+    g_readPages->write(addr, value);
 }
 
-static clock_t g_lastMemoryRefresh = 0;
-static unsigned char deferredMemoryRead(unsigned addr)
+/* RA_InstallMemoryBank doesn't provide a context pointer, so each bank needs its own set of
+ * functions. they're generated from templates and collected into a table at compile time */
+template<unsigned N> static unsigned char memoryReadN(unsigned addr) { return memoryRead(addr, g_memoryBankStart[N]); }
+template<unsigned N> static unsigned memoryReadBlockN(unsigned addr, uint8_t* buffer, unsigned count) { return memoryReadBlock(addr, buffer, count, g_memoryBankStart[N]); }
+template<unsigned N> static void memoryWriteN(unsigned addr, unsigned char value) { memoryWrite(addr, g_memoryBankStart[N], value); }
+
+struct MemoryBankAccessors
+{
+  unsigned char (*read)(unsigned addr);
+  unsigned (*readBlock)(unsigned addr, uint8_t* buffer, unsigned count);
+  void (*write)(unsigned addr, unsigned char value);
+};
+
+template<unsigned... Ns> struct MemoryBankTable
 {
-  const clock_t now = clock();
-  const clock_t elapsed = now - g_lastMemoryRefresh;
-  if (elapsed < CLOCKS_PER_SEC / 100) /* 10ms */
-    return '\0';
+  static const MemoryBankAccessors accessors[sizeof...(Ns)];
+};
 
-  g_lastMemoryRefresh = now;
+template<unsigned... Ns> const MemoryBankAccessors MemoryBankTable<Ns...>::accessors[sizeof...(Ns)] =
+{
+  { memoryReadN<Ns>, memoryReadBlockN<Ns>, memoryWriteN<Ns> }...
+};
 
-  extern Application app;
-  app.refreshMemoryMap();
-  return memoryRead0(addr);
+/* expands to MemoryBankTable<0, 1, ..., N - 1> */
+template<unsigned N, unsigned... Ns> struct MemoryBankTableBuilder : MemoryBankTableBuilder<N - 1, N - 1, Ns...> {};
+template<unsigned... Ns> struct MemoryBankTableBuilder<0, Ns...> { typedef MemoryBankTable<Ns...> type; };
+
+typedef MemoryBankTableBuilder<MAX_MEMORY_BANKS>::type MemoryBanks;
+
+static void installMemoryBank(int bankId, int validBankId, unsigned bankStart, size_t bankSize, libretro::LoggerComponent* logger)
+{
+  if (validBankId >= MAX_MEMORY_BANKS)
+  {
+    logger->warn(TAG "Too many unsupported memory regions");
+    return;
+  }
+
+  g_memoryBankStart[validBankId] = bankStart;
+
+  const MemoryBankAccessors& accessors = MemoryBanks::accessors[validBankId];
+  RA_InstallMemoryBank(bankId, accessors.read, accessors.write, bankSize);
+  RA_InstallMemoryBankBlockReader(bankId, accessors.readBlock);
 }
 
+static bool g_memoryBanksDeferred = false;
+
 bool Memory::init(libretro::LoggerComponent* logger)
 {
   _logger = logger;
+  _memoryMapVersion = 0;
+  memset(_coreMemoryData, 0, sizeof(_coreMemoryData));
+  memset(_coreMemorySize, 0, sizeof(_coreMemorySize));
   return true;
 }
 
 void Memory::destroy()
 {
   rc_libretro_memory_destroy(&g_memoryRegions);
-  g_lastMemoryRefresh = 0;
+  destroyPageTable();
+  g_memoryBanksDeferred = false;
   RA_ClearMemoryBanks();
 }
 
+void Memory::captureCoreState(libretro::Core* core)
+{
+  _memoryMapVersion = core->getMemoryMapVersion();
+
+  for (unsigned id = 0; id < sizeof(_coreMemoryData) / sizeof(_coreMemoryData[0]); ++id)
+  {
+    _coreMemoryData[id] = core->getMemoryData(id);
+    _coreMemorySize[id] = core->getMemorySize(id);
+  }
+}
+
+void Memory::update(libretro::Core* core, int consoleId)
+{
+  bool changed = (core->getMemoryMapVersion() != _memoryMapVersion);
+
+  for (unsigned id = 0; id < sizeof(_coreMemoryData) / sizeof(_coreMemoryData[0]) && !changed; ++id)
+  {
+    changed = (core->getMemoryData(id) != _coreMemoryData[id] ||
+               core->getMemorySize(id) != _coreMemorySize[id]);
+  }
+
+  if (changed)
+    attachToCore(core, consoleId);
+}
+
+void Memory::captureSnapshot()
+{
+  if (g_snapshotPages.getPageCount() == 0 && !buildSnapshot())
+    return;
+
+  for (unsigned i = 0; i < g_memoryRegions.count; ++i)
+  {
+    if (g_memoryRegions.data[i])
+      memcpy(g_snapshotRegions.data[i], g_memoryRegions.data[i], g_memoryRegions.size[i]);
+  }
+
+  g_readPages = &g_snapshotPages;
+}
+
+void Memory::releaseSnapshot()
+{
+  g_readPages = &g_livePages;
+}
+
 static libretro::Core* s_coreBeingInitialized = nullptr;
 static libretro::LoggerComponent* s_logger = nullptr;
 
@@ -303,12 +282,14 @@ static void dumpDescriptors(const retro_memory_map* mmap, libretro::LoggerCompon
 
 void Memory::attachToCore(libretro::Core* core, int consoleId)
 {
+  captureCoreState(core);
+
   s_logger = _logger;
   s_coreBeingInitialized = core;
   rc_libretro_init_verbose_message_callback(rc_log_callback);
 
   const retro_memory_map* mmap = core->getMemoryMap();
-  if (mmap && _logger->logLevel(RETRO_LOG_DEBUG))
+  if (mmap && _logger->logLevel(TAG, RETRO_LOG_DEBUG))
     dumpDescriptors(mmap, _logger);
 
   /* capture the registered regions */
@@ -338,17 +319,20 @@ void Memory::attachToCore(libretro::Core* core, int consoleId)
 
   /* update the global map */
   memcpy(&g_memoryRegions, &memoryRegions, sizeof(memoryRegions));
+  buildPageTable();
 
   if (hasValidRegion)
   {
     installMemoryBanks();
+    g_memoryBanksDeferred = false;
   }
-  else if (g_lastMemoryRefresh == 0)
+  else if (!g_memoryBanksDeferred)
   {
+    /* update() will install the real banks once the core exposes its memory */
     _logger->info(TAG "delaying memory bank installation");
-    g_lastMemoryRefresh = clock();
+    g_memoryBanksDeferred = true;
     RA_ClearMemoryBanks();
-    RA_InstallMemoryBank(0, deferredMemoryRead, memoryWrite0, g_memoryRegions.total_size);
+    RA_InstallMemoryBank(0, memoryReadN<0>, memoryWriteN<0>, g_memoryRegions.total_size);
   }
 }
 
@@ -382,14 +366,14 @@ void Memory::installMemoryBanks()
   if (!g_bVersionSupported)
   {
     // have an 0.78 DLL - register a read function that will return 0 for the unsupported regions
-    RA_InstallMemoryBank(0, memoryRead0, memoryWrite0, g_memoryRegions.total_size);
+    RA_InstallMemoryBank(0, memoryReadN<0>, memoryWriteN<0>, g_memoryRegions.total_size);
     return;
   }
 
   // have an 0.79 DLL - register invalid banks for unsupported regions
   int bankId = 0;
   int validBankId = 0;
-  int firstRegion = 0;
+  unsigned bankStart = 0;
   size_t bankSize = 0;
   bool wasValidRegion = false;
   for (size_t i = 0; i < g_memoryRegions.count; i++)
@@ -398,11 +382,11 @@ void Memory::installMemoryBanks()
     if (bankSize > 0 && isValidRegion != wasValidRegion)
     {
       if (wasValidRegion)
-        installMemoryBank(bankId, validBankId++, firstRegion, bankSize, _logger);
+        installMemoryBank(bankId, validBankId++, bankStart, bankSize, _logger);
       else
         RA_InstallMemoryBank(bankId, NULL, NULL, bankSize);
 
-      firstRegion = i;
+      bankStart += (unsigned)bankSize;
       bankSize = g_memoryRegions.size[i];
       ++bankId;
     }
@@ -417,7 +401,7 @@ void Memory::installMemoryBanks()
   if (bankSize > 0)
   {
     if (wasValidRegion)
-      installMemoryBank(bankId, validBankId, firstRegion, bankSize, _logger);
+      installMemoryBank(bankId, validBankId, bankStart, bankSize, _logger);
     else
       RA_InstallMemoryBank(bankId, NULL, NULL, bankSize);
   }
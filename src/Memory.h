@@ -33,8 +33,21 @@ public:
 
   void attachToCore(libretro::Core* core, int consoleId);
 
+  /* called once per frame to pick up memory map changes made by the core */
+  void update(libretro::Core* core, int consoleId);
+
+  /* copies the exposed memory so achievements are evaluated against a stable view of it */
+  void captureSnapshot();
+  void releaseSnapshot();
+
 protected:
   void installMemoryBanks();
+  void captureCoreState(libretro::Core* core);
 
   libretro::LoggerComponent* _logger;
+
+  /* what the core was exposing the last time the memory map was built */
+  unsigned _memoryMapVersion;
+  void*    _coreMemoryData[4];
+  size_t   _coreMemorySize[4];
 };
@@ -0,0 +1,188 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Measures the memory reads done while achievements are evaluated for a frame, on a SNES-like map
+ * with NULL regions and regions that don't start on a page boundary. The reads are made through
+ * function pointers, like the toolkit calls the memory bank readers, once walking the regions like
+ * the readers did before the page table and once through the page table. Every value read is
+ * checked against the walk.
+ *
+ * usage: MemoryBenchmark [number of frames] [number of reads per frame] */
+
+#include "MemoryPageTable.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define BENCHMARK_BLOCK_SIZE 64
+#define BENCHMARK_BLOCKS_PER_FRAME 64
+
+enum benchmark_mode
+{
+  BENCHMARK_WALK,
+  BENCHMARK_PAGE_TABLE
+};
+
+static const char* benchmark_mode_name(benchmark_mode mode)
+{
+  switch (mode)
+  {
+    case BENCHMARK_WALK: return "walk";
+    default: return "page table";
+  }
+}
+
+static rc_libretro_memory_regions_t s_regions;
+static MemoryPageTable s_pages;
+
+static unsigned char benchmark_read_walk(unsigned addr) { return MemoryPageTable::readSlow(&s_regions, addr); }
+static unsigned char benchmark_read_pages(unsigned addr) { return s_pages.read(addr); }
+static unsigned benchmark_read_block_walk(unsigned addr, uint8_t* buffer, unsigned count) { return MemoryPageTable::readBlockSlow(&s_regions, addr, buffer, count); }
+static unsigned benchmark_read_block_pages(unsigned addr, uint8_t* buffer, unsigned count) { return s_pages.readBlock(addr, buffer, count); }
+
+typedef unsigned char (*benchmark_read_func)(unsigned addr);
+typedef unsigned (*benchmark_read_block_func)(unsigned addr, uint8_t* buffer, unsigned count);
+
+static void benchmark_init_regions(std::vector<uint8_t>& memory)
+{
+  /* WRAM, a hole, SRAM, registers, another hole, VRAM, CGRAM, OAM and extra RAM */
+  static const struct { size_t size; bool valid; } regions[] =
+  {
+    { 0x20000, true }, { 0x8000, false }, { 0x8000, true }, { 0x100, true }, { 0x3F00, false },
+    { 0x10000, true }, { 0x200, true }, { 0x220, true }, { 0x2000, true }
+  };
+
+  size_t total = 0;
+  for (const auto& region : regions)
+    total += region.size;
+
+  memory.resize(total);
+  for (size_t i = 0; i < total; i++)
+    memory[i] = (uint8_t)(rand() & 0xFF);
+
+  memset(&s_regions, 0, sizeof(s_regions));
+  size_t offset = 0;
+  for (const auto& region : regions)
+  {
+    s_regions.data[s_regions.count] = region.valid ? &memory[offset] : NULL;
+    s_regions.size[s_regions.count] = region.size;
+    s_regions.count++;
+    offset += region.size;
+  }
+
+  s_regions.total_size = total;
+}
+
+/* returns the time per frame in microseconds */
+static double benchmark_run(benchmark_mode mode, const std::vector<unsigned>& addresses, unsigned readsPerFrame, int frames, unsigned& checksum)
+{
+  volatile benchmark_read_func read = (mode == BENCHMARK_WALK) ? benchmark_read_walk : benchmark_read_pages;
+  volatile benchmark_read_block_func readBlock = (mode == BENCHMARK_WALK) ? benchmark_read_block_walk : benchmark_read_block_pages;
+  uint8_t block[BENCHMARK_BLOCK_SIZE];
+  unsigned sum = 0;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  for (int frame = 0; frame < frames; frame++)
+  {
+    const unsigned* address = &addresses[(frame * 7919) % (addresses.size() - readsPerFrame - BENCHMARK_BLOCKS_PER_FRAME)];
+
+    for (unsigned i = 0; i < readsPerFrame; i++)
+      sum = sum * 31 + read(address[i]);
+
+    for (unsigned i = 0; i < BENCHMARK_BLOCKS_PER_FRAME; i++)
+    {
+      const unsigned count = readBlock(address[readsPerFrame + i], block, sizeof(block));
+      for (unsigned j = 0; j < count; j++)
+        sum = sum * 31 + block[j];
+    }
+  }
+
+  const auto end = std::chrono::steady_clock::now();
+
+  checksum = sum;
+  return std::chrono::duration<double, std::micro>(end - start).count() / frames;
+}
+
+int main(int argc, char* argv[])
+{
+  int frames = 10000;
+  if (argc > 1)
+    frames = atoi(argv[1]);
+
+  int readsPerFrame = 4000;
+  if (argc > 2)
+    readsPerFrame = atoi(argv[2]);
+
+  if (frames <= 0 || readsPerFrame <= 0)
+  {
+    fprintf(stderr, "usage: %s [number of frames] [number of reads per frame]\n", argv[0]);
+    return 1;
+  }
+
+  srand(1);
+
+  std::vector<uint8_t> memory;
+  benchmark_init_regions(memory);
+  s_pages.build(&s_regions);
+
+  std::vector<unsigned> addresses(readsPerFrame * 4 + BENCHMARK_BLOCKS_PER_FRAME * 4);
+  for (auto& address : addresses)
+    address = (unsigned)(((size_t)rand() * (RAND_MAX + 1u) + rand()) % s_regions.total_size);
+
+  /* the page table must return what the walk returns */
+  uint8_t expected[BENCHMARK_BLOCK_SIZE], actual[BENCHMARK_BLOCK_SIZE];
+  for (const auto address : addresses)
+  {
+    const unsigned expectedCount = MemoryPageTable::readBlockSlow(&s_regions, address, expected, sizeof(expected));
+    const unsigned actualCount = s_pages.readBlock(address, actual, sizeof(actual));
+
+    if (MemoryPageTable::readSlow(&s_regions, address) != s_pages.read(address) ||
+        expectedCount != actualCount || memcmp(expected, actual, expectedCount) != 0)
+    {
+      fprintf(stderr, "page table mismatch at $%06x\n", address);
+      return 1;
+    }
+  }
+
+  printf("%zu bytes in %u regions, %d frames of %d reads and %d %d-byte block reads\n\n",
+    s_regions.total_size, s_regions.count, frames, readsPerFrame, BENCHMARK_BLOCKS_PER_FRAME, BENCHMARK_BLOCK_SIZE);
+  printf("%-12s %12s\n", "mode", "us/frame");
+
+  const benchmark_mode modes[] = { BENCHMARK_WALK, BENCHMARK_PAGE_TABLE };
+  unsigned checksums[2];
+
+  for (int i = 0; i < 2; i++)
+  {
+    const double time = benchmark_run(modes[i], addresses, (unsigned)readsPerFrame, frames, checksums[i]);
+    printf("%-12s %12.2f\n", benchmark_mode_name(modes[i]), time);
+  }
+
+  if (checksums[0] != checksums[1])
+  {
+    fprintf(stderr, "checksum mismatch\n");
+    return 1;
+  }
+
+  s_pages.destroy();
+  return 0;
+}
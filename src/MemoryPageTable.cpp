@@ -0,0 +1,165 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MemoryPageTable.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+uint8_t MemoryPageTable::s_zeroPage[MemoryPageTable::PageSize];
+
+bool MemoryPageTable::build(const rc_libretro_memory_regions_t* regions)
+{
+  _regions = regions;
+
+  const size_t pageCount = (regions->total_size + PageMask) >> PageShift;
+  if (pageCount != _pageCount)
+  {
+    free(_pages);
+    _pages = (uint8_t**)malloc(pageCount * sizeof(uint8_t*));
+
+    /* without a table, every access takes the slow path */
+    _pageCount = (_pages != NULL) ? pageCount : 0;
+  }
+
+  if (_pageCount == 0)
+    return false;
+
+  memset(_pages, 0, _pageCount * sizeof(uint8_t*));
+
+  size_t regionStart = 0;
+  for (unsigned i = 0; i < regions->count; ++i)
+  {
+    const size_t regionEnd = regionStart + regions->size[i];
+    size_t pageStart = (regionStart + PageMask) & ~(size_t)PageMask;
+
+    for (; pageStart + PageSize <= regionEnd; pageStart += PageSize)
+    {
+      uint8_t* data = regions->data[i];
+      _pages[pageStart >> PageShift] = data ? data + (pageStart - regionStart) : s_zeroPage;
+    }
+
+    regionStart = regionEnd;
+  }
+
+  return true;
+}
+
+void MemoryPageTable::destroy()
+{
+  free(_pages);
+  _pages = NULL;
+  _pageCount = 0;
+}
+
+unsigned MemoryPageTable::readBlock(unsigned addr, uint8_t* buffer, unsigned count) const
+{
+  unsigned provided = 0;
+
+  while (count > 0)
+  {
+    const size_t page = addr >> PageShift;
+    const uint8_t* data = (page < _pageCount) ? _pages[page] : NULL;
+    if (data == NULL)
+      return provided + readBlockSlow(_regions, addr, buffer, count);
+
+    if (data == s_zeroPage)
+      break;
+
+    const unsigned offset = addr & PageMask;
+    const unsigned avail = std::min((unsigned)PageSize - offset, count);
+    memcpy(buffer, &data[offset], avail);
+
+    provided += avail;
+    count -= avail;
+    buffer += avail;
+    addr += avail;
+  }
+
+  return provided;
+}
+
+unsigned char MemoryPageTable::readSlow(const rc_libretro_memory_regions_t* regions, unsigned addr)
+{
+  unsigned i;
+  for (i = 0; i < regions->count; ++i)
+  {
+    const size_t size = regions->size[i];
+    if (addr < size)
+    {
+      if (regions->data[i] == NULL)
+        break;
+
+      return regions->data[i][addr];
+    }
+
+    addr -= size;
+  }
+
+  return 0;
+}
+
+unsigned MemoryPageTable::readBlockSlow(const rc_libretro_memory_regions_t* regions, unsigned addr, uint8_t* buffer, unsigned count)
+{
+  unsigned provided = 0;
+  unsigned i;
+  for (i = 0; i < regions->count; ++i)
+  {
+    const size_t size = regions->size[i];
+    if (addr < size)
+    {
+      if (regions->data[i] == NULL)
+        break;
+
+      const size_t avail = std::min(size - addr, (size_t)count);
+      memcpy(buffer, &regions->data[i][addr], avail);
+
+      provided += avail;
+      count -= avail;
+      if (count == 0)
+        break;
+
+      buffer += avail;
+      addr += avail;
+    }
+
+    addr -= size;
+  }
+
+  return provided;
+}
+
+void MemoryPageTable::writeSlow(const rc_libretro_memory_regions_t* regions, unsigned addr, unsigned char value)
+{
+  unsigned i;
+  for (i = 0; i < regions->count; ++i)
+  {
+    const size_t size = regions->size[i];
+    if (addr < size)
+    {
+      if (regions->data[i])
+        regions->data[i][addr] = value;
+
+      break;
+    }
+
+    addr -= size;
+  }
+}
@@ -0,0 +1,93 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <rcheevos/src/rc_libretro.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Flat page table over a set of memory regions so each access is a shift, an index and a load.
+ * Pages that are entirely inside a region point at the region data, pages that are entirely
+ * inside a NULL region point at a shared zero page, and pages that straddle a region boundary
+ * are NULL and use the slow path that walks the regions. */
+class MemoryPageTable
+{
+public:
+  enum
+  {
+    PageShift = 8,
+    PageSize = 1 << PageShift,
+    PageMask = PageSize - 1
+  };
+
+  /* the regions must outlive the table. rebuild it whenever they change */
+  bool build(const rc_libretro_memory_regions_t* regions);
+  void destroy();
+
+  size_t getPageCount() const { return _pageCount; }
+
+  inline unsigned char read(unsigned addr) const
+  {
+    const size_t page = addr >> PageShift;
+    if (page < _pageCount)
+    {
+      const uint8_t* data = _pages[page];
+      if (data)
+        return data[addr & PageMask];
+    }
+
+    return readSlow(_regions, addr);
+  }
+
+  /* stops at the first NULL region */
+  unsigned readBlock(unsigned addr, uint8_t* buffer, unsigned count) const;
+
+  inline void write(unsigned addr, unsigned char value) const
+  {
+    const size_t page = addr >> PageShift;
+    if (page < _pageCount)
+    {
+      uint8_t* data = _pages[page];
+      if (data == s_zeroPage)
+        return;
+
+      if (data)
+      {
+        data[addr & PageMask] = value;
+        return;
+      }
+    }
+
+    writeSlow(_regions, addr, value);
+  }
+
+  /* the accesses without the page table */
+  static unsigned char readSlow(const rc_libretro_memory_regions_t* regions, unsigned addr);
+  static unsigned readBlockSlow(const rc_libretro_memory_regions_t* regions, unsigned addr, uint8_t* buffer, unsigned count);
+  static void writeSlow(const rc_libretro_memory_regions_t* regions, unsigned addr, unsigned char value);
+
+protected:
+  static uint8_t s_zeroPage[PageSize];
+
+  const rc_libretro_memory_regions_t* _regions = NULL;
+  uint8_t** _pages = NULL;
+  size_t _pageCount = 0;
+};
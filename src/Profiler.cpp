@@ -0,0 +1,296 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Profiler.h"
+
+#include "Util.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+#define TAG "[PRF] "
+
+/* frame time histogram */
+#define PROFILER_HISTOGRAM_BUCKETS 20
+#define PROFILER_HISTOGRAM_BUCKET_MS 2
+#define PROFILER_HISTOGRAM_WIDTH 50
+
+Profiler* Profiler::s_active = NULL;
+
+bool Profiler::init(Logger* logger, size_t capacity)
+{
+  _logger = logger;
+
+  size_t size = 1;
+  while (size < capacity)
+    size <<= 1;
+
+  /* the ring is kept when the profiler is stopped, reuse it if it's the right size */
+  if (_slots != NULL && _mask + 1 != size)
+  {
+    delete[] _slots;
+    _slots = NULL;
+  }
+
+  if (_slots == NULL)
+    _slots = new Slot[size];
+
+  for (size_t i = 0; i < size; i++)
+    _slots[i].sequence.store(0, std::memory_order_relaxed);
+
+  _mask = size - 1;
+  _next.store(0, std::memory_order_relaxed);
+  _start = Clock::now();
+
+  for (auto& total : _frameTotals)
+    total.store(0, std::memory_order_relaxed);
+
+  memset(&_lastFrame, 0, sizeof(_lastFrame));
+  _lastFrameStart = 0;
+  _numFrames = 0;
+
+  _running.store(true, std::memory_order_release);
+  s_active = this;
+
+  _logger->info(TAG "Profiling frames, keeping the last %zu samples", size);
+  return true;
+}
+
+void Profiler::destroy()
+{
+  stop();
+
+  delete[] _slots;
+  _slots = NULL;
+  _mask = 0;
+}
+
+void Profiler::stop()
+{
+  if (s_active == this)
+    s_active = NULL;
+
+  _running.store(false, std::memory_order_release);
+}
+
+const char* Profiler::getPhaseName(Phase phase)
+{
+  switch (phase)
+  {
+    case Phase::Frame:             return "frame";
+    case Phase::ProcessEvents:     return "processEvents";
+    case Phase::CoreStep:          return "Core::step";
+    case Phase::CoreRun:           return "retro_run";
+    case Phase::VideoRefresh:      return "video refresh";
+    case Phase::AudioMix:          return "audio mix";
+    case Phase::AchievementsFrame: return "RA_DoAchievementsFrame";
+    case Phase::VideoDraw:         return "Video::draw";
+    case Phase::SwapBuffers:       return "swapBuffers";
+    case Phase::SaveSRAM:          return "periodicSaveSRAM";
+    default:                       return "unknown";
+  }
+}
+
+uint32_t Profiler::getThreadIndex()
+{
+  static std::atomic<uint32_t> s_numThreads{0};
+  static thread_local uint32_t s_threadIndex = ++s_numThreads;
+  return s_threadIndex;
+}
+
+void Profiler::record(Phase phase, Clock::time_point start, Clock::time_point end)
+{
+  /* a scope opened before the profiler was stopped */
+  if (!_running.load(std::memory_order_acquire))
+    return;
+
+  const uint64_t index = _next.fetch_add(1, std::memory_order_relaxed);
+  Slot* slot = &_slots[index & _mask];
+
+  /* readers skip the slot until the new sample is complete */
+  slot->sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot->data.start = std::chrono::duration_cast<std::chrono::nanoseconds>(start - _start).count();
+  slot->data.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+  slot->data.thread = getThreadIndex();
+  slot->data.phase = phase;
+
+  slot->sequence.store(index + 1, std::memory_order_release);
+
+  if (phase != Phase::Frame)
+  {
+    _frameTotals[(size_t)phase].fetch_add(slot->data.duration, std::memory_order_relaxed);
+  }
+  else
+  {
+    for (size_t i = 0; i < (size_t)Phase::Count; i++)
+      _lastFrame.phases[i] = _frameTotals[i].exchange(0, std::memory_order_relaxed);
+
+    _lastFrame.phases[(size_t)Phase::Frame] = _numFrames != 0 ? slot->data.start - _lastFrameStart : slot->data.duration;
+    _lastFrameStart = slot->data.start;
+    _numFrames++;
+  }
+}
+
+bool Profiler::getLastFrame(FrameStats& stats) const
+{
+  if (_numFrames == 0)
+    return false;
+
+  stats = _lastFrame;
+  return true;
+}
+
+void Profiler::snapshot(std::vector<Sample>& samples) const
+{
+  samples.clear();
+
+  if (_slots == NULL)
+    return;
+
+  const uint64_t next = _next.load(std::memory_order_acquire);
+  const uint64_t first = next > _mask + 1 ? next - (_mask + 1) : 0;
+  samples.reserve((size_t)(next - first));
+
+  for (uint64_t index = first; index < next; index++)
+  {
+    const Slot* slot = &_slots[index & _mask];
+
+    if (slot->sequence.load(std::memory_order_acquire) != index + 1)
+      continue;
+
+    const Sample sample = slot->data;
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    /* discard samples overwritten while they were copied */
+    if (slot->sequence.load(std::memory_order_relaxed) == index + 1)
+      samples.push_back(sample);
+  }
+}
+
+bool Profiler::writeTrace(const std::string& path) const
+{
+  std::vector<Sample> samples;
+  snapshot(samples);
+
+  std::string json("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  json.append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"main\"}}");
+
+  char event[256];
+
+  for (const auto& sample : samples)
+  {
+    /* complete events, timestamps in microseconds */
+    snprintf(event, sizeof(event), ",\n{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+      getPhaseName(sample.phase), sample.thread, sample.start / 1000.0, sample.duration / 1000.0);
+
+    json.append(event);
+  }
+
+  json.append("\n]}\n");
+
+  if (!util::saveFile(_logger, path, json.c_str(), json.length()))
+    return false;
+
+  _logger->info(TAG "Wrote %zu samples to %s", samples.size(), path.c_str());
+  return true;
+}
+
+void Profiler::logSummary() const
+{
+  std::vector<Sample> samples;
+  snapshot(samples);
+
+  if (samples.empty())
+    return;
+
+  const size_t numPhases = (size_t)Phase::Count;
+  std::vector<uint64_t> durations[(size_t)Phase::Count];
+
+  for (const auto& sample : samples)
+    durations[(size_t)sample.phase].push_back(sample.duration);
+
+  _logger->info(TAG "%-24s %8s %9s %9s %9s %9s %9s", "phase (ms)", "count", "mean", "p50", "p95", "p99", "max");
+
+  for (size_t i = 0; i < numPhases; i++)
+  {
+    auto& phase = durations[i];
+    if (phase.empty())
+      continue;
+
+    std::sort(phase.begin(), phase.end());
+
+    uint64_t total = 0;
+    for (const auto duration : phase)
+      total += duration;
+
+    const size_t count = phase.size();
+    _logger->info(TAG "%-24s %8zu %9.3f %9.3f %9.3f %9.3f %9.3f", getPhaseName((Phase)i), count,
+      total / 1e6 / count, phase[count / 2] / 1e6, phase[count * 95 / 100] / 1e6,
+      phase[count * 99 / 100] / 1e6, phase[count - 1] / 1e6);
+  }
+
+  /* the time between the start of consecutive frames includes the time spent waiting for vsync or
+   * the audio device, while the frame phase itself only includes the work done */
+  std::vector<uint64_t> frameStarts;
+  for (const auto& sample : samples)
+  {
+    if (sample.phase == Phase::Frame)
+      frameStarts.push_back(sample.start);
+  }
+
+  if (frameStarts.size() < 2)
+    return;
+
+  std::sort(frameStarts.begin(), frameStarts.end());
+
+  unsigned buckets[PROFILER_HISTOGRAM_BUCKETS];
+  memset(buckets, 0, sizeof(buckets));
+  unsigned maxBucket = 0;
+
+  for (size_t i = 1; i < frameStarts.size(); i++)
+  {
+    size_t bucket = (size_t)((frameStarts[i] - frameStarts[i - 1]) / (PROFILER_HISTOGRAM_BUCKET_MS * 1000000));
+    if (bucket >= PROFILER_HISTOGRAM_BUCKETS)
+      bucket = PROFILER_HISTOGRAM_BUCKETS - 1;
+
+    if (++buckets[bucket] > maxBucket)
+      maxBucket = buckets[bucket];
+  }
+
+  _logger->info(TAG "frame interval histogram");
+
+  char bar[PROFILER_HISTOGRAM_WIDTH + 1];
+  for (unsigned i = 0; i < PROFILER_HISTOGRAM_BUCKETS; i++)
+  {
+    if (buckets[i] == 0)
+      continue;
+
+    const unsigned width = (unsigned)(((uint64_t)buckets[i] * PROFILER_HISTOGRAM_WIDTH + maxBucket - 1) / maxBucket);
+    memset(bar, '#', width);
+    bar[width] = '\0';
+
+    if (i == PROFILER_HISTOGRAM_BUCKETS - 1)
+      _logger->info(TAG "  >= %2u ms %8u %s", i * PROFILER_HISTOGRAM_BUCKET_MS, buckets[i], bar);
+    else
+      _logger->info(TAG "  %2u-%2u ms %8u %s", i * PROFILER_HISTOGRAM_BUCKET_MS, (i + 1) * PROFILER_HISTOGRAM_BUCKET_MS, buckets[i], bar);
+  }
+}
@@ -0,0 +1,147 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "components/Logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/* Records how long each phase of a frame takes. Phases are timed with PROFILE_PHASE, which costs a
+ * single test when the profiler isn't running. Samples go into a fixed size ring that any thread can
+ * write to without locking, the oldest samples are overwritten when it's full. The samples can be
+ * exported in the Chrome trace_event format (chrome://tracing, https://ui.perfetto.dev) or
+ * summarized in the log. */
+class Profiler
+{
+public:
+  enum class Phase : uint8_t
+  {
+    Frame,
+    ProcessEvents,
+    CoreStep,
+    CoreRun,
+    VideoRefresh,
+    AudioMix,
+    AchievementsFrame,
+    VideoDraw,
+    SwapBuffers,
+    SaveSRAM,
+
+    Count
+  };
+
+  typedef std::chrono::steady_clock Clock;
+
+  /* time spent in each phase during a frame, in nanoseconds. the time of the frame phase is the
+   * interval between the start of the frame and the start of the previous one */
+  struct FrameStats
+  {
+    uint64_t phases[(size_t)Phase::Count];
+  };
+
+  /* capacity is the number of samples kept, rounded up to a power of two. can be called again after
+   * stop to start over */
+  bool init(Logger* logger, size_t capacity = 65536);
+  void destroy();
+
+  /* stops recording but keeps the ring, so scopes that are still open when the profiler is stopped
+   * (i.e. it's stopped from inside a frame) can finish safely. the samples can still be exported */
+  void stop();
+
+  bool writeTrace(const std::string& path) const;
+  void logSummary() const;
+
+  /* returns false if no frame was completed yet. only meaningful on the thread that runs the frames */
+  bool getLastFrame(FrameStats& stats) const;
+
+  static const char* getPhaseName(Phase phase);
+
+  /* the running profiler, or NULL */
+  static Profiler* active() { return s_active; }
+
+  class Scope
+  {
+  public:
+    explicit Scope(Phase phase) : _profiler(s_active), _phase(phase)
+    {
+      if (_profiler)
+        _start = Clock::now();
+    }
+
+    ~Scope()
+    {
+      if (_profiler)
+        _profiler->record(_phase, _start, Clock::now());
+    }
+
+  protected:
+    Profiler* _profiler;
+    Phase _phase;
+    Clock::time_point _start;
+  };
+
+  void record(Phase phase, Clock::time_point start, Clock::time_point end);
+
+protected:
+  struct Sample
+  {
+    uint64_t start;    /* nanoseconds since init */
+    uint64_t duration; /* nanoseconds */
+    uint32_t thread;
+    Phase    phase;
+  };
+
+  struct Slot
+  {
+    std::atomic<uint64_t> sequence; /* index + 1 of the sample in data, 0 while it's being written */
+    Sample data;
+  };
+
+  /* copies the samples still in the ring, oldest first */
+  void snapshot(std::vector<Sample>& samples) const;
+
+  static uint32_t getThreadIndex();
+
+  static Profiler* s_active;
+
+  Logger* _logger = NULL;
+  Clock::time_point _start;
+
+  Slot* _slots = NULL;
+  size_t _mask = 0;
+  std::atomic<uint64_t> _next{0};
+  std::atomic<bool> _running{false};
+
+  /* phases recorded since the current frame started */
+  std::atomic<uint64_t> _frameTotals[(size_t)Phase::Count];
+  FrameStats _lastFrame;
+  uint64_t _lastFrameStart = 0;
+  uint64_t _numFrames = 0;
+};
+
+#define PROFILE_CONCAT2(a, b) a ## b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+
+/* times the rest of the enclosing block */
+#define PROFILE_PHASE(phase) Profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(Profiler::Phase::phase)
@@ -2,13 +2,21 @@
 //
 
 #include "Git.h"
+#include "HashCache.h"
 #include "Util.h"
+#include "ZipIndex.h"
 
 #include <rcheevos/include/rc_hash.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <stdio.h>
 #include <string.h>
+#include <thread>
+#include <vector>
 
 #ifdef _WIN32
  #define WIN32_LEAN_AND_MEAN
@@ -23,19 +31,27 @@
 #endif
 
 #ifdef HAVE_CHD
-void rc_hash_init_chd_cdreader(); /* in HashCHD.cpp */
+void rc_hash_get_chd_cdreader(struct rc_hash_cdreader* cdreader); /* in HashCHD.cpp */
 #endif
 
 void   initHash3DS(const std::string& systemDir); /* in Hash3DS.cpp */
+void   rc_hash_get_mapped_filereader(struct rc_hash_filereader* filereader, Logger* logger); /* in HashFileReader.cpp */
+void   rc_hash_get_zip_filereader(struct rc_hash_filereader* filereader); /* in HashFileReader.cpp */
+void   rc_hash_track_opened_files(std::vector<std::string>* files); /* in HashFileReader.cpp */
 
 static void usage(const char* appname)
 {
   printf("RAHasher %s\n====================\n", git::getReleaseVersion());
 
-  printf("Usage: %s [-v] [-s systempath] systemid filepath\n", util::fileName(appname).c_str());
+  printf("Usage: %s [-v] [-s systempath] [-j threads] [-c cachefile [-r|-k]] [-z] systemid filepath\n", util::fileName(appname).c_str());
   printf("\n");
   printf("  -v             (optional) enables verbose messages for debugging\n");
   printf("  -s systempath  (optional) specifies where supplementary files are stored (typically a path to RetroArch/system)\n");
+  printf("  -j threads     (optional) number of files to hash at the same time when processing multiple files\n");
+  printf("  -c cachefile   (optional) remembers hashes in cachefile so unchanged files don't have to be hashed again\n");
+  printf("  -r             (optional) ignores the cached hashes and hashes every file again, updating the cache\n");
+  printf("  -k             (optional) hashes every file again and reports any that don't match the cache\n");
+  printf("  -z             (optional) hashes each file in zip files instead of picking one\n");
   printf("  systemid       specifies the system id associated to the game (which hash algorithm to use)\n");
   printf("  filepath       specifies the path to the game file (file may include wildcards, path may not)\n");
 }
@@ -61,8 +77,7 @@ public:
       --length;
     }
 
-    ::fwrite(line, length, 1, stderr);
-    ::fprintf(stderr, "\n");
+    ::fprintf(stderr, "%.*s\n", (int)length, line);
   }
 };
 
@@ -78,98 +93,276 @@ void rhash_log_error_message(const char* message)
   fprintf(stderr, "%s\n", message);
 }
 
-static void* rhash_file_open(const char* path)
+#define RC_CONSOLE_MAX 90
+
+static bool is_zip(const std::string& file)
 {
-  return util::openFile(logger.get(), path, "rb");
+  const std::string ext = util::extension(file);
+  return (ext.length() == 4 && tolower(ext[1]) == 'z' && tolower(ext[2]) == 'i' && tolower(ext[3]) == 'p');
 }
 
-#define RC_CONSOLE_MAX 90
-
-static int process_file(int consoleId, const std::string& file)
+static int hash_file(int consoleId, const std::string& file, std::string& output)
 {
   char hash[33];
   int count = 0;
 
   std::string filePath = util::fullPath(file);
   std::string ext = util::extension(file);
+  std::string zipPath, zippedFile;
 
-  if (consoleId != RC_CONSOLE_ARCADE && consoleId <= RC_CONSOLE_MAX && ext.length() == 4 &&
-      tolower(ext[1]) == 'z' && tolower(ext[2]) == 'i' && tolower(ext[3]) == 'p')
+  if (consoleId != RC_CONSOLE_ARCADE && consoleId <= RC_CONSOLE_MAX && is_zip(file))
   {
-    std::string unzippedFilename;
     size_t size;
-    void* data = util::loadZippedFile(logger.get(), filePath, &size, unzippedFilename);
-    if (data)
+    if (!util::findZippedFile(logger.get(), filePath, &size, zippedFile))
+      return 0;
+
+    if (zippedFile.empty())
     {
-      if (rc_hash_generate_from_buffer(hash, consoleId, (uint8_t*)data, size))
+      /* can't tell which file to hash, hash the whole zip */
+      void* data = util::loadFile(logger.get(), filePath, &size);
+      if (data)
       {
-        printf("%s", hash);
-        count = 1;
+        if (rc_hash_generate_from_buffer(hash, consoleId, (uint8_t*)data, size))
+        {
+          output += hash;
+          count = 1;
+        }
+
+        free(data);
       }
 
-      free(data);
+      return count;
     }
+
+    zipPath = filePath;
   }
   else
   {
-    /* register a custom file_open handler for unicode support. use the default implementation for the other methods */
-    struct rc_hash_filereader filereader;
-    memset(&filereader, 0, sizeof(filereader));
-    filereader.open = rhash_file_open;
-    rc_hash_init_custom_filereader(&filereader);
+    /* a file in a zip that was listed with -z */
+    ZipIndex::splitPath(file, zipPath, zippedFile);
+  }
+
+  if (!zippedFile.empty())
+  {
+    /* decompress the file as it's hashed instead of extracting it into memory first */
+    const std::string zipPseudoPath = zipPath + '#' + zippedFile;
+    rc_hash_iterator_t iterator;
+    rc_hash_initialize_iterator(&iterator, zipPseudoPath.c_str(), NULL, 0);
+    rc_hash_get_zip_filereader(&iterator.callbacks.filereader);
+    rc_hash_get_default_cdreader(&iterator.callbacks.cdreader);
+
+    if (rc_hash_generate(hash, consoleId, &iterator))
+    {
+      output += hash;
+      count = 1;
+    }
 
+    rc_hash_destroy_iterator(&iterator);
+  }
+  else
+  {
+    rc_hash_iterator_t iterator;
+    rc_hash_initialize_iterator(&iterator, filePath.c_str(), NULL, 0);
+
+    /* the cd reader is set on the iterator rather than globally so files can be hashed on several threads */
     if (ext.length() == 4 && tolower(ext[1]) == 'c' && tolower(ext[2]) == 'h' && tolower(ext[3]) == 'd')
     {
 #ifdef HAVE_CHD
-      rc_hash_init_chd_cdreader();
+      rc_hash_get_chd_cdreader(&iterator.callbacks.cdreader);
 #else
-      printf("CHD not supported without HAVE_CHD compile flag");
+      output += "CHD not supported without HAVE_CHD compile flag";
+      rc_hash_destroy_iterator(&iterator);
       return 0;
 #endif
     }
     else
     {
-      rc_hash_init_default_cdreader();
+      rc_hash_get_default_cdreader(&iterator.callbacks.cdreader);
     }
 
     if (consoleId > RC_CONSOLE_MAX)
     {
-      rc_hash_iterator iterator;
-      rc_hash_initialize_iterator(&iterator, filePath.c_str(), NULL, 0);
       while (rc_hash_iterate(hash, &iterator))
       {
-        printf("%s", hash);
+        output += hash;
         count++;
       }
-      rc_hash_destroy_iterator(&iterator);
     }
     else
     {
-      if (rc_hash_generate_from_file(hash, consoleId, filePath.c_str()))
+      if (rc_hash_generate(hash, consoleId, &iterator))
       {
-        printf("%s", hash);
+        output += hash;
         count++;
       }
     }
+
+    rc_hash_destroy_iterator(&iterator);
   }
 
   return count;
 }
 
-static int process_iterated_file(int console_id, const std::string& file)
+enum hash_cache_mode
+{
+  HASH_CACHE_NONE,
+  HASH_CACHE_USE,
+  HASH_CACHE_REFRESH,
+  HASH_CACHE_VERIFY
+};
+
+static HashCache hashCache;
+static hash_cache_mode hashCacheMode = HASH_CACHE_NONE;
+
+static int process_file(int consoleId, const std::string& file, std::string& output)
 {
-  int result = process_file(console_id, file);
-  if (!result)
+  /* the hashes generated when iterating over the possible consoles aren't cached */
+  if (hashCacheMode == HASH_CACHE_NONE || consoleId > RC_CONSOLE_MAX)
+    return hash_file(consoleId, file, output);
+
+  const std::string filePath = util::fullPath(file);
+  char cachedHash[33];
+  const bool cached = (hashCacheMode != HASH_CACHE_REFRESH && hashCache.lookup(filePath, std::string(), consoleId, NULL, 0, cachedHash));
+
+  if (cached && hashCacheMode == HASH_CACHE_USE)
+  {
+    output += cachedHash;
+    return 1;
+  }
+
+  std::string hash;
+  std::vector<std::string> files;
+  rc_hash_track_opened_files(&files);
+  const int count = hash_file(consoleId, file, hash);
+  rc_hash_track_opened_files(NULL);
+  if (count)
+  {
+    if (cached && hash != cachedHash)
+      fprintf(stderr, "Cached hash %s does not match %s for %s\n", cachedHash, hash.c_str(), filePath.c_str());
+
+    hashCache.store(filePath, std::string(), consoleId, NULL, 0, files, hash.c_str());
+  }
+
+  output += hash;
+  return count;
+}
+
+struct hash_job
+{
+  std::string file;
+  std::string output;
+  int count;
+  bool done;
+};
+
+static bool listZippedFiles = false;
+
+static void add_job(std::vector<hash_job>& jobs, const std::string& file)
+{
+  hash_job job;
+  job.count = 0;
+  job.done = false;
+
+  /* with -z, each file in a zip is its own job so they're decompressed and hashed on separate threads */
+  if (listZippedFiles && is_zip(file))
+  {
+    const std::string zipPath = util::fullPath(file);
+    std::shared_ptr<const ZipIndex> index = ZipIndex::get(logger.get(), zipPath);
+    if (index && !index->getEntries().empty())
+    {
+      for (const auto& entry : index->getEntries())
+      {
+        job.file = zipPath + '#' + entry.name;
+        jobs.push_back(job);
+      }
+
+      return;
+    }
+  }
+
+  job.file = file;
+  jobs.push_back(job);
+}
+
+static void print_job(const hash_job& job, bool iterated)
+{
+  printf("%s", job.output.c_str());
+  if (!job.count && iterated)
     printf("????????????????????????????????");
 
-  printf(" %s\n", util::fileNameWithExtension(file).c_str());
-  return result;
+  printf(" %s\n", util::fileNameWithExtension(job.file).c_str());
 }
 
-static int process_files(int consoleId, const std::string& pattern)
+/* hashes the jobs on numThreads workers and prints the results in input order. workers take the
+ * next job from a shared counter, so a worker busy with a large disc image doesn't hold up the
+ * cartridges queued behind it. if stopOnFailure is set, nothing after the first failure is printed */
+static int process_jobs(int consoleId, std::vector<hash_job>& jobs, int numThreads, bool stopOnFailure, bool iterated)
 {
+  std::mutex mutex;
+  std::condition_variable jobDone;
+  std::atomic<size_t> nextJob(0);
+  std::atomic<bool> cancelled(false);
+
+  auto worker = [&]()
+  {
+    size_t index;
+    while (!cancelled && (index = nextJob++) < jobs.size())
+    {
+      std::string output;
+      const int count = process_file(consoleId, jobs[index].file, output);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs[index].output.swap(output);
+        jobs[index].count = count;
+        jobs[index].done = true;
+      }
+
+      jobDone.notify_one();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  if (numThreads > 1 && jobs.size() > 1)
+  {
+    const size_t count = std::min((size_t)numThreads, jobs.size());
+    for (size_t i = 0; i < count; ++i)
+      threads.emplace_back(worker);
+  }
+
   int count = 0;
+  for (size_t i = 0; i < jobs.size(); ++i)
+  {
+    hash_job& job = jobs[i];
+
+    if (threads.empty())
+    {
+      job.count = process_file(consoleId, job.file, job.output);
+    }
+    else
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      jobDone.wait(lock, [&job]() { return job.done; });
+    }
+
+    print_job(job, iterated);
+    count += job.count;
+
+    if (!job.count && stopOnFailure)
+    {
+      cancelled = true;
+      break;
+    }
+  }
+
+  for (auto& thread : threads)
+    thread.join();
 
+  return count;
+}
+
+static void collect_files(const std::string& pattern, std::vector<hash_job>& jobs)
+{
 #ifdef _WIN32
   std::string path = util::directory(pattern);
   WIN32_FIND_DATAA fileData;
@@ -184,10 +377,7 @@ static int process_files(int consoleId, const std::string& pattern)
     do
     {
       if (!(fileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
-      {
-        const std::string filePath = path + "\\" + fileData.cFileName;
-        count += process_iterated_file(consoleId, filePath);
-      }
+        add_job(jobs, path + "\\" + fileData.cFileName);
     } while (FindNextFileA(hFind, &fileData));
 
     FindClose(hFind);
@@ -203,7 +393,7 @@ static int process_files(int consoleId, const std::string& pattern)
     for (i = 0; i < globResult.gl_pathc; ++i)
     {
       if (stat(globResult.gl_pathv[i], &filebuf) == 0 && !S_ISDIR(filebuf.st_mode))
-        count += process_iterated_file(consoleId, globResult.gl_pathv[i]);
+        add_job(jobs, globResult.gl_pathv[i]);
     }
   }
 
@@ -228,26 +418,38 @@ static int process_files(int consoleId, const std::string& pattern)
       if (fnmatch(filePattern.c_str(), dp->d_name, 0) == 0)
       {
         if (stat(dp->d_name, &filebuf) == 0 && !S_ISDIR(filebuf.st_mode))
-        {
-          const std::string filePath = path + "/" + dp->d_name;
-          count += process_iterated_file(consoleId, filePath);
-        }
+          add_job(jobs, path + "/" + dp->d_name);
       }
     }
   }
 #endif
+}
+
+static int process_files(int consoleId, const std::string& pattern, int numThreads)
+{
+  std::vector<hash_job> jobs;
+  collect_files(pattern, jobs);
 
+  const int count = process_jobs(consoleId, jobs, numThreads, false, true);
   if (count == 0)
     printf("No matches found\n");
 
   return count;
 }
 
+static bool is_pattern(const std::string& file)
+{
+  return (file.find('*') != std::string::npos || file.find('?') != std::string::npos);
+}
+
 int main(int argc, char* argv[])
 {
   int consoleId = 0;
   int singleFile = 1;
+  int numThreads = 1;
   std::string systemDirectory = ".";
+  std::string cacheFile;
+  hash_cache_mode cacheMode = HASH_CACHE_USE;
 
   int argi = 1;
 
@@ -263,6 +465,33 @@ int main(int argc, char* argv[])
       systemDirectory = argv[++argi];
       ++argi;
     }
+    else if (strcmp(argv[argi], "-j") == 0 && argi + 1 < argc)
+    {
+      numThreads = atoi(argv[++argi]);
+      if (numThreads < 1)
+        numThreads = 1;
+      ++argi;
+    }
+    else if (strcmp(argv[argi], "-c") == 0 && argi + 1 < argc)
+    {
+      cacheFile = argv[++argi];
+      ++argi;
+    }
+    else if (strcmp(argv[argi], "-r") == 0)
+    {
+      cacheMode = HASH_CACHE_REFRESH;
+      ++argi;
+    }
+    else if (strcmp(argv[argi], "-k") == 0)
+    {
+      cacheMode = HASH_CACHE_VERIFY;
+      ++argi;
+    }
+    else if (strcmp(argv[argi], "-z") == 0)
+    {
+      listZippedFiles = true;
+      ++argi;
+    }
     else
     {
       usage(argv[0]);
@@ -289,6 +518,18 @@ int main(int argc, char* argv[])
   if (consoleId == RC_CONSOLE_NINTENDO_3DS)
     initHash3DS(systemDirectory);
 
+  /* arcade hashes are generated from the name of the zip, not its contents */
+  if (consoleId == RC_CONSOLE_ARCADE)
+    listZippedFiles = false;
+
+  if (!cacheFile.empty() && hashCache.init(logger.get(), cacheFile))
+    hashCacheMode = cacheMode;
+
+  /* read files through memory mapped views. this also handles unicode paths */
+  struct rc_hash_filereader filereader;
+  rc_hash_get_mapped_filereader(&filereader, logger.get());
+  rc_hash_init_custom_filereader(&filereader);
+
   if (argi + 1 < argc)
   {
     if (consoleId > RC_CONSOLE_MAX)
@@ -302,7 +543,7 @@ int main(int argc, char* argv[])
   else
   {
     std::string file = argv[argi];
-    if (file.find('*') != std::string::npos || file.find('?') != std::string::npos)
+    if (is_pattern(file))
     {
       if (consoleId > RC_CONSOLE_MAX)
       {
@@ -310,35 +551,53 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
       }
 
+      singleFile = 0;
+    }
+    else if (listZippedFiles && is_zip(file))
+    {
+      if (consoleId > RC_CONSOLE_MAX)
+      {
+        printf("Specific console must be specified when hashing each file in a zip\n");
+        return EXIT_FAILURE;
+      }
+
       singleFile = 0;
     }
   }
 
-  if (!singleFile)
+  if (singleFile)
   {
-    /* verbose logging not allowed when processing multiple files */
-    rc_hash_init_verbose_message_callback(NULL);
+    std::string output;
+    int result = process_file(consoleId, argv[argi], output);
+    printf("%s\n", output.c_str());
+
+    return result ? EXIT_SUCCESS : EXIT_FAILURE;
   }
 
+  /* verbose logging not allowed when processing multiple files */
+  rc_hash_init_verbose_message_callback(NULL);
+
+  /* consecutive files are hashed as one batch so they can be spread across the threads */
+  std::vector<hash_job> jobs;
   while (argi < argc)
   {
     std::string file = argv[argi++];
 
-    if (file.find('*') != std::string::npos || file.find('?') != std::string::npos)
+    if (!is_pattern(file))
+      add_job(jobs, file);
+
+    if (!jobs.empty() && (argi == argc || is_pattern(file)))
     {
-      if (!process_files(consoleId, file))
+      const size_t numJobs = jobs.size();
+      if (process_jobs(consoleId, jobs, numThreads, true, false) != (int)numJobs)
         return EXIT_FAILURE;
-    }
-    else
-    {
-      int result = process_file(consoleId, file);
 
-      if (singleFile)
-	printf("\n");
-      else
-        printf(" %s\n", util::fileNameWithExtension(file).c_str());
+      jobs.clear();
+    }
 
-      if (!result)
+    if (is_pattern(file))
+    {
+      if (!process_files(consoleId, file, numThreads))
         return EXIT_FAILURE;
     }
   }
@@ -43,7 +43,9 @@ along with RALibRetro.  If not, see <http://www.gnu.org/licenses/>.
 #define TAG "[SAV] "
 
 #define RASTATE_VERSION 1
+#define RASTATE_CHUNKED_VERSION 2
 #define RASTATE_MEM_BLOCK "MEM "
+#define RASTATE_CHUNKS_BLOCK "CHNK"
 #define RASTATE_CHEEVOS_BLOCK "ACHV"
 #define RASTATE_SCREEN_BLOCK "SCRN"
 #define RASTATE_END_BLOCK "END "
@@ -57,16 +59,27 @@ bool States::init(Logger* logger, Config* config, Video* video)
   _video = video;
   _core = NULL;
   _lastSave = 0;
+  _slotsIndexed = false;
 
-  return true;
+  return _chunks.init(logger);
+}
+
+void States::destroy()
+{
+  closeChunkStore();
 }
 
 void States::setGame(const std::string& gameFileName, int system, const std::string& coreName, libretro::Core* core)
 {
+  closeChunkStore();
+
   _gameFileName = gameFileName;
   _system = system;
   _coreName = coreName;
   _core = core;
+  _slotsIndexed = false;
+
+  openChunkStore();
 
   _config->setSaveDirectory(buildPath(_sramPath));
 
@@ -127,7 +140,7 @@ std::string States::getStatePath(unsigned ndx) const
   return getStatePath(ndx, _statePath, false);
 }
 
-std::string States::getStatePath(unsigned ndx, Path path, bool bOldFormat) const
+std::string States::getStateBasePath(Path path) const
 {
   std::string statePath = buildPath(path);
 
@@ -142,6 +155,49 @@ std::string States::getStatePath(unsigned ndx, Path path, bool bOldFormat) const
     statePath += _coreName;
   }
 
+  return statePath;
+}
+
+std::string States::getChunkStorePath() const
+{
+  return getStateBasePath(_chunksPath) + ".chunks";
+}
+
+void States::setStatePath(Path path)
+{
+  if (path == _statePath)
+    return;
+
+  /* the slots in the old path still reference the open store, collect it with them before switching */
+  closeChunkStore();
+
+  _statePath = path;
+  _slotsIndexed = false;
+
+  openChunkStore();
+}
+
+void States::openChunkStore()
+{
+  _chunksPath = _statePath;
+
+  if (!_gameFileName.empty())
+    _chunks.setDirectory(getChunkStorePath());
+}
+
+void States::closeChunkStore()
+{
+  /* only bother cleaning up the chunk store if something was written to it or a slot was replaced */
+  if ((_chunks.isDirty() || _collectChunks) && !_gameFileName.empty())
+    collectChunks();
+
+  _collectChunks = false;
+}
+
+std::string States::getStatePath(unsigned ndx, Path path, bool bOldFormat) const
+{
+  std::string statePath = getStateBasePath(path);
+
   if (bOldFormat)
   {
     char index[8];
@@ -173,9 +229,21 @@ static void writeBlockHeader(uint8_t* output, const char* header, size_t size)
 }
 
 bool States::saveState(const std::string& path)
+{
+  /* the path may be one of the numbered slots */
+  _slotsIndexed = false;
+
+  return saveState(path, false);
+}
+
+bool States::saveState(const std::string& path, bool numbered)
 {
   _logger->info(TAG "Saving state to %s", path.c_str());
 
+  /* the state being replaced may have been the last reference to some chunks */
+  if (util::exists(path))
+    _collectChunks = true;
+
   util::ensureDirectoryExists(util::directory(path));
 
   /* make sure the core supports save states */
@@ -199,11 +267,40 @@ bool States::saveState(const std::string& path)
     free((void*)rawFramebuffer);
   }
 
+  /* numbered slots can keep the core data in the chunk store and only write the manifest */
+  std::vector<uint8_t> manifest;
+  const bool chunked = (numbered && _dedupStates);
+  if (chunked)
+  {
+    void* coreData = malloc(coreSize);
+    if (coreData == NULL)
+    {
+      _logger->error(TAG "Out of memory allocating %lu bytes for the game state", coreSize);
+    }
+    else
+    {
+      if (!_core->serialize(coreData, coreSize))
+        _logger->error(TAG "Core serialize failed");
+      else if (!_chunks.store(coreData, coreSize, manifest))
+        manifest.clear();
+
+      free(coreData);
+    }
+
+    if (manifest.empty())
+    {
+      if (pngData)
+        free((void*)pngData);
+
+      return false;
+    }
+  }
+
   /* determine how much space is needed for achievement data */
   const size_t rapSize = RA_CaptureState(NULL, 0);
 
   /* 8-byte identifier, 8-byte block header, content, 8-byte terminator */
-  size_t totalSize = 8 + 8 + alignSize(coreSize) + 8;
+  size_t totalSize = 8 + 8 + alignSize(chunked ? manifest.size() : coreSize) + 8;
 
   if (rapSize > 0)
     totalSize += 8 + alignSize(rapSize); /* 8-byte header + content */
@@ -221,20 +318,33 @@ bool States::saveState(const std::string& path)
   {
     uint8_t* output = (uint8_t*)data;
     memcpy(output, "RASTATE", 7);
-    output[7] = RASTATE_VERSION;
+    output[7] = chunked ? RASTATE_CHUNKED_VERSION : RASTATE_VERSION;
     output += 8;
 
-    writeBlockHeader(output, RASTATE_MEM_BLOCK, coreSize);
-    output += 8;
-
-    if (!_core->serialize(output, coreSize))
+    bool serialized;
+    if (chunked)
     {
-      _logger->error(TAG "Core serialize failed");
+      writeBlockHeader(output, RASTATE_CHUNKS_BLOCK, manifest.size());
+      output += 8;
+
+      memcpy(output, manifest.data(), manifest.size());
+      output += alignSize(manifest.size());
+      serialized = true;
     }
     else
     {
-      output += alignSize(coreSize);
+      writeBlockHeader(output, RASTATE_MEM_BLOCK, coreSize);
+      output += 8;
 
+      serialized = _core->serialize(output, coreSize);
+      if (!serialized)
+        _logger->error(TAG "Core serialize failed");
+      else
+        output += alignSize(coreSize);
+    }
+
+    if (serialized)
+    {
       if (rapSize > 0)
       {
         writeBlockHeader(output, RASTATE_CHEEVOS_BLOCK, rapSize);
@@ -274,7 +384,7 @@ bool States::saveState(const std::string& path)
 bool States::saveState(unsigned ndx)
 {
   std::string path = getStatePath(ndx, _statePath, false);
-  if (!saveState(path))
+  if (!saveState(path, true))
     return false;
 
   path = getStatePath(ndx, _statePath, true);
@@ -285,6 +395,13 @@ bool States::saveState(unsigned ndx)
     util::deleteFile(path + ".rap");
   }
 
+  /* update the index in place rather than going back to the disk */
+  if (_slotsIndexed && ndx <= MaxIndexedSlots)
+  {
+    _slots[ndx].exists = true;
+    _slots[ndx].oldFormat = false;
+  }
+
   return true;
 }
 
@@ -306,6 +423,21 @@ bool States::loadRAState1(unsigned char* input, size_t size, std::string& errorB
     {
       ret = _core->unserialize(input, block_size, &errorBuffer);
     }
+    else if (memcmp(marker, RASTATE_CHUNKS_BLOCK, 4) == 0)
+    {
+      size_t coreSize;
+      void* coreData = _chunks.load(input, block_size, &coreSize);
+      if (coreData == NULL)
+      {
+        errorBuffer = "Could not rebuild the state from the chunk store.";
+        ret = false;
+      }
+      else
+      {
+        ret = _core->unserialize(coreData, coreSize, &errorBuffer);
+        free(coreData);
+      }
+    }
     else if (memcmp(marker, RASTATE_CHEEVOS_BLOCK, 4) == 0)
     {
       RA_RestoreState((const char*)input);
@@ -469,7 +601,8 @@ bool States::loadState(const std::string& path)
     unsigned char* input = (unsigned char*)data;
     switch (input[7]) /* version */
     {
-      case 1:
+      case RASTATE_VERSION:
+      case RASTATE_CHUNKED_VERSION: /* same layout, but the core data may be in a CHNK block */
         ret = loadRAState1(input, size, errorBuffer);
         break;
 
@@ -533,15 +666,29 @@ void States::restoreFrameBuffer(const void* pixels, unsigned image_width, unsign
 
 bool States::loadState(unsigned ndx)
 {
-  std::string path = getStatePath(ndx, _statePath, false);
-  if (!util::exists(path))
-    path = getStatePath(ndx, _statePath, true);
+  std::string path;
+
+  const SlotInfo* slot = getSlot(ndx);
+  if (slot != NULL)
+  {
+    path = getStatePath(ndx, _statePath, slot->oldFormat);
+  }
+  else
+  {
+    path = getStatePath(ndx, _statePath, false);
+    if (!util::exists(path))
+      path = getStatePath(ndx, _statePath, true);
+  }
 
   return loadState(path);
 }
 
 bool States::existsState(unsigned ndx)
 {
+  const SlotInfo* slot = getSlot(ndx);
+  if (slot != NULL)
+    return slot->exists;
+
   std::string path = getStatePath(ndx, _statePath, false);
   if (util::exists(path))
     return true;
@@ -550,6 +697,45 @@ bool States::existsState(unsigned ndx)
   return util::exists(path);
 }
 
+const States::SlotInfo* States::getSlot(unsigned ndx)
+{
+  if (ndx == 0 || ndx > MaxIndexedSlots)
+    return NULL;
+
+  if (!_slotsIndexed)
+    indexSlots();
+
+  return &_slots[ndx];
+}
+
+void States::indexSlots()
+{
+  memset(&_slots, 0, sizeof(_slots));
+  _slotsIndexed = true;
+
+  if (_gameFileName.empty())
+    return;
+
+  /* if the directory doesn't exist, none of the slots can */
+  if (!util::exists(util::directory(getStatePath(1, _statePath, false))))
+    return;
+
+  for (unsigned ndx = 1; ndx <= MaxIndexedSlots; ndx++)
+  {
+    SlotInfo& slot = _slots[ndx];
+
+    if (util::exists(getStatePath(ndx, _statePath, false)))
+    {
+      slot.exists = true;
+    }
+    else if (util::exists(getStatePath(ndx, _statePath, true)))
+    {
+      slot.exists = true;
+      slot.oldFormat = true;
+    }
+  }
+}
+
 const int States::_saveIntervals[] =
 {
   0,
@@ -710,7 +896,7 @@ void States::migrateFiles()
     }
   }
 
-  for (unsigned ndx = 1; ndx <= 10; ndx++)
+  for (unsigned ndx = 1; ndx <= MaxIndexedSlots; ndx++)
   {
     if (existsState(ndx))
       return;
@@ -778,6 +964,11 @@ void States::migrateFiles()
             MoveFile(oldPng.c_str(), newPng.c_str());
           }
         }
+
+        /* deduplicated states need their chunks */
+        _chunks.adopt(getStateBasePath(testPath) + ".chunks");
+
+        _slotsIndexed = false;
       }
 
       break;
@@ -785,6 +976,62 @@ void States::migrateFiles()
   }
 }
 
+void States::collectChunks()
+{
+  /* numbered slots are the only states that reference the chunk store */
+  for (unsigned ndx = 1; ndx <= 99; ndx++)
+  {
+    const std::string path = getStatePath(ndx, _chunksPath, false);
+    if (!util::exists(path))
+      continue;
+
+    /* check the header first so we don't read entire unchunked states */
+    uint8_t header[8];
+    FILE* file = util::openFile(_logger, path, "rb");
+    if (file == NULL)
+    {
+      _logger->warn(TAG "Not collecting chunks, could not open %s", path.c_str());
+      _chunks.clearMarks();
+      return;
+    }
+
+    const size_t headerSize = fread(header, 1, sizeof(header), file);
+    fclose(file);
+    if (headerSize != sizeof(header) || memcmp(header, "RASTATE", 7) != 0 || header[7] != RASTATE_CHUNKED_VERSION)
+      continue;
+
+    size_t size;
+    uint8_t* data = (uint8_t*)util::loadFile(_logger, path, &size);
+    if (data == NULL)
+    {
+      /* if a slot can't be read, we can't tell which chunks it needs */
+      _logger->warn(TAG "Not collecting chunks, could not read %s", path.c_str());
+      _chunks.clearMarks();
+      return;
+    }
+
+    const uint8_t* input = data + 8;
+    const uint8_t* stop = data + size;
+    while (input + 8 <= stop)
+    {
+      const size_t blockSize = (input[7] << 24 | input[6] << 16 | input[5] << 8 | input[4]);
+      if (input + 8 + blockSize > stop)
+        break;
+
+      if (memcmp(input, RASTATE_CHUNKS_BLOCK, 4) == 0)
+        _chunks.mark(input + 8, blockSize);
+      else if (memcmp(input, RASTATE_END_BLOCK, 4) == 0)
+        break;
+
+      input += 8 + alignSize(blockSize);
+    }
+
+    free(data);
+  }
+
+  _chunks.sweep();
+}
+
 std::string States::encodePath(Path path)
 {
   std::string settings;
@@ -808,6 +1055,10 @@ std::string States::serializeSettings() const
   settings += std::to_string(_saveInterval);
   settings += ",";
 
+  settings += "\"dedupStates\":";
+  settings += _dedupStates ? "true" : "false";
+  settings += ",";
+
   settings += "\"sramPath\":\"";
   settings += encodePath(_sramPath);
   settings += "\",";
@@ -845,9 +1096,11 @@ bool States::deserializeSettings(const char* json)
   {
     States* self;
     std::string key;
+    Path statePath;
   };
   Deserialize ud;
   ud.self = this;
+  ud.statePath = _statePath;
 
   jsonsax_result_t res = jsonsax_parse((char*)json, &ud, [](void* udata, jsonsax_event_t event, const char* str, size_t num)
   {
@@ -862,17 +1115,24 @@ bool States::deserializeSettings(const char* json)
       if (ud->key == "sramPath")
         ud->self->_sramPath = decodePath(std::string(str, num));
       else if (ud->key == "statePath")
-        ud->self->_statePath = decodePath(std::string(str, num));
+        ud->statePath = decodePath(std::string(str, num));
     }
     else if (event == JSONSAX_NUMBER)
     {
       if (ud->key == "saveInterval")
         ud->self->_saveInterval = (int)strtoul(str, NULL, 10);
     }
+    else if (event == JSONSAX_BOOLEAN)
+    {
+      if (ud->key == "dedupStates")
+        ud->self->_dedupStates = num != 0;
+    }
 
     return 0;
   });
 
+  setStatePath(ud.statePath);
+
   return (res == JSONSAX_OK);
 }
 
@@ -1032,6 +1292,10 @@ void States::showDialog()
   db.addCombobox(51006, 65, y - 2, WIDTH - 65, 12, 140, s_getStatePathOptions, NULL, &statePath);
   y += LINE;
 
+  bool dedupStates = _dedupStates;
+  db.addCheckbox("Deduplicate numbered save states", 51007, 0, y, WIDTH, 8, &dedupStates);
+  y += LINE;
+
   db.addButton("OK", IDOK, WIDTH - 55 - 50, y, 50, 14, true);
   db.addButton("Cancel", IDCANCEL, WIDTH - 50, y, 50, 14, false);
 
@@ -1039,6 +1303,7 @@ void States::showDialog()
   {
     _saveInterval = _saveIntervals[saveInterval];
     _sramPath = _sramPaths[sramPath];
-    _statePath = _statePaths[statePath];
+    setStatePath(_statePaths[statePath]);
+    _dedupStates = dedupStates;
   }
 }
@@ -19,6 +19,8 @@ along with RALibRetro.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include "ChunkStore.h"
+
 #include "components/Config.h"
 #include "components/Logger.h"
 #include "components/Video.h"
@@ -29,6 +31,7 @@ class States
 {
 public:
   bool init(Logger* logger, Config* config, Video* video);
+  void destroy();
 
   void setGame(const std::string& gameFileName, int system, const std::string& coreName, libretro::Core* core);
 
@@ -76,6 +79,24 @@ protected:
   int _system = 0;
   std::string _coreName;
   libretro::Core* _core = NULL;
+
+  /* cached information about the numbered slots so the menus don't have to hit the disk */
+  enum { MaxIndexedSlots = 10 };
+  struct SlotInfo
+  {
+    bool exists;
+    bool oldFormat;
+  };
+  SlotInfo _slots[MaxIndexedSlots + 1];
+  bool _slotsIndexed = false;
+
+  /* when enabled, the core data for numbered slots is kept in a per-game chunk store. the store is
+   * only ever collected with the slots of the state path it was opened for */
+  ChunkStore _chunks;
+  Path _chunksPath = Path::Saves;
+  bool _collectChunks = false;
+  bool _dedupStates = false;
+
   int _saveInterval = 0;
   void* _lastSaveData = NULL;
   time_t _lastSave = 0;
@@ -87,6 +108,17 @@ private:
 
   std::string getSRamPath(Path path) const;
   std::string getStatePath(unsigned ndx, Path path, bool bOldFormat) const;
+  std::string getStateBasePath(Path path) const;
+  std::string getChunkStorePath() const;
+
+  void setStatePath(Path path);
+  void openChunkStore();
+  void closeChunkStore();
+  void collectChunks();
+
+  bool saveState(const std::string& path, bool numbered);
+  const SlotInfo* getSlot(unsigned ndx);
+  void indexSlots();
 
   void saveSRAM(void* sramData, size_t sramSize);
   void restoreFrameBuffer(const void* pixels, unsigned image_width, unsigned image_height, unsigned pitch);
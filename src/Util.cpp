@@ -25,6 +25,7 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 #include <string.h>
 
 #ifndef NO_MINIZ
+#include "ZipIndex.h"
 #include <miniz_zip.h>
 #endif
 
@@ -59,15 +60,17 @@ static bool isAsciiOnly(const std::string& str)
   return true;
 }
 
-time_t util::fileTime(const std::string& path)
+bool util::fileInfo(const std::string& path, time_t* time, size_t* size)
 {
   if (isAsciiOnly(path))
   {
     struct stat filestat;
     if (stat(path.c_str(), &filestat) != 0)
-      return 0;
+      return false;
 
-    return filestat.st_mtime;
+    *time = filestat.st_mtime;
+    *size = (size_t)filestat.st_size;
+    return true;
   }
   else
   {
@@ -76,15 +79,27 @@ time_t util::fileTime(const std::string& path)
 
     struct _stat filestat;
     if (_wstat(unicodePath.c_str(), &filestat) != 0)
-      return 0;
+      return false;
 
-    return filestat.st_mtime;
+    *time = filestat.st_mtime;
+    *size = (size_t)filestat.st_size;
+    return true;
 #else
-    return 0;
+    return false;
 #endif
   }
 }
 
+time_t util::fileTime(const std::string& path)
+{
+  time_t time;
+  size_t size;
+  if (!util::fileInfo(path, &time, &size))
+    return 0;
+
+  return time;
+}
+
 bool util::exists(const std::string& path)
 {
   return util::fileTime(path) != 0;
@@ -173,67 +188,69 @@ void* util::loadFile(Logger* logger, const std::string& path, size_t* size)
 }
 
 #ifndef NO_MINIZ
-void* util::loadZippedFile(Logger* logger, const std::string& path, size_t* size, std::string& unzippedFileName)
+static const ZipIndex::Entry* selectZippedFile(Logger* logger, const ZipIndex& index, const char* validExtensions)
 {
-  mz_bool status;
-  mz_zip_archive zip_archive;
-  mz_zip_archive_file_stat file_stat;
-  void* data;
-  int file_count;
-
-  memset(&zip_archive, 0, sizeof(zip_archive));
-
-  status = mz_zip_reader_init_file(&zip_archive, path.c_str(), 0);
-  if (!status)
+  if (index.getEntries().empty())
   {
-    log_errno(logger, "opening", path.c_str());
+    logger->error(TAG "Zip file \"%s\" does not contain any files", index.getPath().c_str());
     return NULL;
   }
 
-  file_count = mz_zip_reader_get_num_files(&zip_archive);
-  if (file_count == 0)
-  {
-    mz_zip_reader_end(&zip_archive);
-    logger->error(TAG "Empty zip file \"%s\"", path.c_str());
-    return NULL;
-  }
+  const ZipIndex::Entry* entry = index.select(validExtensions);
+  if (!entry)
+    logger->error(TAG "Zip file \"%s\" contains %zu files, could not determine which to open", index.getPath().c_str(), index.getEntries().size());
 
-  if (file_count > 1)
+  return entry;
+}
+
+bool util::findZippedFile(Logger* logger, const std::string& path, size_t* size, std::string& unzippedFileName, const char* validExtensions)
+{
+  unzippedFileName.clear();
+  *size = 0;
+
+  std::shared_ptr<const ZipIndex> index = ZipIndex::get(logger, path);
+  if (!index || index->getEntries().empty())
+    return false;
+
+  const ZipIndex::Entry* entry = selectZippedFile(logger, *index, validExtensions);
+  if (entry)
   {
-    mz_zip_reader_end(&zip_archive);
-    logger->error(TAG "Zip file \"%s\" contains %d files, determining which to open is not supported - returning entire zip file", path.c_str(), file_count);
-    return loadFile(logger, path, size);
+    *size = (size_t)entry->size;
+    unzippedFileName = entry->name;
   }
 
-  if (mz_zip_reader_is_file_a_directory(&zip_archive, 0))
-  {
-    mz_zip_reader_end(&zip_archive);
-    logger->error(TAG "Zip file \"%s\" only contains a directory", path.c_str());
+  return true;
+}
+
+void* util::loadZippedFile(Logger* logger, const std::string& path, size_t* size, std::string& unzippedFileName, const char* validExtensions)
+{
+  std::shared_ptr<const ZipIndex> index = ZipIndex::get(logger, path);
+  if (!index || index->getEntries().empty())
     return NULL;
+
+  const ZipIndex::Entry* entry = selectZippedFile(logger, *index, validExtensions);
+  if (!entry)
+  {
+    logger->info(TAG "Returning entire zip file \"%s\"", path.c_str());
+    return loadFile(logger, path, size);
   }
 
-  if (!mz_zip_reader_file_stat(&zip_archive, 0, &file_stat))
+  /* decompress straight into the buffer that's returned to the caller */
+  *size = (size_t)entry->size;
+  void* data = malloc(*size + 1);
+  if (data == NULL)
   {
-    mz_zip_reader_end(&zip_archive);
-    logger->error(TAG "Error opening file in \"%s\"", path.c_str());
+    logger->error(TAG "Out of memory allocating %zu bytes to load \"%s\":\"%s\"", *size, path.c_str(), entry->name.c_str());
     return NULL;
   }
 
-  *size = (size_t)file_stat.m_uncomp_size;
-  data = malloc(*size);
-
-  status = mz_zip_reader_extract_to_mem(&zip_archive, 0, data, *size, 0);
-  if (!status)
+  if (!index->extract(logger, *entry, data))
   {
-    mz_zip_reader_end(&zip_archive);
-    log_errno(logger, "decompressing file in", path.c_str());
     free(data);
     return NULL;
   }
 
-  unzippedFileName = file_stat.m_filename;
-  logger->info(TAG "Read %zu bytes from \"%s\":\"%s\"", *size, path.c_str(), file_stat.m_filename);
-  mz_zip_reader_end(&zip_archive);
+  unzippedFileName = entry->name;
   return data;
 }
 
@@ -636,7 +653,7 @@ void util::ensureDirectoryExists(const std::string& directory)
   if (!util::exists(directory))
   {
     /* warning: this requires a full path */
-    SHCreateDirectoryEx(NULL, directory.c_str(), NULL);
+    SHCreateDirectoryExW(NULL, util::utf8ToUChar(directory).c_str(), NULL);
   }
 }
 #endif
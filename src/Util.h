@@ -41,6 +41,7 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 namespace util
 {
   time_t      fileTime(const std::string& path);
+  bool        fileInfo(const std::string& path, time_t* time, size_t* size);
   bool        exists(const std::string& path);
 
   FILE*       openFile(Logger* logger, const std::string& path, const char* mode);
@@ -48,7 +49,9 @@ namespace util
   void*       loadFile(Logger* logger, const std::string& path, size_t* size);
 
 #ifndef NO_MINIZ
-  void*       loadZippedFile(Logger* logger, const std::string& path, size_t* size, std::string& unzippedFileName);
+  /* validExtensions ('|' separated) selects the file if the zip contains more than one. unzippedFileName is empty if no file could be selected */
+  bool        findZippedFile(Logger* logger, const std::string& path, size_t* size, std::string& unzippedFileName, const char* validExtensions = NULL);
+  void*       loadZippedFile(Logger* logger, const std::string& path, size_t* size, std::string& unzippedFileName, const char* validExtensions = NULL);
   bool        unzipFile(Logger* logger, const std::string& zipPath, const std::string& archiveFileName, const std::string& unzippedPath);
 #endif
 
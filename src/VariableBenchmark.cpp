@@ -0,0 +1,179 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Measures the cost of RETRO_ENVIRONMENT_GET_VARIABLE for a core with as many options as Beetle PSX HW,
+ * which queries all of them when its options change and some of them every frame. Each frame queries
+ * every variable through Config::getVariable, once with the values already cached and once after the
+ * core's configuration was reloaded (the first queries after the user changed an option). The names
+ * are copied so the lookups can't rely on the pointers the options were registered with.
+ *
+ * usage: VariableBenchmark [number of frames] [number of variables] */
+
+#include "components/Config.h"
+#include "components/Logger.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+enum benchmark_mode
+{
+  BENCHMARK_CACHED,
+  BENCHMARK_RELOADED
+};
+
+static const char* benchmark_mode_name(benchmark_mode mode)
+{
+  switch (mode)
+  {
+    case BENCHMARK_CACHED: return "cached";
+    default: return "reloaded";
+  }
+}
+
+/* Config::init creates the frontend's directories, which a benchmark has no use for */
+class BenchmarkConfig : public Config
+{
+public:
+  explicit BenchmarkConfig(libretro::LoggerComponent* logger)
+  {
+    _logger = logger;
+    reset();
+  }
+};
+
+struct benchmark_data
+{
+  std::vector<std::string> definitions;
+  std::vector<retro_variable> variables;
+  std::vector<std::string> keys;    /* the names as the core would pass them */
+  std::string selections;           /* the core's configuration, as loaded from its json file */
+};
+
+static void benchmark_init(benchmark_data& data, int numVariables)
+{
+  static const char* groups[] = { "hw_renderer", "hw_internal_resolution", "hw_filter", "cd_access_method", "input_mouse_sensitivity" };
+  char key[64], definition[128];
+
+  data.selections = "{";
+
+  for (int i = 0; i < numVariables; i++)
+  {
+    snprintf(key, sizeof(key), "beetle_psx_hw_%s_%d", groups[i % 5], i);
+    snprintf(definition, sizeof(definition), "Option %d; option 0|option 1|option 2|option 3|option 4|option 5|option 6", i);
+
+    data.keys.push_back(key);
+    data.definitions.push_back(definition);
+
+    char selection[96];
+    snprintf(selection, sizeof(selection), "%s\"%s\":\"option %d\"", i ? "," : "", key, i % 7);
+    data.selections += selection;
+  }
+
+  data.selections += "}";
+
+  /* the keys are copied again here so the definitions don't share their pointers */
+  for (int i = 0; i < numVariables; i++)
+  {
+    retro_variable variable;
+    variable.key = strdup(data.keys[i].c_str());
+    variable.value = data.definitions[i].c_str();
+    data.variables.push_back(variable);
+  }
+}
+
+/* returns the time spent in the lookups in seconds */
+static double benchmark_run(Config& config, const benchmark_data& data, benchmark_mode mode, int numFrames, size_t& checksum)
+{
+  std::chrono::steady_clock::duration elapsed(0);
+
+  config.setVariables(data.variables.data(), (unsigned)data.variables.size());
+  config.deserialize(data.selections.c_str());
+
+  for (int frame = 0; frame < numFrames; frame++)
+  {
+    if (mode == BENCHMARK_RELOADED)
+      config.deserialize(data.selections.c_str());
+
+    const auto start = std::chrono::steady_clock::now();
+
+    for (const auto& key : data.keys)
+    {
+      const char* value = config.getVariable(key.c_str());
+      checksum += (size_t)value[7];
+    }
+
+    elapsed += std::chrono::steady_clock::now() - start;
+  }
+
+  return std::chrono::duration<double>(elapsed).count();
+}
+
+int main(int argc, char* argv[])
+{
+  const benchmark_mode modes[] = { BENCHMARK_CACHED, BENCHMARK_RELOADED };
+  const size_t numModes = sizeof(modes) / sizeof(modes[0]);
+
+  int numFrames = 10000;
+  if (argc > 1)
+    numFrames = atoi(argv[1]);
+
+  int numVariables = 200;
+  if (argc > 2)
+    numVariables = atoi(argv[2]);
+
+  if (numFrames <= 0 || numVariables <= 0)
+  {
+    fprintf(stderr, "usage: %s [number of frames] [number of variables]\n", argv[0]);
+    return 1;
+  }
+
+  /* only warnings are shown, as they would be in a release build */
+  Logger logger;
+  logger.init(NULL);
+  logger.setLogLevel(RETRO_LOG_WARN);
+
+  BenchmarkConfig config(&logger);
+
+  benchmark_data data;
+  benchmark_init(data, numVariables);
+
+  printf("%d frames, %d variables\n\n", numFrames, numVariables);
+  printf("%-12s %14s %14s\n", "mode", "ns/lookup", "us/frame");
+
+  size_t checksum = 0;
+
+  for (size_t i = 0; i < numModes; i++)
+  {
+    const double time = benchmark_run(config, data, modes[i], numFrames, checksum);
+    const double lookups = (double)numFrames * numVariables;
+    printf("%-12s %14.1f %14.2f\n", benchmark_mode_name(modes[i]), time * 1e9 / lookups, time * 1e6 / numFrames);
+  }
+
+  for (auto& variable : data.variables)
+    free((void*)variable.key);
+
+  logger.destroy();
+
+  /* keeps the lookups from being optimized away */
+  return checksum == 0 ? 2 : 0;
+}
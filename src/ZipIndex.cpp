@@ -0,0 +1,527 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ZipIndex.h"
+
+#include "Util.h"
+
+#include <miniz.h>
+#include <miniz_zip.h>
+
+#include <atomic>
+#include <mutex>
+#include <string.h>
+#include <thread>
+
+#define TAG "[ZIP] "
+
+#define ZIP_INDEX_CACHE_SIZE 8    /* number of archives whose index is kept */
+#define ZIP_BUFFER_SIZE 65536
+
+#define ZIP_LOCAL_HEADER_SIGNATURE 0x04034b50
+#define ZIP_LOCAL_HEADER_SIZE 30
+
+struct CachedZipIndex
+{
+  std::shared_ptr<const ZipIndex> index;
+  time_t time;
+  size_t size;
+};
+
+static std::mutex s_cacheMutex;
+static std::vector<CachedZipIndex> s_cache; /* most recently used last */
+
+static bool seekFile(FILE* file, uint64_t offset)
+{
+#ifdef _WIN32
+  return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+  return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+static uint32_t readLE(const uint8_t* data, int bytes)
+{
+  uint32_t value = 0;
+  while (bytes--)
+    value = (value << 8) | data[bytes];
+
+  return value;
+}
+
+static bool hasExtension(const char* validExtensions, const char* extension)
+{
+  const size_t length = strlen(extension);
+  const char* ptr = validExtensions;
+
+  while (*ptr)
+  {
+    if (strncasecmp(ptr, extension, length) == 0 && (ptr[length] == '\0' || ptr[length] == '|'))
+      return true;
+
+    while (*ptr && *ptr != '|')
+      ++ptr;
+    if (*ptr == '|')
+      ++ptr;
+  }
+
+  return false;
+}
+
+std::shared_ptr<const ZipIndex> ZipIndex::get(Logger* logger, const std::string& path)
+{
+  time_t time;
+  size_t size;
+
+  if (!util::fileInfo(path, &time, &size))
+  {
+    if (logger)
+      logger->error(TAG "File not found: %s", path.c_str());
+
+    return nullptr;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(s_cacheMutex);
+
+    for (auto it = s_cache.begin(); it != s_cache.end(); ++it)
+    {
+      if (it->index->getPath() == path)
+      {
+        if (it->time == time && it->size == size)
+        {
+          const CachedZipIndex cached = *it;
+          s_cache.erase(it);
+          s_cache.push_back(cached);
+          return cached.index;
+        }
+
+        /* archive changed since it was indexed */
+        s_cache.erase(it);
+        break;
+      }
+    }
+  }
+
+  std::shared_ptr<ZipIndex> index = std::make_shared<ZipIndex>();
+  if (!index->load(logger, path))
+    return nullptr;
+
+  {
+    std::lock_guard<std::mutex> lock(s_cacheMutex);
+
+    if (s_cache.size() >= ZIP_INDEX_CACHE_SIZE)
+      s_cache.erase(s_cache.begin());
+
+    CachedZipIndex cached;
+    cached.index = index;
+    cached.time = time;
+    cached.size = size;
+    s_cache.push_back(cached);
+  }
+
+  return index;
+}
+
+bool ZipIndex::splitPath(const std::string& path, std::string& zipPath, std::string& fileName)
+{
+  /* find the last ".zip#" in case the archive is in a directory with a '#' in its name */
+  size_t separator = std::string::npos;
+  for (size_t index = path.find('#'); index != std::string::npos; index = path.find('#', index + 1))
+  {
+    if (index >= 4 && strncasecmp(&path[index - 4], ".zip", 4) == 0)
+      separator = index;
+  }
+
+  if (separator == std::string::npos)
+    return false;
+
+  zipPath = path.substr(0, separator);
+  fileName = path.substr(separator + 1);
+  return true;
+}
+
+bool ZipIndex::load(Logger* logger, const std::string& path)
+{
+  mz_zip_archive zip_archive;
+  memset(&zip_archive, 0, sizeof(zip_archive));
+
+  /* open the file ourselves so unicode paths work */
+  FILE* file = util::openFile(logger, path, "rb");
+  if (!file)
+    return false;
+
+  if (!mz_zip_reader_init_cfile(&zip_archive, file, 0, 0))
+  {
+    if (logger)
+      logger->error(TAG "Error reading \"%s\": %s", path.c_str(), mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)));
+
+    fclose(file);
+    return false;
+  }
+
+  const mz_uint count = mz_zip_reader_get_num_files(&zip_archive);
+  _entries.reserve(count);
+
+  for (mz_uint i = 0; i < count; ++i)
+  {
+    mz_zip_archive_file_stat file_stat;
+    if (!mz_zip_reader_file_stat(&zip_archive, i, &file_stat) || file_stat.m_is_directory)
+      continue;
+
+    if (file_stat.m_is_encrypted || (file_stat.m_method != 0 && file_stat.m_method != MZ_DEFLATED) ||
+        (file_stat.m_method == 0 && file_stat.m_comp_size != file_stat.m_uncomp_size))
+    {
+      if (logger)
+        logger->warn(TAG "Ignoring unsupported file \"%s\" in \"%s\"", file_stat.m_filename, path.c_str());
+
+      continue;
+    }
+
+    Entry entry;
+    entry.name = file_stat.m_filename;
+    entry.size = file_stat.m_uncomp_size;
+    entry.compressedSize = file_stat.m_comp_size;
+    entry.localHeaderOffset = file_stat.m_local_header_ofs;
+    entry.crc32 = file_stat.m_crc32;
+    entry.method = file_stat.m_method;
+    _entries.push_back(entry);
+  }
+
+  /* mz_zip_reader_end doesn't close files passed to mz_zip_reader_init_cfile */
+  mz_zip_reader_end(&zip_archive);
+  fclose(file);
+
+  _path = path;
+
+  if (logger)
+    logger->info(TAG "Indexed %zu files in \"%s\"", _entries.size(), path.c_str());
+
+  return true;
+}
+
+const ZipIndex::Entry* ZipIndex::find(const std::string& name) const
+{
+  for (const auto& entry : _entries)
+  {
+    if (entry.name == name)
+      return &entry;
+  }
+
+  return NULL;
+}
+
+const ZipIndex::Entry* ZipIndex::select(const char* validExtensions) const
+{
+  if (_entries.size() == 1)
+    return &_entries.front();
+
+  if (validExtensions == NULL)
+    return NULL;
+
+  const Entry* match = NULL;
+  const Entry* playlist = NULL;
+  size_t numMatches = 0;
+
+  for (const auto& entry : _entries)
+  {
+    const char* extension = strrchr(entry.name.c_str(), '.');
+    if (extension == NULL || strchr(extension, '/') != NULL)
+      continue;
+
+    ++extension;
+    if (!hasExtension(validExtensions, extension))
+      continue;
+
+    match = &entry;
+    ++numMatches;
+
+    if (strcasecmp(extension, "m3u") == 0)
+      playlist = &entry;
+  }
+
+  if (numMatches == 1)
+    return match;
+
+  return playlist;
+}
+
+bool ZipIndex::extract(Logger* logger, const Entry& entry, void* buffer) const
+{
+  uint8_t* output = (uint8_t*)buffer;
+  Reader reader;
+
+  if (!reader.open(*this, entry))
+  {
+    logger->error(TAG "Error opening \"%s\" in \"%s\"", entry.name.c_str(), _path.c_str());
+    return false;
+  }
+
+  while (reader.tell() < entry.size)
+  {
+    if (reader.read(output + reader.tell(), (size_t)(entry.size - reader.tell())) == 0)
+    {
+      logger->error(TAG "Error decompressing \"%s\" in \"%s\"", entry.name.c_str(), _path.c_str());
+      return false;
+    }
+  }
+
+  logger->info(TAG "Read %zu bytes from \"%s\":\"%s\"", (size_t)entry.size, _path.c_str(), entry.name.c_str());
+  return true;
+}
+
+bool ZipIndex::extractFile(Logger* logger, const Entry& entry, const std::string& path) const
+{
+  Reader reader;
+  if (!reader.open(*this, entry))
+  {
+    logger->error(TAG "Error opening \"%s\" in \"%s\"", entry.name.c_str(), _path.c_str());
+    return false;
+  }
+
+  FILE* file = util::openFile(logger, path, "wb");
+  if (!file)
+    return false;
+
+  std::vector<uint8_t> buffer(ZIP_BUFFER_SIZE);
+  bool success = true;
+  size_t bytes;
+
+  while ((bytes = reader.read(buffer.data(), buffer.size())) > 0)
+  {
+    if (fwrite(buffer.data(), 1, bytes, file) != bytes)
+    {
+      success = false;
+      break;
+    }
+  }
+
+  fclose(file);
+
+  if (!success || reader.tell() != entry.size)
+  {
+    logger->error(TAG "Error extracting \"%s\" from \"%s\"", entry.name.c_str(), _path.c_str());
+    util::deleteFile(path);
+    return false;
+  }
+
+  logger->info(TAG "Extracted \"%s\" from \"%s\"", path.c_str(), _path.c_str());
+  return true;
+}
+
+bool ZipIndex::extract(Logger* logger, const std::vector<const Entry*>& entries, const std::vector<std::string>& paths, unsigned numThreads) const
+{
+  std::atomic<size_t> nextEntry(0);
+  std::atomic<bool> success(true);
+
+  auto worker = [&]()
+  {
+    size_t index;
+    while ((index = nextEntry++) < entries.size())
+    {
+      if (!extractFile(logger, *entries[index], paths[index]))
+        success = false;
+    }
+  };
+
+  /* the calling thread is one of the workers */
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < numThreads && i < entries.size(); ++i)
+    threads.emplace_back(worker);
+
+  worker();
+
+  for (auto& thread : threads)
+    thread.join();
+
+  return success;
+}
+
+bool ZipIndex::Reader::open(const ZipIndex& index, const Entry& entry)
+{
+  uint8_t header[ZIP_LOCAL_HEADER_SIZE];
+
+  close();
+
+  _file = util::openFile(NULL, index.getPath(), "rb");
+  if (!_file)
+    return false;
+
+  /* the file data follows the local header, whose name and extra field may not match the central directory */
+  if (!seekFile(_file, entry.localHeaderOffset) || fread(header, 1, sizeof(header), _file) != sizeof(header) ||
+      readLE(&header[0], 4) != ZIP_LOCAL_HEADER_SIGNATURE)
+  {
+    close();
+    return false;
+  }
+
+  _entry = &entry;
+  _dataOffset = entry.localHeaderOffset + sizeof(header) + readLE(&header[26], 2) + readLE(&header[28], 2);
+
+  if (!restart())
+  {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+void ZipIndex::Reader::close()
+{
+  if (_stream)
+  {
+    mz_inflateEnd((mz_stream*)_stream);
+    delete (mz_stream*)_stream;
+    _stream = NULL;
+  }
+
+  if (_file)
+  {
+    fclose(_file);
+    _file = NULL;
+  }
+
+  _entry = NULL;
+  _position = 0;
+}
+
+bool ZipIndex::Reader::restart()
+{
+  if (!seekFile(_file, _dataOffset))
+    return false;
+
+  _compressedRemaining = _entry->compressedSize;
+  _position = 0;
+  _crc32 = MZ_CRC32_INIT;
+  _failed = false;
+
+  if (_entry->method == MZ_DEFLATED)
+  {
+    mz_stream* stream = (mz_stream*)_stream;
+    if (stream)
+      mz_inflateEnd(stream);
+    else
+      _stream = stream = new mz_stream;
+
+    memset(stream, 0, sizeof(*stream));
+
+    /* zip files contain raw deflate data without a zlib header */
+    if (mz_inflateInit2(stream, -MZ_DEFAULT_WINDOW_BITS) != MZ_OK)
+    {
+      delete stream;
+      _stream = NULL;
+      return false;
+    }
+
+    _input.resize(ZIP_BUFFER_SIZE);
+  }
+
+  return true;
+}
+
+size_t ZipIndex::Reader::read(void* buffer, size_t count)
+{
+  size_t total;
+
+  if (!_entry || _failed)
+    return 0;
+
+  if (count > _entry->size - _position)
+    count = (size_t)(_entry->size - _position);
+  if (count > 0x40000000) /* avail_out is 32-bit */
+    count = 0x40000000;
+  if (count == 0)
+    return 0;
+
+  if (_entry->method == MZ_DEFLATED)
+  {
+    mz_stream* stream = (mz_stream*)_stream;
+    stream->next_out = (unsigned char*)buffer;
+    stream->avail_out = (unsigned)count;
+
+    while (stream->avail_out > 0)
+    {
+      if (stream->avail_in == 0 && _compressedRemaining > 0)
+      {
+        size_t bytes = _input.size();
+        if (bytes > _compressedRemaining)
+          bytes = (size_t)_compressedRemaining;
+
+        bytes = fread(_input.data(), 1, bytes, _file);
+        if (bytes == 0)
+          break;
+
+        _compressedRemaining -= bytes;
+        stream->next_in = _input.data();
+        stream->avail_in = (unsigned)bytes;
+      }
+
+      if (mz_inflate(stream, MZ_NO_FLUSH) != MZ_OK)
+        break;
+    }
+
+    total = count - stream->avail_out;
+  }
+  else
+  {
+    total = fread(buffer, 1, count, _file);
+  }
+
+  _crc32 = (uint32_t)mz_crc32(_crc32, (const unsigned char*)buffer, total);
+
+  if (total < count || (_position + total == _entry->size && _crc32 != _entry->crc32))
+  {
+    /* truncated or corrupt */
+    _failed = true;
+    return 0;
+  }
+
+  _position += total;
+  return total;
+}
+
+bool ZipIndex::Reader::seek(uint64_t position)
+{
+  if (!_entry || position > _entry->size)
+    return false;
+
+  /* the data can only be decompressed forward. start over to go backwards */
+  if (position < _position && !restart())
+  {
+    _failed = true;
+    return false;
+  }
+
+  if (position > _position)
+  {
+    uint8_t buffer[4096];
+    while (_position < position)
+    {
+      size_t bytes = sizeof(buffer);
+      if (bytes > position - _position)
+        bytes = (size_t)(position - _position);
+
+      if (read(buffer, bytes) == 0)
+        return false;
+    }
+  }
+
+  return true;
+}
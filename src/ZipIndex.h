@@ -0,0 +1,102 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "components/Logger.h"
+
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/* Index of the files in a zip archive, built from its central directory. Indexes are cached and
+ * checked against the size and modification time of the archive, so opening the same archive
+ * again doesn't read the central directory again. Files are decompressed by Readers, which each
+ * have their own file handle, so several files can be decompressed on different threads. */
+class ZipIndex
+{
+public:
+  struct Entry
+  {
+    std::string name;
+    uint64_t size;
+    uint64_t compressedSize;
+    uint64_t localHeaderOffset;
+    uint32_t crc32;
+    unsigned method;
+  };
+
+  class Reader
+  {
+  public:
+    ~Reader() { close(); }
+
+    /* the index must outlive the reader */
+    bool     open(const ZipIndex& index, const Entry& entry);
+    void     close();
+
+    /* returns 0 at the end of the file, or if the data is corrupt */
+    size_t   read(void* buffer, size_t count);
+    bool     seek(uint64_t position);
+    uint64_t tell() const { return _position; }
+
+  protected:
+    bool     restart();
+
+    const Entry* _entry = NULL;
+    FILE* _file = NULL;
+    void* _stream = NULL;   /* mz_stream for deflated files */
+    std::vector<uint8_t> _input;
+    uint64_t _dataOffset = 0;
+    uint64_t _compressedRemaining = 0;
+    uint64_t _position = 0;
+    uint32_t _crc32 = 0;
+    bool _failed = false;
+  };
+
+  /* logger may be NULL */
+  static std::shared_ptr<const ZipIndex> get(Logger* logger, const std::string& path);
+
+  /* splits "archive.zip#file" (the form of path passed to cores) into its parts */
+  static bool splitPath(const std::string& path, std::string& zipPath, std::string& fileName);
+
+  const std::string&        getPath() const { return _path; }
+  const std::vector<Entry>& getEntries() const { return _entries; }
+
+  const Entry* find(const std::string& name) const;
+
+  /* returns the only file in the zip, or the only file with one of the '|' separated extensions. if
+   * several files match and one of them is a playlist, returns the playlist */
+  const Entry* select(const char* validExtensions) const;
+
+  /* decompresses a file into a buffer of entry.size bytes */
+  bool extract(Logger* logger, const Entry& entry, void* buffer) const;
+
+  /* decompresses files to disk, using up to numThreads threads */
+  bool extract(Logger* logger, const std::vector<const Entry*>& entries, const std::vector<std::string>& paths, unsigned numThreads) const;
+
+protected:
+  bool load(Logger* logger, const std::string& path);
+  bool extractFile(Logger* logger, const Entry& entry, const std::string& path) const;
+
+  std::string _path;
+  std::vector<Entry> _entries;
+};
@@ -19,6 +19,8 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "Audio.h"
 
+#include "Profiler.h"
+
 #include <SDL_timer.h>
 #include <string.h>
 #include <math.h>
@@ -203,7 +205,9 @@ bool Audio::setRate(double rate)
 
 void Audio::mix(const int16_t* samples, size_t frames)
 {
-  _logger->debug(TAG "Processing %zu audio frames", frames);
+  PROFILE_PHASE(AudioMix);
+
+  LOG_DEBUG(_logger, TAG "Processing %zu audio frames", frames);
 
   size_t avail = _fifo->free();
   size_t output_size;
@@ -229,7 +233,7 @@ void Audio::mix(const int16_t* samples, size_t frames)
     _currentRatio = _originalRatio * adjust;
 
     if (_currentRatio != _originalRatio)
-      _logger->debug(TAG "Original ratio %f adjusted by %f to %f", _originalRatio, adjust, _currentRatio);
+      LOG_DEBUG(_logger, TAG "Original ratio %f adjusted by %f to %f", _originalRatio, adjust, _currentRatio);
 #endif
 
     /* allocate output buffer */
@@ -248,7 +252,7 @@ void Audio::mix(const int16_t* samples, size_t frames)
     /* do the resampling */
     spx_uint32_t in_frames = frames;
     spx_uint32_t out_frames = out_len / 2;
-    _logger->debug(TAG "Resampling %u samples to %u", in_frames * 2, out_frames * 2);
+    LOG_DEBUG(_logger, TAG "Resampling %u samples to %u", in_frames * 2, out_frames * 2);
 
     {
       /* speex seems to have issues upsampling SNES (32KHz) properly without introducing static.
@@ -291,7 +295,7 @@ void Audio::mix(const int16_t* samples, size_t frames)
     }
     else
     {
-      _logger->debug(TAG "Waiting for FIFO (need %zu bytes but only %zu available), sleeping", needed, avail);
+      LOG_DEBUG(_logger, TAG "Waiting for FIFO (need %zu bytes but only %zu available), sleeping", needed, avail);
 
       const int MAX_WAIT = 250;
       int tries = MAX_WAIT;
@@ -360,5 +364,5 @@ void Audio::mix(const int16_t* samples, size_t frames)
       _fifo->write(expanded, count * _channels * sizeof(int16_t));
   }
 
-  _logger->debug(TAG "Wrote %zu bytes to the FIFO", needed);
+  LOG_DEBUG(_logger, TAG "Wrote %zu bytes to the FIFO", needed);
 }
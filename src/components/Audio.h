@@ -60,6 +60,8 @@ public:
 
   void setBlocking(bool value) { _blocking = value; }
 
+  double getResamplerRatio() const { return _currentRatio; }
+
 protected:
   libretro::LoggerComponent* _logger;
 
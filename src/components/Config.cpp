@@ -21,12 +21,13 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "Util.h"
 #include "jsonsax/jsonsax.h"
+
+#ifdef _WINDOWS
 #include "RA_Interface.h"
 
 #include <rcheevos/src/rc_libretro.h>
 #include <rcheevos/include/rc_consoles.h>
 
-#ifdef _WINDOWS
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 
@@ -74,6 +75,8 @@ bool Config::init(libretro::LoggerComponent* logger)
 
 #ifdef WIN32
  #define mkdir(path) CreateDirectory(path, NULL)
+#else
+ #define mkdir(path) mkdir(path, 0755)
 #endif
 
   mkdir(_assetsFolder.c_str());
@@ -87,8 +90,10 @@ bool Config::init(libretro::LoggerComponent* logger)
   _logger->info(TAG "System folder:      %s", _systemFolder.c_str());
   _logger->info(TAG "Screenshots folder: %s", _screenshotsFolder.c_str());
 
+#ifdef _WINDOWS
   // TODO This should be done in main.cpp as soon as possible
   SetCurrentDirectory(_rootFolder.c_str());
+#endif
 
   // these settings are global and should not be modified by reset()
   _audioWhileFastForwarding = true;
@@ -96,6 +101,8 @@ bool Config::init(libretro::LoggerComponent* logger)
   _backgroundInput = false;
   _showSpeedIndicator = true;
   _gameFocusCaptureMouse = false;
+  _snapshotMemory = false;
+  _cacheHashes = true;
 
   reset();
   return true;
@@ -105,6 +112,7 @@ void Config::reset()
 {
   _variables.clear();
   _selections.clear();
+  _variableCache.clear();
   _updated = false;
   _hadDisallowedSetting = false;
 }
@@ -128,6 +136,7 @@ void Config::setVariables(const struct retro_variable* variables, unsigned count
 {
   _variables.clear();
   _categories.clear();
+  _variableCache.clear();
 
   for (unsigned i = 0; i < count; variables++, i++)
   {
@@ -186,6 +195,7 @@ void Config::setVariables(const struct retro_core_option_definition* options, un
 {
   _variables.clear();
   _categories.clear();
+  _variableCache.clear();
 
   for (unsigned i = 0; i < count; options++, i++)
   {
@@ -265,6 +275,7 @@ void Config::setVariables(const struct retro_core_option_v2_definition* options,
 {
   _variables.clear();
   _categories.clear();
+  _variableCache.clear();
 
   for (unsigned i = 0; i < category_count; categories++, i++)
   {
@@ -334,12 +345,19 @@ bool Config::varUpdated()
 
 const char* Config::getVariable(const char* variable)
 {
+  // some cores query their variables every frame, only the first query after a change is logged
+  const char* value = _variableCache.find(variable);
+
+  if (value != NULL)
+    return value;
+
   const auto& found = _selections.find(variable);
 
   if (found != _selections.cend())
   {
-    const char* value = found->second.c_str();
+    value = found->second.c_str();
     _logger->info(TAG "Variable %s is \"%s\"", variable, value);
+    _variableCache.add(found->first.c_str(), value);
     return value;
   }
 
@@ -347,8 +365,9 @@ const char* Config::getVariable(const char* variable)
   {
     if (var._key == variable)
     {
-      const char* value = var._options[var._selected].c_str();
+      value = var._options[var._selected].c_str();
       _logger->warn(TAG "Variable %s not found in the selections, returning \"%s\"", variable, value);
+      _variableCache.add(var._key.c_str(), value);
       return value;
     }
   }
@@ -359,6 +378,8 @@ const char* Config::getVariable(const char* variable)
 
 std::string Config::serialize()
 {
+  _variableCache.clear();
+
   for (const auto& var : _variables)
   {
     const auto found = _selections.find(var._key);
@@ -402,6 +423,8 @@ void Config::deserialize(const char* json)
   Deserialize ud;
   ud.self = this;
 
+  _variableCache.clear();
+
   jsonsax_parse(json, &ud, [](void* udata, jsonsax_event_t event, const char* str, size_t num) {
     auto ud = (Deserialize*)udata;
 
@@ -516,7 +539,6 @@ bool Config::validateSettingsForHardcore(const char* library_name, int console_i
       return false;
     }
   }
-#endif
 
   if (RA_HardcoreModeIsActive() && !rc_libretro_is_system_allowed(library_name, console_id))
   {
@@ -534,6 +556,7 @@ bool Config::validateSettingsForHardcore(const char* library_name, int console_i
       return false;
     }
   }
+#endif
 
   return true;
 }
@@ -575,6 +598,14 @@ std::string Config::serializeEmulatorSettings() const
 
   json.append("\"gameFocusCaptureMouse\":");
   json.append(_gameFocusCaptureMouse ? "true" : "false");
+  json.append(",");
+
+  json.append("\"snapshotMemory\":");
+  json.append(_snapshotMemory ? "true" : "false");
+  json.append(",");
+
+  json.append("\"cacheHashes\":");
+  json.append(_cacheHashes ? "true" : "false");
 
   json.append("}");
   return json;
@@ -617,6 +648,14 @@ bool Config::deserializeEmulatorSettings(const char* json)
       {
         ud->self->_gameFocusCaptureMouse = num != 0;
       }
+      else if (ud->key == "snapshotMemory")
+      {
+        ud->self->_snapshotMemory = num != 0;
+      }
+      else if (ud->key == "cacheHashes")
+      {
+        ud->self->_cacheHashes = num != 0;
+      }
     }
     else if (event == JSONSAX_NUMBER)
     {
@@ -887,6 +926,8 @@ void Config::showDialog(const std::string& coreName, Input& input)
       }
     }
 
+    _variableCache.clear();
+
     for (unsigned i = 0; i < db.variables.size(); ++i)
     {
       auto& var = *db.variables[i];
@@ -952,6 +993,14 @@ void Config::showEmulatorSettingsDialog()
   db.addCheckbox("Capture mouse in Game Focus mode", 51005, 0, y, WIDTH - 10, 8, &gameFocusCaptureMouse);
   y += LINE;
 
+  bool snapshotMemory = _snapshotMemory;
+  db.addCheckbox("Snapshot memory for achievement processing", 51006, 0, y, WIDTH - 10, 8, &snapshotMemory);
+  y += LINE;
+
+  bool cacheHashes = _cacheHashes;
+  db.addCheckbox("Remember hashes of loaded games", 51007, 0, y, WIDTH - 10, 8, &cacheHashes);
+  y += LINE;
+
   db.addButton("OK", IDOK, WIDTH - 55 - 50, y, 50, 14, true);
   db.addButton("Cancel", IDCANCEL, WIDTH - 50, y, 50, 14, false);
 
@@ -961,6 +1010,8 @@ void Config::showEmulatorSettingsDialog()
     _fastForwardRatio = fastForwardRatio + 2;
     _showSpeedIndicator = showSpeedIndicator;
     _gameFocusCaptureMouse = gameFocusCaptureMouse;
+    _snapshotMemory = snapshotMemory;
+    _cacheHashes = cacheHashes;
   }
 }
 #endif
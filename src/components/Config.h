@@ -23,6 +23,7 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
  #include "components/Input.h"
 #endif
 
+#include "components/VariableCache.h"
 #include "libretro/Components.h"
 
 #include <map>
@@ -62,6 +63,9 @@ public:
 
   virtual bool getGameFocusCaptureMouse() override { return _gameFocusCaptureMouse; }
 
+  bool getSnapshotMemory() const { return _snapshotMemory; }
+  bool getCacheHashes() const { return _cacheHashes; }
+
   void setSaveDirectory(const std::string& path) { _saveFolder = path; }
 
   const char* getRootFolder()
@@ -111,6 +115,7 @@ protected:
     std::vector<std::string> _labels;
   };
 
+#ifdef _WINDOWS
   class ConfigDialog : public Dialog
   {
   public:
@@ -132,6 +137,7 @@ protected:
 
     HWND hwnd;
   };
+#endif
 
   static void initializeControllerVariable(Variable& variable, const char* name, const char* key, const std::map<std::string, unsigned>& names, unsigned selectedDevice);
   void setOptions(Variable& var, const retro_core_option_value* values, const char* default_value);
@@ -148,6 +154,9 @@ protected:
   std::vector<Variable> _variables;
   std::unordered_map<std::string, std::string> _selections;
 
+  // Values returned by getVariable, must be cleared when _selections or _variables change
+  VariableCache _variableCache;
+
   bool _updated;
   bool _fastForwarding;
   bool _hadDisallowedSetting;
@@ -155,6 +164,8 @@ protected:
   bool _backgroundInput;
   bool _showSpeedIndicator;
   bool _gameFocusCaptureMouse;
+  bool _snapshotMemory;
+  bool _cacheHashes;
 
   int _fastForwardRatio;
 
@@ -21,10 +21,14 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 
 #ifdef LOG_TO_FILE
 #include "Util.h"
-#include <chrono>
 #endif
 
+#include <chrono>
 #include <memory.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 /* must be less than RING_LOG_MAX_BUFFER_SIZE */
@@ -32,6 +36,379 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 #define RING_LOG_MAX_LINE_SIZE 1024
 #endif
 
+namespace
+{
+  enum ArgumentType
+  {
+    kInt,
+    kLong,
+    kLongLong,
+    kSize,
+    kIntMax,
+    kPtrDiff,
+    kDouble,
+    kLongDouble,
+    kPointer,
+    kString
+  };
+
+  struct Conversion
+  {
+    char flags[6];
+    int width;            // -1 if not specified, -2 if passed as an argument.
+    int precision;        // -1 if not specified, -2 if passed as an argument.
+    const char* modifier; // The length modifier, i.e. "ll" or "z".
+    size_t modifierLength;
+    char type;
+    ArgumentType argument;
+  };
+}
+
+static bool isModifier(const Conversion& conversion, const char* modifier)
+{
+  return conversion.modifierLength == strlen(modifier) && memcmp(conversion.modifier, modifier, conversion.modifierLength) == 0;
+}
+
+// Parses the conversion specification after a '%'. Returns a pointer past it, or NULL if the
+// conversion isn't supported (i.e. wide strings or %n).
+static const char* parseConversion(const char* fmt, Conversion* conversion)
+{
+  size_t numFlags = 0;
+
+  while (*fmt && strchr("-+ #0", *fmt))
+  {
+    if (numFlags == sizeof(conversion->flags) - 1)
+      return NULL;
+
+    conversion->flags[numFlags++] = *fmt++;
+  }
+
+  conversion->flags[numFlags] = 0;
+
+  conversion->width = -1;
+  if (*fmt == '*')
+  {
+    conversion->width = -2;
+    fmt++;
+  }
+  else if (*fmt >= '0' && *fmt <= '9')
+  {
+    conversion->width = 0;
+
+    do
+    {
+      conversion->width = conversion->width * 10 + (*fmt++ - '0');
+      if (conversion->width > LOG_MAX_LINE_SIZE)
+        return NULL;
+    } while (*fmt >= '0' && *fmt <= '9');
+  }
+
+  conversion->precision = -1;
+  if (*fmt == '.')
+  {
+    fmt++;
+
+    if (*fmt == '*')
+    {
+      conversion->precision = -2;
+      fmt++;
+    }
+    else
+    {
+      conversion->precision = 0;
+
+      while (*fmt >= '0' && *fmt <= '9')
+      {
+        conversion->precision = conversion->precision * 10 + (*fmt++ - '0');
+        if (conversion->precision > LOG_MAX_LINE_SIZE)
+          return NULL;
+      }
+    }
+  }
+
+  conversion->modifier = fmt;
+
+  switch (*fmt)
+  {
+    case 'h':
+    case 'l':
+      if (fmt[1] == fmt[0])
+        fmt++;
+      fmt++;
+      break;
+
+    case 'z':
+    case 'j':
+    case 't':
+    case 'L':
+      fmt++;
+      break;
+
+    case 'I': // MSVC
+      fmt++;
+      if ((fmt[0] == '6' && fmt[1] == '4') || (fmt[0] == '3' && fmt[1] == '2'))
+        fmt += 2;
+      break;
+  }
+
+  conversion->modifierLength = fmt - conversion->modifier;
+  conversion->type = *fmt;
+
+  switch (conversion->type)
+  {
+    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+      if (conversion->modifierLength == 0 || isModifier(*conversion, "h") || isModifier(*conversion, "hh") || isModifier(*conversion, "I32"))
+        conversion->argument = kInt;
+      else if (isModifier(*conversion, "l"))
+        conversion->argument = kLong;
+      else if (isModifier(*conversion, "ll") || isModifier(*conversion, "I64"))
+        conversion->argument = kLongLong;
+      else if (isModifier(*conversion, "z") || isModifier(*conversion, "I"))
+        conversion->argument = kSize;
+      else if (isModifier(*conversion, "j"))
+        conversion->argument = kIntMax;
+      else if (isModifier(*conversion, "t"))
+        conversion->argument = kPtrDiff;
+      else
+        return NULL;
+      break;
+
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+      if (conversion->modifierLength == 0 || isModifier(*conversion, "l"))
+        conversion->argument = kDouble;
+      else if (isModifier(*conversion, "L"))
+        conversion->argument = kLongDouble;
+      else
+        return NULL;
+      break;
+
+    case 'c':
+    case 's':
+    case 'p':
+      if (conversion->modifierLength != 0)
+        return NULL;
+
+      conversion->argument = (conversion->type == 'c') ? kInt : (conversion->type == 's') ? kString : kPointer;
+      break;
+
+    default:
+      return NULL;
+  }
+
+  return fmt + 1;
+}
+
+template<typename T>
+static bool putArgument(uint8_t* arguments, size_t size, size_t* length, T value)
+{
+  if (size - *length < sizeof(T))
+    return false;
+
+  memcpy(arguments + *length, &value, sizeof(T));
+  *length += sizeof(T);
+  return true;
+}
+
+template<typename T>
+static T getArgument(const uint8_t* arguments, size_t* length)
+{
+  T value;
+  memcpy(&value, arguments + *length, sizeof(T));
+  *length += sizeof(T);
+  return value;
+}
+
+// Copies the arguments for fmt. Strings are copied, since the pointers may not be valid when the
+// message is formatted.
+static bool captureArguments(const char* fmt, va_list args, uint8_t* arguments, size_t size, size_t* length)
+{
+  *length = 0;
+
+  while ((fmt = strchr(fmt, '%')) != NULL)
+  {
+    if (fmt[1] == '%')
+    {
+      fmt += 2;
+      continue;
+    }
+
+    Conversion conversion;
+    fmt = parseConversion(fmt + 1, &conversion);
+    if (!fmt)
+      return false;
+
+    if (conversion.width == -2 && !putArgument(arguments, size, length, va_arg(args, int)))
+      return false;
+
+    int precision = conversion.precision;
+    if (precision == -2)
+    {
+      precision = va_arg(args, int);
+      if (!putArgument(arguments, size, length, precision))
+        return false;
+    }
+
+    bool ok = false;
+
+    switch (conversion.argument)
+    {
+      case kInt:        ok = putArgument(arguments, size, length, va_arg(args, int)); break;
+      case kLong:       ok = putArgument(arguments, size, length, va_arg(args, long)); break;
+      case kLongLong:   ok = putArgument(arguments, size, length, va_arg(args, long long)); break;
+      case kSize:       ok = putArgument(arguments, size, length, va_arg(args, size_t)); break;
+      case kIntMax:     ok = putArgument(arguments, size, length, va_arg(args, intmax_t)); break;
+      case kPtrDiff:    ok = putArgument(arguments, size, length, va_arg(args, ptrdiff_t)); break;
+      case kDouble:     ok = putArgument(arguments, size, length, va_arg(args, double)); break;
+      case kLongDouble: ok = putArgument(arguments, size, length, va_arg(args, long double)); break;
+      case kPointer:    ok = putArgument(arguments, size, length, va_arg(args, void*)); break;
+
+      case kString:
+      {
+        const char* string = va_arg(args, const char*);
+        if (!string)
+          string = "(null)";
+
+        // Only copy the characters that will be printed.
+        const size_t available = size - *length;
+        const size_t limit = (precision >= 0 && (size_t)precision < available) ? (size_t)precision : available;
+        size_t stringLength = 0;
+        while (stringLength < limit && string[stringLength])
+          stringLength++;
+
+        if (stringLength + sizeof(uint16_t) > available)
+          return false;
+
+        putArgument(arguments, size, length, (uint16_t)stringLength);
+        memcpy(arguments + *length, string, stringLength);
+        *length += stringLength;
+        ok = true;
+        break;
+      }
+    }
+
+    if (!ok)
+      return false;
+  }
+
+  return true;
+}
+
+// Formats a message from the arguments copied by captureArguments, the same way vprintf does.
+static size_t formatArguments(const char* fmt, const uint8_t* arguments, char* line, size_t size)
+{
+  size_t length = 0;
+  size_t used = 0;
+  bool truncated = false;
+
+  while (*fmt)
+  {
+    if (*fmt != '%' || fmt[1] == '%')
+    {
+      if (length == size - 1)
+      {
+        truncated = true;
+        break;
+      }
+
+      line[length++] = *fmt;
+      fmt += (*fmt == '%') ? 2 : 1;
+      continue;
+    }
+
+    // This can't fail, fmt was already parsed when the arguments were captured.
+    Conversion conversion;
+    fmt = parseConversion(fmt + 1, &conversion);
+
+    char spec[48];
+    char* end = spec;
+    *end++ = '%';
+
+    int width = conversion.width;
+    if (width == -2)
+    {
+      width = getArgument<int>(arguments, &used);
+
+      // A negative width is a '-' flag followed by a positive width.
+      if (width < 0)
+      {
+        *end++ = '-';
+        width = (width < -LOG_MAX_LINE_SIZE) ? LOG_MAX_LINE_SIZE : -width;
+      }
+      else if (width > LOG_MAX_LINE_SIZE)
+      {
+        width = LOG_MAX_LINE_SIZE;
+      }
+    }
+
+    int precision = conversion.precision;
+    if (precision == -2)
+      precision = getArgument<int>(arguments, &used);
+
+    for (const char* flag = conversion.flags; *flag; flag++)
+      *end++ = *flag;
+
+    if (width >= 0)
+      end += sprintf(end, "%d", width);
+
+    const char* string = NULL;
+    if (conversion.argument == kString)
+    {
+      // The string was already cut to the precision.
+      precision = getArgument<uint16_t>(arguments, &used);
+      string = (const char*)arguments + used;
+      used += precision;
+    }
+
+    if (precision >= 0)
+      end += sprintf(end, ".%d", precision);
+
+    memcpy(end, conversion.modifier, conversion.modifierLength);
+    end += conversion.modifierLength;
+    *end++ = conversion.type;
+    *end = 0;
+
+    char* output = line + length;
+    const size_t available = size - length;
+    int written = 0;
+
+    switch (conversion.argument)
+    {
+      case kInt:        written = snprintf(output, available, spec, getArgument<int>(arguments, &used)); break;
+      case kLong:       written = snprintf(output, available, spec, getArgument<long>(arguments, &used)); break;
+      case kLongLong:   written = snprintf(output, available, spec, getArgument<long long>(arguments, &used)); break;
+      case kSize:       written = snprintf(output, available, spec, getArgument<size_t>(arguments, &used)); break;
+      case kIntMax:     written = snprintf(output, available, spec, getArgument<intmax_t>(arguments, &used)); break;
+      case kPtrDiff:    written = snprintf(output, available, spec, getArgument<ptrdiff_t>(arguments, &used)); break;
+      case kDouble:     written = snprintf(output, available, spec, getArgument<double>(arguments, &used)); break;
+      case kLongDouble: written = snprintf(output, available, spec, getArgument<long double>(arguments, &used)); break;
+      case kPointer:    written = snprintf(output, available, spec, getArgument<void*>(arguments, &used)); break;
+      case kString:     written = snprintf(output, available, spec, string); break;
+    }
+
+    if (written < 0)
+      written = 0;
+
+    if ((size_t)written >= available)
+    {
+      length = size - 1;
+      truncated = true;
+      break;
+    }
+
+    length += written;
+  }
+
+  line[length] = 0;
+
+  if (truncated)
+    line[length - 1] = line[length - 2] = line[length - 3] = '.';
+
+  while (length > 0 && line[length - 1] == '\n')
+    line[--length] = 0;
+
+  return length;
+}
+
 bool Logger::init(const char* rootFolder)
 {
   // Do compile-time checks for the line and buffer sizes.
@@ -50,17 +427,56 @@ bool Logger::init(const char* rootFolder)
     strcpy(path, rootFolder);
   strcat(path, "log.txt");
   _file = util::openFile(NULL, path, "w");
+  _fileTime = 0;
+  _fileTimeText[0] = '\0';
 #endif
 
 #ifndef NDEBUG
   setLogLevel(RETRO_LOG_DEBUG);
 #endif
 
+  _stop = false;
+  _writer = std::thread(&Logger::writerThread, this);
+  _running = true;
+
   return true;
 }
 
 void Logger::destroy()
 {
+  if (_running)
+  {
+    {
+      std::lock_guard<std::mutex> lock(_writerMutex);
+      _stop = true;
+    }
+
+    _wakeWriter.notify_one();
+    _writer.join();
+    _running = false;
+
+    // Write anything that was logged while the writer thread was exiting.
+    Message* message = _queue.exchange(nullptr, std::memory_order_acquire);
+    Message* reversed = nullptr;
+
+    while (message)
+    {
+      Message* next = message->next;
+      message->next = reversed;
+      reversed = message;
+      message = next;
+    }
+
+    for (message = reversed; message; message = reversed)
+    {
+      reversed = message->next;
+      output(message);
+      free(message);
+    }
+
+    fflush(stdout);
+  }
+
 #ifdef LOG_TO_FILE
   if (_file)
   {
@@ -70,11 +486,257 @@ void Logger::destroy()
 #endif
 }
 
+void Logger::flush()
+{
+  if (!_running)
+    return;
+
+  const uint64_t numQueued = _numQueued.load(std::memory_order_relaxed);
+
+  std::unique_lock<std::mutex> lock(_writerMutex);
+  _wakeWriter.notify_one();
+  _written.wait(lock, [this, numQueued]() { return _numWritten >= numQueued || _stop; });
+}
+
+bool Logger::setLogLevels(const char* levels)
+{
+  bool ok = true;
+
+  while (*levels)
+  {
+    const char* end = strchr(levels, ',');
+    if (!end)
+      end = levels + strlen(levels);
+
+    const char* equals = (const char*)memchr(levels, '=', end - levels);
+    const char* name = equals ? equals + 1 : levels;
+    const size_t nameLength = end - name;
+
+    enum retro_log_level level;
+    if (nameLength == 5 && strncmp(name, "debug", 5) == 0)
+      level = RETRO_LOG_DEBUG;
+    else if (nameLength == 4 && strncmp(name, "info", 4) == 0)
+      level = RETRO_LOG_INFO;
+    else if (nameLength == 4 && strncmp(name, "warn", 4) == 0)
+      level = RETRO_LOG_WARN;
+    else if (nameLength == 5 && strncmp(name, "error", 5) == 0)
+      level = RETRO_LOG_ERROR;
+    else
+      level = RETRO_LOG_DUMMY;
+
+    if (level == RETRO_LOG_DUMMY)
+    {
+      ok = false;
+    }
+    else if (!equals)
+    {
+      setLogLevel(level);
+    }
+    else
+    {
+      // Accept the tag with or without the brackets.
+      char tag[16];
+      const char* tagStart = levels;
+      size_t tagLength = equals - levels;
+      if (tagLength >= 2 && tagStart[0] == '[' && tagStart[tagLength - 1] == ']')
+      {
+        tagStart++;
+        tagLength -= 2;
+      }
+
+      if (tagLength == 0 || tagLength + 3 > sizeof(tag))
+      {
+        ok = false;
+      }
+      else
+      {
+        tag[0] = '[';
+        memcpy(tag + 1, tagStart, tagLength);
+        tag[tagLength + 1] = ']';
+        tag[tagLength + 2] = '\0';
+
+        ok &= setLogLevel(tag, level);
+      }
+    }
+
+    levels = (*end == ',') ? end + 1 : end;
+  }
+
+  return ok;
+}
+
 void Logger::log(enum retro_log_level level, const char* line, size_t length)
+{
+#ifndef LOG_TO_FILE
+  // Debug messages only go to the log file.
+  if (level == RETRO_LOG_DEBUG)
+    return;
+#endif
+
+  Message* message = allocate(level, NULL, length);
+  if (!message)
+    return;
+
+  memcpy(message->data, line, length);
+  message->data[length] = 0;
+
+  push(message);
+}
+
+void Logger::logStructured(enum retro_log_level level, const char* fmt, va_list args)
+{
+#ifndef LOG_TO_FILE
+  // Debug messages only go to the log file.
+  if (level == RETRO_LOG_DEBUG)
+    return;
+#endif
+
+  // Without the writer thread the message is formatted right away, and goes through log so
+  // subclasses still see it.
+  if (!_running)
+  {
+    vprintf(level, fmt, args);
+    return;
+  }
+
+  uint8_t arguments[LOG_MAX_LINE_SIZE];
+  size_t length;
+
+  va_list copy;
+  va_copy(copy, args);
+  const bool captured = captureArguments(fmt, copy, arguments, sizeof(arguments), &length);
+  va_end(copy);
+
+  // Formats that aren't supported, or with very long strings, are formatted right away.
+  if (!captured)
+  {
+    vprintf(level, fmt, args);
+    return;
+  }
+
+  Message* message = allocate(level, fmt, length);
+  if (!message)
+    return;
+
+  memcpy(message->data, arguments, length);
+  push(message);
+}
+
+Logger::Message* Logger::allocate(enum retro_log_level level, const char* format, size_t length)
+{
+  Message* message = (Message*)malloc(offsetof(Message, data) + length + 1);
+  if (!message)
+    return NULL;
+
+  message->time = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+  message->format = format;
+  message->level = level;
+  message->length = length;
+  return message;
+}
+
+void Logger::push(Message* message)
+{
+  if (!_running)
+  {
+    // Not initialized or already destroyed, write the message right away.
+    output(message);
+    fflush(stdout);
+    free(message);
+    return;
+  }
+
+  Message* head = _queue.load(std::memory_order_relaxed);
+
+  do
+  {
+    message->next = head;
+  }
+  while (!_queue.compare_exchange_weak(head, message, std::memory_order_release, std::memory_order_relaxed));
+
+  _numQueued.fetch_add(1, std::memory_order_relaxed);
+
+  // Only wake the writer when the queue was empty, it'll take everything pushed until it runs. The
+  // mutex isn't held here, so a wake up can be missed if the writer is just about to sleep. The writer
+  // never sleeps for long so that only delays the message a little.
+  if (!head)
+    _wakeWriter.notify_one();
+}
+
+void Logger::writerThread()
+{
+  for (;;)
+  {
+    Message* message = _queue.exchange(nullptr, std::memory_order_acquire);
+
+    if (!message)
+    {
+      std::unique_lock<std::mutex> lock(_writerMutex);
+
+      if (_stop)
+        break;
+
+      _wakeWriter.wait_for(lock, std::chrono::milliseconds(100), [this]() {
+        return _stop || _queue.load(std::memory_order_relaxed) != nullptr;
+      });
+
+      continue;
+    }
+
+    // Messages were pushed in reverse order.
+    Message* reversed = nullptr;
+    uint64_t count = 0;
+
+    while (message)
+    {
+      Message* next = message->next;
+      message->next = reversed;
+      reversed = message;
+      message = next;
+      count++;
+    }
+
+    for (message = reversed; message; message = reversed)
+    {
+      reversed = message->next;
+      output(message);
+      free(message);
+    }
+
+    // Flush once per batch instead of once per message.
+    fflush(stdout);
+
+#if defined(LOG_TO_FILE) && !defined(NDEBUG)
+    if (_file)
+      fflush(_file);
+#endif
+
+    {
+      std::lock_guard<std::mutex> lock(_writerMutex);
+      _numWritten += count;
+    }
+
+    _written.notify_all();
+  }
+
+  _written.notify_all();
+}
+
+void Logger::output(const Message* message)
 {
   const char* desc = "?";
+  const char* line = message->data;
+  size_t length = message->length;
+
+  char formatted[LOG_MAX_LINE_SIZE];
+  if (message->format)
+  {
+    length = formatArguments(message->format, (const uint8_t*)message->data, formatted, sizeof(formatted));
+    line = formatted;
+  }
 
-  switch (level)
+  switch (message->level)
   {
   case RETRO_LOG_DEBUG: desc = "DEBUG"; break;
   case RETRO_LOG_INFO:  desc = "INFO "; break;
@@ -84,7 +746,7 @@ void Logger::log(enum retro_log_level level, const char* line, size_t length)
   }
 
   // Do not log debug messages to the internal buffer and the console.
-  if (level != RETRO_LOG_DEBUG)
+  if (message->level != RETRO_LOG_DEBUG)
   {
     // Log to the internal buffer.
     length += 3; // Add one byte for the level and two bytes for the length.
@@ -92,48 +754,52 @@ void Logger::log(enum retro_log_level level, const char* line, size_t length)
     if (length > RING_LOG_MAX_LINE_SIZE)
       length = RING_LOG_MAX_LINE_SIZE;
 
-    unsigned char meta[3];
-    if (length > _avail)
     {
-      do
+      std::lock_guard<std::mutex> lock(_bufferMutex);
+
+      // Keep one byte free, a full buffer would look empty since _first would be equal to _last.
+      unsigned char meta[3];
+      if (length >= _avail)
       {
-        // Remove content until we have enough space.
-        read(meta, 3);
-        skip(meta[1] | meta[2] << 8); // Little endian.
-      } while (length > _avail);
-    }
+        do
+        {
+          // Remove content until we have enough space.
+          read(meta, 3);
+          skip(meta[1] | meta[2] << 8); // Little endian.
+        } while (length >= _avail);
+      }
 
-    length -= 3;
+      length -= 3;
 
-    meta[0] = level;
-    meta[1] = length & 0xff;
-    meta[2] = (unsigned char)(length >> 8);
+      meta[0] = message->level;
+      meta[1] = length & 0xff;
+      meta[2] = (unsigned char)(length >> 8);
 
-    write(meta, 3);
-    write(line, length);
+      write(meta, 3);
+      write(line, length);
+    }
 
     // Log to the console.
     ::printf("[%s] %s\n", desc, line);
-    fflush(stdout);
   }
 
 #ifdef LOG_TO_FILE
   if (_file)
   {
-    const std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
-    const unsigned int now_ms = (unsigned int)
-      (std::chrono::time_point_cast<std::chrono::milliseconds>(now).time_since_epoch().count() % 1000);
-    const time_t now_timet = std::chrono::system_clock::to_time_t(now);
-    std::tm now_tm;
-    localtime_s(&now_tm, &now_timet);
-    char buffer[10];
-    strftime(buffer, sizeof(buffer), "%H%M%S", &now_tm);
+    const time_t now_timet = (time_t)(message->time / 1000);
+    const unsigned int now_ms = (unsigned int)(message->time % 1000);
+
+    // Only convert the time when the second changes.
+    if (now_timet != _fileTime || !_fileTimeText[0])
+    {
+      std::tm now_tm;
+      localtime_s(&now_tm, &now_timet);
+      strftime(_fileTimeText, sizeof(_fileTimeText), "%H%M%S", &now_tm);
+      _fileTime = now_timet;
+    }
 
     // Log to the log file.
-    fprintf(_file, "%s.%03u [%s] %s\n", buffer, now_ms, desc, line);
-#ifndef NDEBUG
-    fflush(_file);
-#endif
+    fprintf(_file, "%s.%03u [%s] %s\n", _fileTimeText, now_ms, desc, line);
   }
 #endif
 }
@@ -169,6 +835,7 @@ std::string Logger::contents() const
 
 void Logger::iterate(Iterator iterator, void* ud) const
 {
+  std::lock_guard<std::mutex> lock(_bufferMutex);
   size_t pos = _first;
   
   while (pos != _last)
@@ -21,8 +21,15 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "libretro/Components.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+
 #ifdef LOG_TO_FILE
 #include <stdio.h>
+#include <time.h>
 #endif
 
 // Must be at least MAX_LINE_SIZE + 3
@@ -30,19 +37,46 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 #define RING_LOG_MAX_BUFFER_SIZE 65536
 #endif
 
+// Messages can be logged from any thread. They're pushed onto a lock-free queue and written to the
+// internal buffer, the console and the log file by a background thread, so logging only costs the
+// caller the formatting and the push. Messages logged with debug, info, warn and error aren't even
+// formatted by the caller, only their arguments are copied and the writer thread formats them.
 class Logger: public libretro::LoggerComponent
 {
 public:
   bool init(const char* rootFolder);
   void destroy();
 
+  // Waits until every message logged so far has been written.
+  void flush();
+
+  // Sets levels from a comma separated list, i.e. "warn,MEM=debug". A level without a tag is the
+  // level for all messages.
+  bool setLogLevels(const char* levels);
+
   std::string contents() const;
   
   typedef bool (*Iterator)(enum retro_log_level level, const char* line, void* ud);
   void iterate(Iterator iterator, void* ud) const;
 
 protected:
+  struct Message
+  {
+    Message* next;
+    int64_t  time;       // Milliseconds since the epoch.
+    const char* format;  // If not NULL, data holds the arguments for format instead of the text.
+    enum retro_log_level level;
+    size_t   length;
+    char     data[1];
+  };
+
   void   log(enum retro_log_level level, const char* msg, size_t length) override;
+  void   logStructured(enum retro_log_level level, const char* fmt, va_list args) override;
+
+  Message* allocate(enum retro_log_level level, const char* format, size_t length);
+  void   push(Message* message);
+  void   output(const Message* message);
+  void   writerThread();
 
   void   write(const void* data, size_t size);
   void   read(void* data, size_t size);
@@ -55,11 +89,26 @@ protected:
   }
   
   char   _buffer[RING_LOG_MAX_BUFFER_SIZE];
-  size_t _avail;
-  size_t _first;
-  size_t _last;
+  size_t _avail = RING_LOG_MAX_BUFFER_SIZE;
+  size_t _first = 0;
+  size_t _last = 0;
+
+  mutable std::mutex _bufferMutex;
+
+  // Messages are pushed in reverse order, the writer thread takes the whole list at once.
+  std::atomic<Message*> _queue{nullptr};
+  std::atomic<uint64_t> _numQueued{0};
+  std::atomic<bool>     _running{false};
+  bool                  _stop = false;
+  uint64_t              _numWritten = 0;
+  std::mutex            _writerMutex;
+  std::condition_variable _wakeWriter;
+  std::condition_variable _written;
+  std::thread           _writer;
 
 #ifdef LOG_TO_FILE
-  FILE* _file;
+  FILE* _file = NULL;
+  time_t _fileTime = 0;
+  char   _fileTimeText[10] = "";
 #endif
 };
@@ -103,7 +103,7 @@ void Microphone::recordCallback(void* data, Uint8* stream, int len)
 
     spx_uint32_t in_frames = frames;
     spx_uint32_t out_frames = out_len;
-    sdlData->logger->debug(TAG "Resampling %u samples to %u", in_frames, out_frames);
+    LOG_DEBUG(sdlData->logger, TAG "Resampling %u samples to %u", in_frames, out_frames);
     error = speex_resampler_process_int(sdlData->resampler, 0, (const int16_t*)samples, &in_frames, output, &out_frames);
     if (error == RESAMPLER_ERR_SUCCESS)
     {
@@ -121,7 +121,7 @@ void Microphone::recordCallback(void* data, Uint8* stream, int len)
   size_t avail = sdlData->fifo.free();
   if (avail < output_size)
   {
-    sdlData->logger->debug(TAG "Waiting for FIFO (need %zu bytes but only %zu available), sleeping", output_size, avail);
+    LOG_DEBUG(sdlData->logger, TAG "Waiting for FIFO (need %zu bytes but only %zu available), sleeping", output_size, avail);
 
     const int MAX_WAIT = 250;
     int tries = MAX_WAIT;
@@ -138,7 +138,7 @@ void Microphone::recordCallback(void* data, Uint8* stream, int len)
       /* prevent infinite loop if fifo full */
       if (--tries == 0)
       {
-        sdlData->logger->debug(TAG "FIFO still full after %dms, flushing", MAX_WAIT);
+        LOG_DEBUG(sdlData->logger, TAG "FIFO still full after %dms, flushing", MAX_WAIT);
         sdlData->fifo.reset();
         avail = sdlData->fifo.free();
         break;
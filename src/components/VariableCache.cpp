@@ -0,0 +1,130 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "VariableCache.h"
+
+#include <string.h>
+
+/* enough for the variables of most cores without growing */
+#define VARIABLE_CACHE_INITIAL_SIZE 256
+
+uint32_t VariableCache::hash(const char* key, size_t length)
+{
+  /* variable names share long prefixes like "beetle_psx_hw_", so mix the length with the first and
+   * the last eight bytes instead of hashing every byte, the comparison takes care of collisions */
+  uint64_t head = 0, tail = 0;
+
+  if (length >= 8)
+  {
+    memcpy(&head, key, 8);
+    memcpy(&tail, key + length - 8, 8);
+  }
+  else
+  {
+    memcpy(&head, key, length);
+  }
+
+  uint64_t h = (head * 0x9E3779B97F4A7C15ULL) ^ (tail + length) * 0xC2B2AE3D27D4EB4FULL;
+  return (uint32_t)(h >> 32) ^ (uint32_t)h;
+}
+
+const char* VariableCache::find(const char* key) const
+{
+  if (_count == 0)
+    return NULL;
+
+  const size_t length = strlen(key);
+  const uint32_t h = hash(key, length);
+  const size_t mask = _entries.size() - 1;
+
+  for (size_t i = h & mask;; i = (i + 1) & mask)
+  {
+    const Entry& entry = _entries[i];
+
+    if (entry.key == NULL)
+      return NULL;
+
+    if (entry.hash == h && entry.length == length && memcmp(entry.key, key, length) == 0)
+      return entry.value;
+  }
+}
+
+void VariableCache::add(const char* key, const char* value)
+{
+  /* keep the load factor under 50% so misses end quickly */
+  if ((_count + 1) * 2 > _entries.size())
+    grow();
+
+  const size_t length = strlen(key);
+  const uint32_t h = hash(key, length);
+  const size_t mask = _entries.size() - 1;
+  size_t i = h & mask;
+
+  while (_entries[i].key != NULL)
+  {
+    if (_entries[i].hash == h && _entries[i].length == length && memcmp(_entries[i].key, key, length) == 0)
+    {
+      _entries[i].value = value;
+      return;
+    }
+
+    i = (i + 1) & mask;
+  }
+
+  _entries[i].key = key;
+  _entries[i].value = value;
+  _entries[i].length = length;
+  _entries[i].hash = h;
+  _count++;
+}
+
+void VariableCache::clear()
+{
+  if (_count == 0)
+    return;
+
+  for (auto& entry : _entries)
+    entry.key = NULL;
+
+  _count = 0;
+}
+
+void VariableCache::grow()
+{
+  std::vector<Entry> old;
+  old.swap(_entries);
+
+  const size_t size = old.empty() ? VARIABLE_CACHE_INITIAL_SIZE : old.size() * 2;
+  _entries.resize(size, Entry{NULL, NULL, 0, 0});
+
+  const size_t mask = size - 1;
+
+  for (const auto& entry : old)
+  {
+    if (entry.key != NULL)
+    {
+      size_t i = entry.hash & mask;
+
+      while (_entries[i].key != NULL)
+        i = (i + 1) & mask;
+
+      _entries[i] = entry;
+    }
+  }
+}
@@ -0,0 +1,58 @@
+/*
+Copyright (C) 2026 RALibretro contributors
+
+This file is part of RALibretro.
+
+RALibretro is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RALibretro is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/* Maps core variable names to their values without allocating. Both the keys and the values are
+ * pointers to strings owned by someone else (the Config selections and variables), so the cache must
+ * be cleared whenever those strings change. Lookups hash the name and compare its contents, so
+ * cores can pass any buffer, not only string literals. */
+class VariableCache
+{
+public:
+  /* returns NULL if the variable isn't in the cache */
+  const char* find(const char* key) const;
+
+  /* key and value must remain valid until the cache is cleared */
+  void add(const char* key, const char* value);
+
+  void clear();
+
+  size_t size() const { return _count; }
+
+protected:
+  struct Entry
+  {
+    const char* key;   /* NULL if the slot is empty */
+    const char* value;
+    size_t      length;
+    uint32_t    hash;
+  };
+
+  static uint32_t hash(const char* key, size_t length);
+
+  void grow();
+
+  std::vector<Entry> _entries; /* open addressing with linear probing, size is a power of two */
+  size_t _count = 0;
+};
@@ -24,6 +24,7 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 #include "BitmapFont.h"
 
 #include "Dialog.h"
+#include "Profiler.h"
 #include "jsonsax/jsonsax.h"
 
 #include <SDL_render.h>
@@ -39,11 +40,54 @@ along with RALibretro.  If not, see <http://www.gnu.org/licenses/>.
 #define OSD_SPEED_INDICATOR_HEIGHT 32
 #define OSD_SPEED_INDICATOR_PADDING 6
 
+/* the font texture has the glyphs from 0x20 to 0x80 in rows of 16 */
+#define OSD_FONT_FIRST_GLYPH 0x20
+#define OSD_FONT_LAST_GLYPH 0x80
+#define OSD_FONT_COLUMNS 16
+#define OSD_FONT_WIDTH (OSD_FONT_COLUMNS * OSD_CHAR_WIDTH)
+#define OSD_FONT_HEIGHT (8 * OSD_CHAR_HEIGHT)
+
+#define OSD_OVERLAY_COLUMNS 32
+#define OSD_OVERLAY_ROWS 3
+#define OSD_OVERLAY_WIDTH (OSD_OVERLAY_COLUMNS * OSD_CHAR_WIDTH)
+#define OSD_OVERLAY_HEIGHT (OSD_OVERLAY_ROWS * OSD_CHAR_HEIGHT)
+#define OSD_OVERLAY_GRAPH_WIDTH 256 /* must be a power of two to wrap around */
+#define OSD_OVERLAY_GRAPH_HEIGHT 48
+#define OSD_OVERLAY_UPDATE_FRAMES 15
+
+#define OSD_COLOR_TEXT 0xFFFF
+#define OSD_COLOR_CORE 0x07E0
+#define OSD_COLOR_ACHIEVEMENTS 0xFFE0
+#define OSD_COLOR_WAIT 0x4208
+#define OSD_COLOR_TARGET 0xF800
+
 struct VertexData
 {
   float x, y, u, v;
 };
 
+static unsigned getGlyphIndex(unsigned char c)
+{
+  if (c < OSD_FONT_FIRST_GLYPH || c > OSD_FONT_LAST_GLYPH)
+    c = OSD_FONT_LAST_GLYPH;
+
+  return c - OSD_FONT_FIRST_GLYPH;
+}
+
+static void rasterizeGlyph(uint16_t* out, size_t pitch, unsigned char c)
+{
+  const uint8_t* in = &_bitmapFont[getGlyphIndex(c) * OSD_CHAR_HEIGHT];
+  for (int j = 0; j < OSD_CHAR_HEIGHT; j++)
+  {
+    const uint8_t pixels = *in++;
+
+    for (int i = 0; i < OSD_CHAR_WIDTH; i++)
+      out[i] = (pixels & (0x80 >> i)) ? OSD_COLOR_TEXT : 0;
+
+    out += pitch;
+  }
+}
+
 Video::Video()
 {
   _enabled = true;
@@ -58,11 +102,19 @@ Video::Video()
   _rotation = Rotation::None;
   _rotationHandler = NULL;
 
-  memset(_messageTexture, 0, sizeof(_messageTexture));
-  memset(_messageWidth, 0, sizeof(_messageWidth));
+  _fontTexture = _messageVertexBuffer = 0;
+  _numMessageVertices = 0;
+  _messageBatchWidth = _messageBatchHeight = 0;
+  memset(_messageText, 0, sizeof(_messageText));
+  memset(_messageLength, 0, sizeof(_messageLength));
   memset(_messageFrames, 0, sizeof(_messageFrames));
   _numMessages = 0;
 
+  _overlayGraphTexture = _overlayVertexBuffer = 0;
+  _overlayGraphColumn = _overlayFrames = 0;
+  memset(&_overlayTotals, 0, sizeof(_overlayTotals));
+  memset(_overlayText, ' ', sizeof(_overlayText));
+
   _preserveAspect = true;
   _linearFilter = false;
 
@@ -100,6 +152,30 @@ bool Video::init(libretro::LoggerComponent* logger, libretro::VideoContextCompon
   Gl::bufferData(GL_ARRAY_BUFFER, sizeof(vertexData), vertexData, GL_STATIC_DRAW);
   Gl::bindBuffer(GL_ARRAY_BUFFER, 0);
 
+  Gl::genBuffers(1, &_messageVertexBuffer);
+
+  _fontTexture = GlUtil::createTexture(OSD_FONT_WIDTH, OSD_FONT_HEIGHT, GL_RGB, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, GL_NEAREST);
+  if (_fontTexture != 0)
+  {
+    uint16_t glyph[OSD_CHAR_WIDTH * OSD_CHAR_HEIGHT];
+
+    for (unsigned c = OSD_FONT_FIRST_GLYPH; c <= OSD_FONT_LAST_GLYPH; c++)
+    {
+      const unsigned index = getGlyphIndex(c);
+      rasterizeGlyph(glyph, OSD_CHAR_WIDTH, c);
+      Gl::texSubImage2D(GL_TEXTURE_2D, 0, (index % OSD_FONT_COLUMNS) * OSD_CHAR_WIDTH, (index / OSD_FONT_COLUMNS) * OSD_CHAR_HEIGHT,
+        OSD_CHAR_WIDTH, OSD_CHAR_HEIGHT, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, glyph);
+    }
+
+    Gl::bindTexture(GL_TEXTURE_2D, 0);
+  }
+
+  if (!Gl::ok())
+  {
+    destroy();
+    return false;
+  }
+
   return true;
 }
 
@@ -112,15 +188,21 @@ void Video::destroy()
     _texture = 0;
   }
 
-  for (unsigned i = 0; i < _numMessages; ++i)
+  _numMessages = 0;
+  _numMessageVertices = 0;
+  _messageBatchWidth = _messageBatchHeight = 0;
+
+  if (_fontTexture != 0)
+  {
+    Gl::deleteTextures(1, &_fontTexture);
+    _fontTexture = 0;
+  }
+
+  if (_messageVertexBuffer != 0)
   {
-    if (_messageTexture[i] != 0)
-    {
-      Gl::deleteTextures(1, &_messageTexture[i]);
-      _messageTexture[i] = 0;
-    }
+    Gl::deleteBuffers(1, &_messageVertexBuffer);
+    _messageVertexBuffer = 0;
   }
-  _numMessages = 0;
 
   if (_speedIndicatorTexture != 0)
   {
@@ -128,6 +210,8 @@ void Video::destroy()
     _texture = 0;
   }
 
+  destroyOverlay();
+
   if (_vertexArray != 0)
   {
     Gl::deleteVertexArrays(1, &_vertexArray);
@@ -200,6 +284,8 @@ void Video::draw(bool force)
 {
   if (_texture != 0 && (force || _enabled))
   {
+    PROFILE_PHASE(VideoDraw);
+
     Gl::bindFramebuffer(GL_FRAMEBUFFER, 0);
     Gl::viewport(0, 0, _windowWidth, _windowHeight);
     Gl::clearColor(0.0, 0.0, 0.0, 1.0);
@@ -215,7 +301,7 @@ void Video::draw(bool force)
 
     Gl::drawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
-    if (_numMessages != 0 || _speedIndicatorTexture != 0)
+    if (_numMessages != 0 || _speedIndicatorTexture != 0 || _overlayGraphTexture != 0)
     {
       Gl::bindBuffer(GL_ARRAY_BUFFER, _indentityVertexBuffer);
       Gl::enableVertexAttribArray(_posAttribute);
@@ -233,37 +319,50 @@ void Video::draw(bool force)
         Gl::drawArrays(GL_TRIANGLE_STRIP, 0, 4);
       }
 
-      const GLint messageHeight = (OSD_PADDING + OSD_CHAR_HEIGHT + OSD_PADDING);
-      const GLint x = 8;
-      GLint y = 8;
-
-      for (int i = _numMessages - 1; i >= 0; --i)
+      if (_numMessages != 0 || _overlayGraphTexture != 0)
       {
-        Gl::viewport(x, y, _messageWidth[i], messageHeight);
-        Gl::bindTexture(GL_TEXTURE_2D, _messageTexture[i]);
-        Gl::uniform1i(_texUniform, 0);
-        Gl::drawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        if (_messageBatchWidth != _windowWidth || _messageBatchHeight != _windowHeight)
+          buildMessageBatch();
 
-        y += messageHeight + 4;
+        Gl::viewport(0, 0, _windowWidth, _windowHeight);
+        Gl::bindBuffer(GL_ARRAY_BUFFER, _messageVertexBuffer);
+        Gl::vertexAttribPointer(_posAttribute, 2, GL_FLOAT, GL_FALSE, sizeof(VertexData), (const GLvoid*)offsetof(VertexData, x));
+        Gl::vertexAttribPointer(_uvAttribute, 2, GL_FLOAT, GL_FALSE, sizeof(VertexData), (const GLvoid*)offsetof(VertexData, u));
+        Gl::bindBuffer(GL_ARRAY_BUFFER, 0);
 
-        if (--_messageFrames[i] == 0)
-        {
-          Gl::deleteTextures(1, &_messageTexture[i]);
+        Gl::bindTexture(GL_TEXTURE_2D, _fontTexture);
+        Gl::uniform1i(_texUniform, 0);
+        Gl::drawArrays(GL_TRIANGLES, 0, _numMessageVertices);
 
-          --_numMessages;
-          for (int j = i; j < (int)_numMessages; ++j)
+        for (int i = _numMessages - 1; i >= 0; --i)
+        {
+          if (--_messageFrames[i] == 0)
           {
-            _messageTexture[j] = _messageTexture[j + 1];
-            _messageWidth[j] = _messageWidth[j + 1];
-            _messageFrames[j] = _messageFrames[j + 1];
+            --_numMessages;
+            for (int j = i; j < (int)_numMessages; ++j)
+            {
+              memcpy(_messageText[j], _messageText[j + 1], sizeof(_messageText[j]));
+              _messageLength[j] = _messageLength[j + 1];
+              _messageFrames[j] = _messageFrames[j + 1];
+            }
+
+            _messageLength[_numMessages] = 0;
+            _messageFrames[_numMessages] = 0;
+
+            // force the batch to be rebuilt
+            _messageBatchWidth = _messageBatchHeight = 0;
           }
-
-          _messageTexture[_numMessages] = 0;
-          _messageWidth[_numMessages] = 0;
-          _messageFrames[_numMessages] = 0;
         }
+
+        Gl::bindBuffer(GL_ARRAY_BUFFER, _indentityVertexBuffer);
+        Gl::vertexAttribPointer(_posAttribute, 2, GL_FLOAT, GL_FALSE, sizeof(VertexData), (const GLvoid*)offsetof(VertexData, x));
+        Gl::vertexAttribPointer(_uvAttribute, 2, GL_FLOAT, GL_FALSE, sizeof(VertexData), (const GLvoid*)offsetof(VertexData, u));
+        Gl::bindBuffer(GL_ARRAY_BUFFER, 0);
       }
 
+      if (_overlayGraphTexture != 0)
+        drawOverlay();
+
       Gl::bindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
       Gl::enableVertexAttribArray(_posAttribute);
       Gl::vertexAttribPointer(_posAttribute, 2, GL_FLOAT, GL_FALSE, sizeof(VertexData), (const GLvoid*)offsetof(VertexData, x));
@@ -276,6 +375,7 @@ void Video::draw(bool force)
     Gl::bindVertexArray(0);
     Gl::useProgram(0);
 
+    PROFILE_PHASE(SwapBuffers);
     _ctx->swapBuffers();
   }
 }
@@ -309,7 +409,7 @@ void Video::refresh(const void* data, unsigned width, unsigned height, size_t pi
 {
   if (data == NULL)
   {
-    _logger->debug(TAG "Refresh not performed, data is NULL");
+    LOG_DEBUG(_logger, TAG "Refresh not performed, data is NULL");
   }
   else if (data != RETRO_HW_FRAME_BUFFER_VALID)
   {
@@ -345,7 +445,7 @@ void Video::refresh(const void* data, unsigned width, unsigned height, size_t pi
     Gl::pixelStorei(GL_UNPACK_ROW_LENGTH, 0);
     Gl::bindTexture(GL_TEXTURE_2D, 0);
 
-    _logger->debug(TAG "Texture refreshed with %u x %u pixels", width, height);
+    LOG_DEBUG(_logger, TAG "Texture refreshed with %u x %u pixels", width, height);
 
     ensureView(width, height, _windowWidth, _windowHeight, _preserveAspect, _rotation);
     draw();
@@ -388,7 +488,7 @@ bool Video::supportsContext(enum retro_hw_context_type type)
 
 uintptr_t Video::getCurrentFramebuffer()
 {
-  _logger->debug(TAG "getCurrentFramebuffer() => %u", _hw.frameBuffer);
+  LOG_DEBUG(_logger, TAG "getCurrentFramebuffer() => %u", _hw.frameBuffer);
   return _hw.frameBuffer;
 }
 
@@ -406,80 +506,114 @@ void Video::showMessage(const char* msg, unsigned frames)
   if (frames == 0)
     return;
 
-  if (_numMessages == sizeof(_messageTexture) / sizeof(_messageTexture[0]))
+  if (_numMessages == sizeof(_messageText) / sizeof(_messageText[0]))
   {
     /* list full, discard oldest */
-    Gl::deleteTextures(1, &_messageTexture[0]);
-
     --_numMessages;
     for (unsigned i = 0; i < _numMessages; ++i)
     {
-      _messageTexture[i] = _messageTexture[i + 1];
-      _messageWidth[i] = _messageWidth[i + 1];
+      memcpy(_messageText[i], _messageText[i + 1], sizeof(_messageText[i]));
+      _messageLength[i] = _messageLength[i + 1];
       _messageFrames[i] = _messageFrames[i + 1];
     }
   }
 
-  const size_t len = strlen(msg);
-  const size_t messageHeight = OSD_PADDING + OSD_CHAR_HEIGHT + OSD_PADDING;
-  const size_t messageWidth = OSD_PADDING + len * OSD_CHAR_WIDTH + OSD_PADDING;
-  const size_t numBytes = messageWidth * messageHeight * 2;
+  /* messages longer than the buffer are truncated, they'd hardly fit the window anyway */
+  size_t len = strlen(msg);
+  if (len >= sizeof(_messageText[0]))
+    len = sizeof(_messageText[0]) - 1;
 
-  uint16_t* data = (uint16_t*)malloc(numBytes);
-  if (!data)
+  memcpy(_messageText[_numMessages], msg, len);
+  _messageText[_numMessages][len] = '\0';
+  _messageLength[_numMessages] = len;
+  _messageFrames[_numMessages] = frames;
+  ++_numMessages;
+
+  // force the batch to be rebuilt
+  _messageBatchWidth = _messageBatchHeight = 0;
+}
+
+void Video::buildMessageBatch()
+{
+  /* two triangles for the background of each message and for each of its characters, and the same
+   * for the text of the performance overlay */
+  static VertexData vertexData[(sizeof(_messageText) / sizeof(_messageText[0][0]) + sizeof(_overlayText) / sizeof(_overlayText[0][0]) + 1) * 6];
+  VertexData* vertex = vertexData;
+
+  const float scaleX = 2.0f / _windowWidth;
+  const float scaleY = 2.0f / _windowHeight;
+
+  const auto addQuad = [&](int x, int y, int width, int height, float u0, float v0, float u1, float v1)
   {
-    _numMessages--;
-    return;
-  }
+    const float x0 = x * scaleX - 1.0f;
+    const float y0 = y * scaleY - 1.0f;
+    const float x1 = (x + width) * scaleX - 1.0f;
+    const float y1 = (y + height) * scaleY - 1.0f;
+
+    /* the texture's first row is at the top */
+    *vertex++ = {x0, y0, u0, v1};
+    *vertex++ = {x0, y1, u0, v0};
+    *vertex++ = {x1, y0, u1, v1};
+    *vertex++ = {x1, y0, u1, v1};
+    *vertex++ = {x0, y1, u0, v0};
+    *vertex++ = {x1, y1, u1, v0};
+  };
 
-  memset(data, 0, numBytes);
+  /* the space glyph is blank, its top left pixel paints the background */
+  const float backgroundU = 0.5f / OSD_FONT_WIDTH;
+  const float backgroundV = 0.5f / OSD_FONT_HEIGHT;
 
-  uint16_t* start = &data[messageWidth * OSD_PADDING + OSD_PADDING];
-  for (size_t i = 0; i < len; i++)
+  const auto addGlyph = [&](int x, int y, unsigned char c)
   {
-    uint16_t* out = &start[i * OSD_CHAR_WIDTH];
-    char c = msg[i];
-    if (c < 0x20 || c > 0x7F)
-      c = 0x80;
-    uint8_t* in = &_bitmapFont[(c - 0x20) * 16];
-    for (int j = 0; j < OSD_CHAR_HEIGHT; j++)
+    const unsigned index = getGlyphIndex(c);
+    if (index == 0)
+      return;
+
+    const float u0 = (float)((index % OSD_FONT_COLUMNS) * OSD_CHAR_WIDTH) / OSD_FONT_WIDTH;
+    const float v0 = (float)((index / OSD_FONT_COLUMNS) * OSD_CHAR_HEIGHT) / OSD_FONT_HEIGHT;
+    const float u1 = u0 + (float)OSD_CHAR_WIDTH / OSD_FONT_WIDTH;
+    const float v1 = v0 + (float)OSD_CHAR_HEIGHT / OSD_FONT_HEIGHT;
+
+    addQuad(x, y, OSD_CHAR_WIDTH, OSD_CHAR_HEIGHT, u0, v0, u1, v1);
+  };
+
+  /* the performance overlay text goes in the top left corner, above its graph */
+  if (_overlayGraphTexture != 0)
+  {
+    const int top = (int)_windowHeight - 8;
+    addQuad(8, top - OSD_OVERLAY_HEIGHT, OSD_OVERLAY_WIDTH, OSD_OVERLAY_HEIGHT, backgroundU, backgroundV, backgroundU, backgroundV);
+
+    for (unsigned row = 0; row < OSD_OVERLAY_ROWS; row++)
     {
-      uint8_t pixels = *in++;
-
-      out[7] = 0xFFFF * (pixels & 0x01); pixels >>= 1;
-      out[6] = 0xFFFF * (pixels & 0x01); pixels >>= 1;
-      out[5] = 0xFFFF * (pixels & 0x01); pixels >>= 1;
-      out[4] = 0xFFFF * (pixels & 0x01); pixels >>= 1;
-      out[3] = 0xFFFF * (pixels & 0x01); pixels >>= 1;
-      out[2] = 0xFFFF * (pixels & 0x01); pixels >>= 1;
-      out[1] = 0xFFFF * (pixels & 0x01); pixels >>= 1;
-      out[0] = 0xFFFF * (pixels & 0x01);
-
-      out += messageWidth;
+      for (unsigned column = 0; column < OSD_OVERLAY_COLUMNS; column++)
+        addGlyph(8 + column * OSD_CHAR_WIDTH, top - (int)(row + 1) * OSD_CHAR_HEIGHT, (unsigned char)_overlayText[row][column]);
     }
   }
 
-  _ctx->enableCoreContext(false);
+  const int messageHeight = OSD_PADDING + OSD_CHAR_HEIGHT + OSD_PADDING;
+  const int x = 8;
+  int y = 8;
 
-  const GLuint texture = GlUtil::createTexture(messageWidth, messageHeight, GL_RGB, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, GL_NEAREST);
-  if (texture)
+  /* newest message at the bottom */
+  for (int i = _numMessages - 1; i >= 0; --i)
   {
-    _messageTexture[_numMessages] = texture;
-    _messageFrames[_numMessages] = frames;
-    _messageWidth[_numMessages] = messageWidth;
-    ++_numMessages;
+    const unsigned len = _messageLength[i];
+    addQuad(x, y, OSD_PADDING + len * OSD_CHAR_WIDTH + OSD_PADDING, messageHeight, backgroundU, backgroundV, backgroundU, backgroundV);
 
-    Gl::bindTexture(GL_TEXTURE_2D, texture);
-    Gl::pixelStorei(GL_UNPACK_ROW_LENGTH, messageWidth);
-    Gl::texSubImage2D(GL_TEXTURE_2D, 0, 0, 0, messageWidth, messageHeight, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, data);
+    for (unsigned j = 0; j < len; j++)
+      addGlyph(x + OSD_PADDING + j * OSD_CHAR_WIDTH, y + OSD_PADDING, (unsigned char)_messageText[i][j]);
 
-    Gl::pixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-    Gl::bindTexture(GL_TEXTURE_2D, 0);
+    y += messageHeight + 4;
   }
 
-  _ctx->enableCoreContext(true);
+  _numMessageVertices = (GLsizei)(vertex - vertexData);
 
-  free(data);
+  Gl::bindBuffer(GL_ARRAY_BUFFER, _messageVertexBuffer);
+  Gl::bufferData(GL_ARRAY_BUFFER, _numMessageVertices * sizeof(VertexData), vertexData, GL_DYNAMIC_DRAW);
+  Gl::bindBuffer(GL_ARRAY_BUFFER, 0);
+
+  _messageBatchWidth = _windowWidth;
+  _messageBatchHeight = _windowHeight;
 }
 
 void Video::showSpeedIndicator(Speed indicator)
@@ -565,6 +699,196 @@ void Video::showSpeedIndicator(Speed indicator)
   free(data);
 }
 
+void Video::showPerformanceOverlay(bool show)
+{
+  if (show == isPerformanceOverlayVisible())
+    return;
+
+  _ctx->enableCoreContext(false);
+
+  if (!show)
+  {
+    destroyOverlay();
+    _logger->info(TAG "Performance overlay hidden");
+  }
+  else if (!createOverlay())
+  {
+    _logger->error(TAG "Could not create the performance overlay");
+    destroyOverlay();
+  }
+  else
+  {
+    _logger->info(TAG "Performance overlay shown");
+  }
+
+  _ctx->enableCoreContext(true);
+}
+
+bool Video::createOverlay()
+{
+  _overlayGraphTexture = GlUtil::createTexture(OSD_OVERLAY_GRAPH_WIDTH, OSD_OVERLAY_GRAPH_HEIGHT, GL_RGB, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, GL_NEAREST);
+  Gl::genBuffers(1, &_overlayVertexBuffer);
+
+  if (_overlayGraphTexture == 0 || _overlayVertexBuffer == 0)
+    return false;
+
+  /* the graph starts blank, after that only the column that changes is uploaded */
+  static const uint16_t blank[OSD_OVERLAY_GRAPH_WIDTH * OSD_OVERLAY_GRAPH_HEIGHT] = { 0 };
+
+  Gl::bindTexture(GL_TEXTURE_2D, _overlayGraphTexture);
+  Gl::texParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  Gl::texSubImage2D(GL_TEXTURE_2D, 0, 0, 0, OSD_OVERLAY_GRAPH_WIDTH, OSD_OVERLAY_GRAPH_HEIGHT, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, blank);
+  Gl::bindTexture(GL_TEXTURE_2D, 0);
+
+  memset(_overlayText, ' ', sizeof(_overlayText));
+  memset(&_overlayTotals, 0, sizeof(_overlayTotals));
+  _overlayGraphColumn = 0;
+  _overlayFrames = 0;
+
+  // force the batch to be rebuilt with the overlay text
+  _messageBatchWidth = _messageBatchHeight = 0;
+
+  scrollOverlayGraph();
+  return Gl::ok();
+}
+
+void Video::destroyOverlay()
+{
+  if (_overlayGraphTexture != 0)
+  {
+    Gl::deleteTextures(1, &_overlayGraphTexture);
+    _overlayGraphTexture = 0;
+  }
+
+  if (_overlayVertexBuffer != 0)
+  {
+    Gl::deleteBuffers(1, &_overlayVertexBuffer);
+    _overlayVertexBuffer = 0;
+  }
+
+  // force the batch to be rebuilt without the overlay text
+  _messageBatchWidth = _messageBatchHeight = 0;
+}
+
+void Video::scrollOverlayGraph()
+{
+  /* the column after the newest one is the oldest, it goes on the left */
+  const float u0 = (float)((_overlayGraphColumn + 1) & (OSD_OVERLAY_GRAPH_WIDTH - 1)) / OSD_OVERLAY_GRAPH_WIDTH;
+  const float u1 = u0 + 1.0f;
+
+  const VertexData vertexData[] = {
+    {-1.0f, -1.0f, u0, 1.0f},
+    {-1.0f,  1.0f, u0, 0.0f},
+    { 1.0f, -1.0f, u1, 1.0f},
+    { 1.0f,  1.0f, u1, 0.0f}
+  };
+
+  Gl::bindBuffer(GL_ARRAY_BUFFER, _overlayVertexBuffer);
+  Gl::bufferData(GL_ARRAY_BUFFER, sizeof(vertexData), vertexData, GL_STREAM_DRAW);
+  Gl::bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Video::setOverlayText(unsigned row, const char* text)
+{
+  for (unsigned column = 0; column < OSD_OVERLAY_COLUMNS; column++)
+  {
+    const char c = *text ? *text++ : ' ';
+
+    if (c != _overlayText[row][column])
+    {
+      _overlayText[row][column] = c;
+
+      // force the batch to be rebuilt
+      _messageBatchWidth = _messageBatchHeight = 0;
+    }
+  }
+}
+
+void Video::updatePerformanceOverlay(const PerformanceStats& stats)
+{
+  if (_overlayGraphTexture == 0)
+    return;
+
+  _ctx->enableCoreContext(false);
+
+  /* one column of the graph per frame: the core and the achievements stacked from the bottom, then
+   * the time spent waiting for vsync or the audio, on a scale of two target frames */
+  uint16_t column[OSD_OVERLAY_GRAPH_HEIGHT];
+  const double scale = OSD_OVERLAY_GRAPH_HEIGHT / (stats.targetFrameTime * 2.0);
+  const int core = (int)(stats.coreTime * scale + 0.5);
+  const int achievements = core + (int)(stats.achievementsTime * scale + 0.5);
+  const int frame = (int)(stats.frameTime * scale + 0.5);
+
+  for (int i = 0; i < OSD_OVERLAY_GRAPH_HEIGHT; i++)
+  {
+    const int height = OSD_OVERLAY_GRAPH_HEIGHT - i;
+
+    if (height <= core)
+      column[i] = OSD_COLOR_CORE;
+    else if (height <= achievements)
+      column[i] = OSD_COLOR_ACHIEVEMENTS;
+    else if (height <= frame)
+      column[i] = OSD_COLOR_WAIT;
+    else if (height == OSD_OVERLAY_GRAPH_HEIGHT / 2)
+      column[i] = OSD_COLOR_TARGET;
+    else
+      column[i] = 0;
+  }
+
+  /* rows of a single RGB565 pixel aren't aligned to four bytes */
+  Gl::bindTexture(GL_TEXTURE_2D, _overlayGraphTexture);
+  Gl::pixelStorei(GL_UNPACK_ALIGNMENT, 2);
+  Gl::texSubImage2D(GL_TEXTURE_2D, 0, _overlayGraphColumn, 0, 1, OSD_OVERLAY_GRAPH_HEIGHT, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, column);
+  Gl::pixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  scrollOverlayGraph();
+  _overlayGraphColumn = (_overlayGraphColumn + 1) & (OSD_OVERLAY_GRAPH_WIDTH - 1);
+
+  /* the text shows averages, and is only updated a few times per second so it can be read */
+  _overlayTotals.frameTime += stats.frameTime;
+  _overlayTotals.coreTime += stats.coreTime;
+  _overlayTotals.achievementsTime += stats.achievementsTime;
+
+  if (++_overlayFrames == OSD_OVERLAY_UPDATE_FRAMES)
+  {
+    const double frameTime = _overlayTotals.frameTime / OSD_OVERLAY_UPDATE_FRAMES;
+    char text[OSD_OVERLAY_COLUMNS + 1];
+
+    snprintf(text, sizeof(text), "%6.2f fps %6.2f ms", frameTime > 0.0 ? 1000.0 / frameTime : 0.0, frameTime);
+    setOverlayText(0, text);
+
+    snprintf(text, sizeof(text), "core %6.2f ms  ra %6.2f ms", _overlayTotals.coreTime / OSD_OVERLAY_UPDATE_FRAMES,
+      _overlayTotals.achievementsTime / OSD_OVERLAY_UPDATE_FRAMES);
+    setOverlayText(1, text);
+
+    snprintf(text, sizeof(text), "audio %3d%%  ratio %.6f", (int)(stats.audioFill * 100.0 + 0.5), stats.resamplerRatio);
+    setOverlayText(2, text);
+
+    memset(&_overlayTotals, 0, sizeof(_overlayTotals));
+    _overlayFrames = 0;
+  }
+
+  Gl::bindTexture(GL_TEXTURE_2D, 0);
+  _ctx->enableCoreContext(true);
+}
+
+void Video::drawOverlay()
+{
+  /* top left corner, under the text drawn with the messages */
+  const GLint x = 8;
+  const GLint y = (GLint)_windowHeight - 8 - OSD_OVERLAY_HEIGHT - OSD_OVERLAY_GRAPH_HEIGHT;
+
+  Gl::bindBuffer(GL_ARRAY_BUFFER, _overlayVertexBuffer);
+  Gl::vertexAttribPointer(_posAttribute, 2, GL_FLOAT, GL_FALSE, sizeof(VertexData), (const GLvoid*)offsetof(VertexData, x));
+  Gl::vertexAttribPointer(_uvAttribute, 2, GL_FLOAT, GL_FALSE, sizeof(VertexData), (const GLvoid*)offsetof(VertexData, u));
+  Gl::bindBuffer(GL_ARRAY_BUFFER, 0);
+
+  Gl::viewport(x, y, OSD_OVERLAY_GRAPH_WIDTH, OSD_OVERLAY_GRAPH_HEIGHT);
+  Gl::bindTexture(GL_TEXTURE_2D, _overlayGraphTexture);
+  Gl::uniform1i(_texUniform, 0);
+  Gl::drawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
 void Video::windowResized(unsigned width, unsigned height)
 {
   _ctx->enableCoreContext(false);
@@ -51,6 +51,20 @@ public:
 
   virtual void showSpeedIndicator(Speed visibleIndicator) override;
 
+  struct PerformanceStats
+  {
+    double frameTime;        // ms between the start of the last two frames
+    double targetFrameTime;  // ms per frame at the core's frame rate
+    double coreTime;         // ms running the core
+    double achievementsTime; // ms processing achievements
+    double audioFill;        // fraction of the audio FIFO in use
+    double resamplerRatio;
+  };
+
+  void showPerformanceOverlay(bool show);
+  bool isPerformanceOverlayVisible() const { return _overlayGraphTexture != 0; }
+  void updatePerformanceOverlay(const PerformanceStats& stats);
+
   void windowResized(unsigned width, unsigned height);
   void getFramebufferSize(unsigned* width, unsigned* height, enum retro_pixel_format* format);
   const void* getFramebuffer(unsigned* width, unsigned* height, unsigned* pitch, enum retro_pixel_format* format);
@@ -85,6 +99,14 @@ protected:
   bool ensureView(unsigned width, unsigned height, unsigned windowWidth, unsigned windowHeight, bool preserveAspect, Rotation rotation);
   void clearErrors();
 
+  void buildMessageBatch();
+
+  bool createOverlay();
+  void destroyOverlay();
+  void scrollOverlayGraph();
+  void setOverlayText(unsigned row, const char* text);
+  void drawOverlay();
+
   libretro::LoggerComponent* _logger;
   libretro::VideoContextComponent* _ctx;
   Config* _config;
@@ -100,12 +122,28 @@ protected:
   GLuint                  _indentityVertexBuffer;
   GLuint                  _texture;
 
-  GLuint                  _messageTexture[4];
-  unsigned                _messageWidth[4];
+  // Messages and the performance overlay text are drawn with a single draw call from quads that
+  // sample the font texture. The quads are only rebuilt when a message is added or removed, when
+  // the overlay text changes, or when the window is resized.
+  GLuint                  _fontTexture;
+  GLuint                  _messageVertexBuffer;
+  GLsizei                 _numMessageVertices;
+  unsigned                _messageBatchWidth;
+  unsigned                _messageBatchHeight;
+  char                    _messageText[4][128];
+  unsigned                _messageLength[4];
   unsigned                _messageFrames[4];
   unsigned                _numMessages;
   GLuint                  _speedIndicatorTexture;
 
+  // The frame time graph of the performance overlay is uploaded one column per frame.
+  GLuint                  _overlayGraphTexture;
+  GLuint                  _overlayVertexBuffer;
+  unsigned                _overlayGraphColumn;
+  unsigned                _overlayFrames;
+  PerformanceStats        _overlayTotals;
+  char                    _overlayText[3][32];
+
   unsigned                _windowWidth;
   unsigned                _windowHeight;
   unsigned                _textureWidth;
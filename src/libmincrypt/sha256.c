@@ -25,14 +25,31 @@
 ** ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
-// Optimized for minimal code size.
+// Optimized for minimal code size. Blocks are processed with the SHA extensions or the ARMv8 SHA2
+// instructions when the processor supports them.
 
 #include "sha256.h"
+#include "../CpuFeatures.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
 
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define HAVE_SHA256_X86
+#include <immintrin.h>
+
+#ifdef __GNUC__
+#define SHA256_TARGET __attribute__((target("sha,ssse3,sse4.1")))
+#else
+#define SHA256_TARGET
+#endif
+#elif defined(_M_ARM64) || defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO)
+// gcc and clang only provide the intrinsics if the crypto extension is enabled for the file
+#define HAVE_SHA256_ARM64
+#include <arm_neon.h>
+#endif
+
 #define ror(value, bits) (((value) >> (bits)) | ((value) << (32 - (bits))))
 #define shr(value, bits) ((value) >> (bits))
 
@@ -54,10 +71,9 @@ static const uint32_t K[64] = {
     0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
     0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
 
-static void SHA256_Transform(SHA256_CTX* ctx) {
+static void SHA256_Transform_portable(uint32_t state[8], const uint8_t* p) {
     uint32_t W[64];
     uint32_t A, B, C, D, E, F, G, H;
-    uint8_t* p = ctx->buf;
     int t;
 
     for(t = 0; t < 16; ++t) {
@@ -74,14 +90,14 @@ static void SHA256_Transform(SHA256_CTX* ctx) {
         W[t] = W[t-16] + s0 + W[t-7] + s1;
     }
 
-    A = ctx->state[0];
-    B = ctx->state[1];
-    C = ctx->state[2];
-    D = ctx->state[3];
-    E = ctx->state[4];
-    F = ctx->state[5];
-    G = ctx->state[6];
-    H = ctx->state[7];
+    A = state[0];
+    B = state[1];
+    C = state[2];
+    D = state[3];
+    E = state[4];
+    F = state[5];
+    G = state[6];
+    H = state[7];
 
     for(t = 0; t < 64; t++) {
         uint32_t s0 = ror(A, 2) ^ ror(A, 13) ^ ror(A, 22);
@@ -101,14 +117,148 @@ static void SHA256_Transform(SHA256_CTX* ctx) {
         A = t1 + t2;
     }
 
-    ctx->state[0] += A;
-    ctx->state[1] += B;
-    ctx->state[2] += C;
-    ctx->state[3] += D;
-    ctx->state[4] += E;
-    ctx->state[5] += F;
-    ctx->state[6] += G;
-    ctx->state[7] += H;
+    state[0] += A;
+    state[1] += B;
+    state[2] += C;
+    state[3] += D;
+    state[4] += E;
+    state[5] += F;
+    state[6] += G;
+    state[7] += H;
+}
+
+#ifdef HAVE_SHA256_X86
+// four rounds of block t using the message words in W0. the message schedule for later rounds
+// is computed from W0 into W1 (the words for block t + 1) and W3 (block t + 3) as it goes
+#define SHA256_X86_ROUNDS(t, W0, W1, W2, W3) \
+    MSG = _mm_add_epi32(W0, _mm_loadu_si128((const __m128i*)&K[(t) * 4])); \
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG); \
+    if ((t) >= 3 && (t) < 15) { \
+        W1 = _mm_add_epi32(W1, _mm_alignr_epi8(W0, W3, 4)); \
+        W1 = _mm_sha256msg2_epu32(W1, W0); \
+    } \
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(MSG, 0x0E)); \
+    if ((t) >= 1 && (t) < 13) \
+        W3 = _mm_sha256msg1_epu32(W3, W0);
+
+SHA256_TARGET static void SHA256_Transform_x86(uint32_t state[8], const uint8_t* data, int blocks) {
+    const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i STATE0, STATE1, ABEF_SAVE, CDGH_SAVE, MSG, TMP;
+    __m128i MSG0, MSG1, MSG2, MSG3;
+
+    // the instructions work on the state as ABEF and CDGH
+    TMP = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+    STATE1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+    STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);
+    STATE1 = _mm_blend_epi16(STATE1, TMP, 0xF0);
+
+    for (; blocks > 0; --blocks, data += 64) {
+        ABEF_SAVE = STATE0;
+        CDGH_SAVE = STATE1;
+
+        MSG0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 0)), MASK);
+        MSG1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), MASK);
+        MSG2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), MASK);
+        MSG3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), MASK);
+
+        SHA256_X86_ROUNDS(0, MSG0, MSG1, MSG2, MSG3)
+        SHA256_X86_ROUNDS(1, MSG1, MSG2, MSG3, MSG0)
+        SHA256_X86_ROUNDS(2, MSG2, MSG3, MSG0, MSG1)
+        SHA256_X86_ROUNDS(3, MSG3, MSG0, MSG1, MSG2)
+        SHA256_X86_ROUNDS(4, MSG0, MSG1, MSG2, MSG3)
+        SHA256_X86_ROUNDS(5, MSG1, MSG2, MSG3, MSG0)
+        SHA256_X86_ROUNDS(6, MSG2, MSG3, MSG0, MSG1)
+        SHA256_X86_ROUNDS(7, MSG3, MSG0, MSG1, MSG2)
+        SHA256_X86_ROUNDS(8, MSG0, MSG1, MSG2, MSG3)
+        SHA256_X86_ROUNDS(9, MSG1, MSG2, MSG3, MSG0)
+        SHA256_X86_ROUNDS(10, MSG2, MSG3, MSG0, MSG1)
+        SHA256_X86_ROUNDS(11, MSG3, MSG0, MSG1, MSG2)
+        SHA256_X86_ROUNDS(12, MSG0, MSG1, MSG2, MSG3)
+        SHA256_X86_ROUNDS(13, MSG1, MSG2, MSG3, MSG0)
+        SHA256_X86_ROUNDS(14, MSG2, MSG3, MSG0, MSG1)
+        SHA256_X86_ROUNDS(15, MSG3, MSG0, MSG1, MSG2)
+
+        STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+        STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+    }
+
+    TMP = _mm_shuffle_epi32(STATE0, 0x1B);
+    STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);
+    STATE0 = _mm_blend_epi16(TMP, STATE1, 0xF0);
+    STATE1 = _mm_alignr_epi8(STATE1, TMP, 8);
+
+    _mm_storeu_si128((__m128i*)&state[0], STATE0);
+    _mm_storeu_si128((__m128i*)&state[4], STATE1);
+}
+#endif
+
+#ifdef HAVE_SHA256_ARM64
+// four rounds of block t using the message words in W0. unless they're needed for the last
+// rounds, W0 is then replaced with the words for block t + 4
+#define SHA256_ARM64_ROUNDS(t, W0, W1, W2, W3) \
+    WK = vaddq_u32(W0, vld1q_u32(&K[(t) * 4])); \
+    if ((t) < 12) \
+        W0 = vsha256su1q_u32(vsha256su0q_u32(W0, W1), W2, W3); \
+    TMP = STATE0; \
+    STATE0 = vsha256hq_u32(STATE0, STATE1, WK); \
+    STATE1 = vsha256h2q_u32(STATE1, TMP, WK);
+
+static void SHA256_Transform_arm64(uint32_t state[8], const uint8_t* data, int blocks) {
+    uint32x4_t STATE0 = vld1q_u32(&state[0]);
+    uint32x4_t STATE1 = vld1q_u32(&state[4]);
+    uint32x4_t ABEF_SAVE, CDGH_SAVE, WK, TMP;
+    uint32x4_t MSG0, MSG1, MSG2, MSG3;
+
+    for (; blocks > 0; --blocks, data += 64) {
+        ABEF_SAVE = STATE0;
+        CDGH_SAVE = STATE1;
+
+        MSG0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 0)));
+        MSG1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+        MSG2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+        MSG3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+        SHA256_ARM64_ROUNDS(0, MSG0, MSG1, MSG2, MSG3)
+        SHA256_ARM64_ROUNDS(1, MSG1, MSG2, MSG3, MSG0)
+        SHA256_ARM64_ROUNDS(2, MSG2, MSG3, MSG0, MSG1)
+        SHA256_ARM64_ROUNDS(3, MSG3, MSG0, MSG1, MSG2)
+        SHA256_ARM64_ROUNDS(4, MSG0, MSG1, MSG2, MSG3)
+        SHA256_ARM64_ROUNDS(5, MSG1, MSG2, MSG3, MSG0)
+        SHA256_ARM64_ROUNDS(6, MSG2, MSG3, MSG0, MSG1)
+        SHA256_ARM64_ROUNDS(7, MSG3, MSG0, MSG1, MSG2)
+        SHA256_ARM64_ROUNDS(8, MSG0, MSG1, MSG2, MSG3)
+        SHA256_ARM64_ROUNDS(9, MSG1, MSG2, MSG3, MSG0)
+        SHA256_ARM64_ROUNDS(10, MSG2, MSG3, MSG0, MSG1)
+        SHA256_ARM64_ROUNDS(11, MSG3, MSG0, MSG1, MSG2)
+        SHA256_ARM64_ROUNDS(12, MSG0, MSG1, MSG2, MSG3)
+        SHA256_ARM64_ROUNDS(13, MSG1, MSG2, MSG3, MSG0)
+        SHA256_ARM64_ROUNDS(14, MSG2, MSG3, MSG0, MSG1)
+        SHA256_ARM64_ROUNDS(15, MSG3, MSG0, MSG1, MSG2)
+
+        STATE0 = vaddq_u32(STATE0, ABEF_SAVE);
+        STATE1 = vaddq_u32(STATE1, CDGH_SAVE);
+    }
+
+    vst1q_u32(&state[0], STATE0);
+    vst1q_u32(&state[4], STATE1);
+}
+#endif
+
+static void SHA256_Transform(SHA256_CTX* ctx, const uint8_t* data, int blocks) {
+#if defined(HAVE_SHA256_X86)
+    if (cpu_features() & CPU_FEATURE_SHA256) {
+        SHA256_Transform_x86(ctx->state, data, blocks);
+        return;
+    }
+#elif defined(HAVE_SHA256_ARM64)
+    if (cpu_features() & CPU_FEATURE_SHA256) {
+        SHA256_Transform_arm64(ctx->state, data, blocks);
+        return;
+    }
+#endif
+
+    for (; blocks > 0; --blocks, data += 64)
+        SHA256_Transform_portable(ctx->state, data);
 }
 
 static const HASH_VTAB SHA256_VTAB = {
@@ -136,13 +286,28 @@ void SHA256_update(SHA256_CTX* ctx, const void* data, int len) {
     int i = (int) (ctx->count & 63);
     const uint8_t* p = (const uint8_t*)data;
     ctx->count += len;
-    while (len--) {
-        ctx->buf[i++] = *p++;
-        if (i == 64) {
-            SHA256_Transform(ctx);
-            i = 0;
-        }
+
+    // complete a partially filled block
+    if (i > 0) {
+        int n = 64 - i;
+        if (n > len) n = len;
+        memcpy(ctx->buf + i, p, n);
+        p += n;
+        len -= n;
+        if (i + n < 64)
+            return;
+
+        SHA256_Transform(ctx, ctx->buf, 1);
+    }
+
+    // whole blocks are processed in place
+    if (len >= 64) {
+        SHA256_Transform(ctx, p, len / 64);
+        p += len & ~63;
+        len &= 63;
     }
+
+    memcpy(ctx->buf, p, len);
 }
 
 const uint8_t* SHA256_final(SHA256_CTX* ctx) {
@@ -25,7 +25,9 @@ SOFTWARE.
 #pragma once
 
 #include <stdarg.h>
+#include <string.h>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include "libretro.h"
@@ -34,8 +36,63 @@ SOFTWARE.
 #define LOG_MAX_LINE_SIZE 1024
 #endif
 
+#ifndef LOG_MAX_TAG_LEVELS
+#define LOG_MAX_TAG_LEVELS 16
+#endif
+
+/**
+ * Tags listed in LOG_DISABLED_TAGS don't have their LOG_DEBUG messages compiled
+ * in, i.e. -DLOG_DISABLED_TAGS="\"[AUD][COR]\"". In release builds no LOG_DEBUG
+ * message is compiled in.
+ */
+#ifndef LOG_DISABLED_TAGS
+#define LOG_DISABLED_TAGS ""
+#endif
+
+#ifdef NDEBUG
+#define LOG_DEBUG_COMPILED false
+#else
+#define LOG_DEBUG_COMPILED true
+#endif
+
+/**
+ * Logs a debug message if its tag is enabled. fmt must be a string literal
+ * starting with the tag, i.e. TAG "...". When the tag is disabled at compile
+ * time the whole statement, including the evaluation of the arguments, is
+ * removed. When it's disabled at run time the arguments aren't evaluated.
+ */
+#define LOG_DEBUG(logger, fmt, ...) \
+  do { \
+    if (std::integral_constant<bool, libretro::logDebugCompiled(fmt)>::value && (logger)->logLevel(fmt, RETRO_LOG_DEBUG)) \
+      (logger)->debug(fmt, ##__VA_ARGS__); \
+  } while (0)
+
 namespace libretro
 {
+  /**
+   * Compares the tag at the start of a message, i.e. "[AUD]", with the tag at
+   * the start of a list of tags.
+   */
+  constexpr bool logTagEquals(const char* fmt, const char* tags)
+  {
+    return *tags == ']' ? *fmt == ']' : (*fmt != '\0' && *fmt == *tags && logTagEquals(fmt + 1, tags + 1));
+  }
+
+  constexpr const char* logNextTag(const char* tags)
+  {
+    return *tags == '\0' ? tags : *tags == ']' ? tags + 1 : logNextTag(tags + 1);
+  }
+
+  constexpr bool logTagListed(const char* fmt, const char* tags)
+  {
+    return *tags != '\0' && (logTagEquals(fmt, tags) || logTagListed(fmt, logNextTag(tags)));
+  }
+
+  constexpr bool logDebugCompiled(const char* fmt)
+  {
+    return LOG_DEBUG_COMPILED && !(*fmt == '[' && logTagListed(fmt, LOG_DISABLED_TAGS));
+  }
+
   /**
    * A logger component for Core instances.
    */
@@ -44,6 +101,16 @@ namespace libretro
   public:
     virtual void log(enum retro_log_level level, const char* line, size_t length) = 0;
 
+    /**
+     * Called by debug, info, warn and error. Their formats must be string literals,
+     * so implementations can keep the format and a copy of the arguments and
+     * format the message later. The default implementation formats it right away.
+     */
+    virtual void logStructured(enum retro_log_level level, const char* fmt, va_list args)
+    {
+      vprintf(level, fmt, args);
+    }
+
     void vprintf(enum retro_log_level level, const char* fmt, va_list args)
     {
       char line[LOG_MAX_LINE_SIZE];
@@ -66,6 +133,39 @@ namespace libretro
     void setLogLevel(enum retro_log_level level)
     {
       _level = level;
+      updateMinLevel();
+    }
+
+    /**
+     * Sets the level for the messages of one tag, i.e. "[MEM]", overriding the
+     * level set for all messages.
+     */
+    bool setLogLevel(const char* tag, enum retro_log_level level)
+    {
+      size_t length = 0;
+      while (tag[length] != '\0' && tag[length] != ']')
+        length++;
+
+      if (tag[0] != '[' || tag[length] != ']' || length + 2 > sizeof(_tagLevels[0].tag))
+        return false;
+
+      unsigned i = 0;
+      while (i < _numTagLevels && !tagEquals(_tagLevels[i].tag, tag))
+        i++;
+
+      if (i == LOG_MAX_TAG_LEVELS)
+        return false;
+
+      if (i == _numTagLevels)
+      {
+        memcpy(_tagLevels[i].tag, tag, length + 1);
+        _tagLevels[i].tag[length + 1] = '\0';
+        _numTagLevels++;
+      }
+
+      _tagLevels[i].level = level;
+      updateMinLevel();
+      return true;
     }
 
     bool logLevel(enum retro_log_level level)
@@ -73,6 +173,27 @@ namespace libretro
       return (_level <= level);
     }
 
+    /**
+     * Checks the level for a message that starts with a tag, i.e. TAG "...".
+     */
+    bool logLevel(const char* fmt, enum retro_log_level level)
+    {
+      if (level < _minLevel)
+        return false;
+
+      // No tag has its own level, so _minLevel is _level.
+      if (_numTagLevels == 0 || *fmt != '[')
+        return (_level <= level);
+
+      for (unsigned i = 0; i < _numTagLevels; i++)
+      {
+        if (tagEquals(_tagLevels[i].tag, fmt))
+          return (_tagLevels[i].level <= level);
+      }
+
+      return (_level <= level);
+    }
+
     void printf(enum retro_log_level level, const char* fmt, ...)
     {
       va_list args;
@@ -86,35 +207,35 @@ namespace libretro
 #else
     void debug(const char* fmt, ...)
     {
-      if (_level > RETRO_LOG_DEBUG)
+      if (!logLevel(fmt, RETRO_LOG_DEBUG))
         return;
 
       va_list args;
       va_start(args, fmt);
-      vprintf(RETRO_LOG_DEBUG, fmt, args);
+      logStructured(RETRO_LOG_DEBUG, fmt, args);
       va_end(args);
     }
 #endif
 
     void info(const char* fmt, ...)
     {
-      if (_level > RETRO_LOG_INFO)
+      if (!logLevel(fmt, RETRO_LOG_INFO))
         return;
 
       va_list args;
       va_start(args, fmt);
-      vprintf(RETRO_LOG_INFO, fmt, args);
+      logStructured(RETRO_LOG_INFO, fmt, args);
       va_end(args);
     }
 
     void warn(const char* fmt, ...)
     {
-      if (_level > RETRO_LOG_WARN)
+      if (!logLevel(fmt, RETRO_LOG_WARN))
         return;
 
       va_list args;
       va_start(args, fmt);
-      vprintf(RETRO_LOG_WARN, fmt, args);
+      logStructured(RETRO_LOG_WARN, fmt, args);
       va_end(args);
     }
 
@@ -122,12 +243,43 @@ namespace libretro
     {
       va_list args;
       va_start(args, fmt);
-      vprintf(RETRO_LOG_ERROR, fmt, args);
+      logStructured(RETRO_LOG_ERROR, fmt, args);
       va_end(args);
     }
 
   private:
+    static bool tagEquals(const char* tag, const char* fmt)
+    {
+      while (*tag == *fmt && *tag != ']')
+      {
+        tag++;
+        fmt++;
+      }
+
+      return (*tag == ']' && *fmt == ']');
+    }
+
+    void updateMinLevel()
+    {
+      _minLevel = _level;
+
+      for (unsigned i = 0; i < _numTagLevels; i++)
+      {
+        if (_tagLevels[i].level < _minLevel)
+          _minLevel = _tagLevels[i].level;
+      }
+    }
+
+    struct TagLevel
+    {
+      char tag[12];
+      enum retro_log_level level;
+    };
+
     enum retro_log_level _level = RETRO_LOG_INFO;
+    enum retro_log_level _minLevel = RETRO_LOG_INFO;
+    TagLevel _tagLevels[LOG_MAX_TAG_LEVELS];
+    unsigned _numTagLevels = 0;
   };
 
   /**
@@ -25,10 +25,14 @@ SOFTWARE.
 #include "Core.h"
 
 #include "Application.h"
+#include "Profiler.h"
 #include "Util.h"
 
+#include <algorithm>
+#include <chrono>
 #include <stdlib.h>
 #include <string.h>
+#include <type_traits>
 
 #ifdef _WINDOWS
 #include <RA_Interface.h>
@@ -414,6 +418,9 @@ bool libretro::Core::init(const Components* components)
     if (components->allocator != NULL)    _allocator    = components->allocator;
   }
 
+  if (!checkEnvironmentCalls(_logger))
+    return false;
+
   reset();
   return true;
 }
@@ -540,11 +547,17 @@ void libretro::Core::destroy()
 
   _core.deinit();
   _core.destroy();
+
+  if (_traceEnvironment)
+    logEnvironmentTrace();
+
   reset();
 }
 
 void libretro::Core::step(bool generateVideo, bool generateAudio)
 {
+  PROFILE_PHASE(CoreStep);
+
   if (_input->ctrlUpdated())
   {
     for (unsigned i = 0; i < _controllerInfoCount; i++)
@@ -563,7 +576,10 @@ void libretro::Core::step(bool generateVideo, bool generateAudio)
 
   _generateAudio = generateAudio;
 
-  _core.run();
+  {
+    PROFILE_PHASE(CoreRun);
+    _core.run();
+  }
 
   /* if any audio was buffered, flush it now */
   if (_samplesCount > 0)
@@ -645,6 +661,9 @@ bool libretro::Core::initCore()
   _logger->debug(TAG "  need_fullpath:    %s", _systemInfo.need_fullpath ? "true" : "false");
   _logger->debug(TAG "  block_extract:    %s", _systemInfo.block_extract ? "true" : "false");
 
+  /* names and times of environment calls are only collected with --log COR=debug */
+  _traceEnvironment = _logger->logLevel(TAG, RETRO_LOG_DEBUG);
+
   _core.setEnvironment(s_environmentCallback);
   _core.init();
   return true;
@@ -697,7 +716,10 @@ void libretro::Core::reset()
   _input->setKeyboardCallback(nullptr);
   memset(&_diskControlInterface, 0, sizeof(_diskControlInterface));
   memset(&_memoryMap, 0, sizeof(_memoryMap));
+  _memoryMapVersion = 0;
   memset(&_calls, 0, sizeof(_calls));
+  _traceEnvironment = false;
+  memset(&_environmentTrace, 0, sizeof(_environmentTrace));
 }
 
 const char* libretro::Core::getLibretroPath() const
@@ -1665,8 +1687,8 @@ bool libretro::Core::setMemoryMaps(const struct retro_memory_map* data)
     _logger->debug(TAG "  %3u %s %p %08X %08X %08X %08X %08X %s", i, flags, descriptors->ptr, descriptors->offset, descriptors->start, descriptors->select, descriptors->disconnect, descriptors->len, descriptors->addrspace ? descriptors->addrspace : "");
   }
 
-  if (app.isGameActive())
-    app.refreshMemoryMap();
+  /* the memory banks are updated once the current frame completes */
+  _memoryMapVersion++;
 
   return true;
 }
@@ -1797,288 +1819,197 @@ static bool clearAllWaitThreadsCallback(unsigned clear_threads, void* data)
   return true;
 }
 
-static void getEnvName(char* name, size_t size, unsigned cmd)
-{
-  static const char* names[] =
-  {
-    "0",
-    "SET_ROTATION",
-    "GET_OVERSCAN",
-    "GET_CAN_DUPE",
-    "4",
-    "5",
-    "SET_MESSAGE",
-    "SHUTDOWN",
-    "SET_PERFORMANCE_LEVEL",
-    "GET_SYSTEM_DIRECTORY",
-    "SET_PIXEL_FORMAT",                        // 10
-    "SET_INPUT_DESCRIPTORS",
-    "SET_KEYBOARD_CALLBACK",
-    "SET_DISK_CONTROL_INTERFACE",
-    "SET_HW_RENDER",
-    "GET_VARIABLE",
-    "SET_VARIABLES",
-    "GET_VARIABLE_UPDATE",
-    "SET_SUPPORT_NO_GAME",
-    "GET_LIBRETRO_PATH",
-    "20",                                      // 20
-    "SET_FRAME_TIME_CALLBACK",
-    "SET_AUDIO_CALLBACK",
-    "GET_RUMBLE_INTERFACE",
-    "GET_INPUT_DEVICE_CAPABILITIES",
-    "GET_SENSOR_INTERFACE",
-    "GET_CAMERA_INTERFACE",
-    "GET_LOG_INTERFACE",
-    "GET_PERF_INTERFACE",
-    "GET_LOCATION_INTERFACE",
-    "GET_CORE_ASSETS_DIRECTORY",               // 30
-    "GET_SAVE_DIRECTORY",
-    "SET_SYSTEM_AV_INFO",
-    "SET_PROC_ADDRESS_CALLBACK",
-    "SET_SUBSYSTEM_INFO",
-    "SET_CONTROLLER_INFO",
-    "SET_MEMORY_MAPS",
-    "SET_GEOMETRY",
-    "GET_USERNAME",
-    "GET_LANGUAGE",
-    "GET_CURRENT_SOFTWARE_FRAMEBUFFER",        // 40
-    "GET_HW_RENDER_INTERFACE",
-    "SET_SUPPORT_ACHIEVEMENTS",
-    "SET_HW_RENDER_CONTEXT_NEGOTIATION_INTERFACE",
-    "SET_SERIALIZATION_QUIRKS",
-    "GET_VFS_INTERFACE",
-    "GET_LED_INTERFACE",
-    "GET_AUDIO_VIDEO_ENABLE",
-    "GET_MIDI_INTERFACE",
-    "GET_FASTFORWARDING",
-    "GET_TARGET_REFRESH_RATE",                 // 50
-    "GET_INPUT_BITMASKS",
-    "GET_CORE_OPTIONS_VERSION",
-    "SET_CORE_OPTIONS",
-    "SET_CORE_OPTIONS_INTL",
-    "SET_CORE_OPTIONS_DISPLAY",
-    "GET_PREFERRED_HW_RENDER",
-    "GET_DISK_CONTROL_INTERFACE_VERSION",
-    "SET_DISK_CONTROL_EXT_INTERFACE",
-    "GET_MESSAGE_INTERFACE_VERSION",
-    "SET_MESSAGE_EXT",                         // 60
-    "GET_INPUT_MAX_USERS",
-    "SET_AUDIO_BUFFER_STATUS_CALLBACK",
-    "SET_MINIMUM_AUDIO_LATENCY",
-    "SET_FASTFORWARDING_OVERRIDE",
-    "SET_CONTENT_INFO_OVERRIDE",
-    "GET_GAME_INFO_EXT",
-    "SET_CORE_OPTIONS_V2",
-    "SET_CORE_OPTIONS_V2_INTL",
-    "SET_CORE_OPTIONS_UPDATE_DISPLAY_CALLBACK",
-    "SET_VARIABLE",                            // 70
-    "GET_THROTTLE_STATE",
-    "GET_SAVESTATE_CONTEXT",
-    "GET_HW_RENDER_CONTEXT_NEGOTIATION_INTERFACE_SUPPORT",
-    "GET_JIT_CAPABLE",
-    "GET_MICROPHONE_INTERFACE",
-    "SET_NETPACKET_INTERFACE",
-    "GET_DEVICE_POWER",
-  };
-
-  cmd &= ~RETRO_ENVIRONMENT_EXPERIMENTAL;
-
-  if (cmd < sizeof(names) / sizeof(names[0]))
+namespace libretro
+{
+  template<typename T>
+  static T environmentArgument(void* data, std::true_type /* pointer */)
   {
-    snprintf(name, size, "%s (%u)", names[cmd], cmd);
+    return (T)data;
   }
-  else
+
+  template<typename T>
+  static T environmentArgument(void* data, std::false_type /* value */)
   {
-    snprintf(name, size, "%u", cmd);
+    return *(T*)data;
   }
-}
-
-bool libretro::Core::environmentCallback(unsigned cmd, void* data)
-{
-  bool ret;
-  char name[128];
-
-  getEnvName(name, sizeof(name), cmd);
-  _logger->debug(TAG "Calling %s", name);
 
-  switch (cmd)
+  template<typename T, bool (Core::*Handler)(T)>
+  struct Core::EnvironmentAdapter<bool (Core::*)(T), Handler>
   {
-  case RETRO_ENVIRONMENT_SET_ROTATION:
-    ret = setRotation(*(const unsigned*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_GET_OVERSCAN:
-    ret = getOverscan((bool*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_GET_CAN_DUPE:
-    ret = getCanDupe((bool*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_SET_MESSAGE:
-    ret = setMessage((const struct retro_message*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_SET_PERFORMANCE_LEVEL:
-    ret = setPerformanceLevel(*(unsigned*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY:
-    ret = getSystemDirectory((const char**)data);
-    break;
-
-  case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
-    ret = setPixelFormat(*(enum retro_pixel_format*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS:
-    ret = setInputDescriptors((const struct retro_input_descriptor*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_SET_KEYBOARD_CALLBACK:
-    ret = setKeyboardCallback((const struct retro_keyboard_callback*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_SET_DISK_CONTROL_INTERFACE:
-    ret = setDiskControlInterface((const struct retro_disk_control_callback*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_SET_HW_RENDER:
-    ret = setHWRender((struct retro_hw_render_callback*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_GET_VARIABLE:
-    ret = getVariable((struct retro_variable*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_SET_VARIABLES:
-    ret = setVariables((const struct retro_variable*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE:
-    ret = getVariableUpdate((bool*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_SET_SUPPORT_NO_GAME:
-    ret = setSupportNoGame(*(bool*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_GET_LIBRETRO_PATH:
-    ret = getLibretroPath((const char**)data);
-    break;
-
-  case RETRO_ENVIRONMENT_GET_RUMBLE_INTERFACE:
-    ret = getRumbleInterface((struct retro_rumble_interface*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_GET_INPUT_DEVICE_CAPABILITIES:
-    ret = getInputDeviceCapabilities((uint64_t*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_GET_LOG_INTERFACE:
-    ret = getLogInterface((struct retro_log_callback*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_GET_CORE_ASSETS_DIRECTORY:
-    ret = getCoreAssetsDirectory((const char**)data);
-    break;
-
-  case RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY:
-    ret = getSaveDirectory((const char**)data);
-    break;
-
-  case RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO:
-    ret = setSystemAVInfo((const struct retro_system_av_info*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_SET_SUBSYSTEM_INFO:
-    ret = setSubsystemInfo((const struct retro_subsystem_info*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_SET_CONTROLLER_INFO:
-    ret = setControllerInfo((const struct retro_controller_info*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_SET_MEMORY_MAPS:
-    ret = setMemoryMaps((const struct retro_memory_map*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_SET_GEOMETRY:
-    ret = setGeometry((const struct retro_game_geometry*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_GET_USERNAME:
-    ret = getUsername((const char**)data);
-    break;
-
-  case RETRO_ENVIRONMENT_GET_LANGUAGE:
-    ret = getLanguage((unsigned*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_SET_SUPPORT_ACHIEVEMENTS:
-    ret = setSupportAchievements(*(bool*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_GET_VFS_INTERFACE:
-    ret = getVfsInterface((struct retro_vfs_interface_info*)data);
-    break;
-
-  case RETRO_ENVIRONMENT_GET_LED_INTERFACE:
-    ret = getLEDInterface((struct retro_led_interface*)data);
-    break;
+    static bool call(Core* core, void* data)
+    {
+      return (core->*Handler)(environmentArgument<T>(data, std::is_pointer<T>()));
+    }
+  };
 
-  case RETRO_ENVIRONMENT_GET_INPUT_BITMASKS:
-    ret = getInputBitmasks((bool*)data);
-    break;
+  template<typename T, bool (Core::*Handler)(T) const>
+  struct Core::EnvironmentAdapter<bool (Core::*)(T) const, Handler>
+  {
+    static bool call(Core* core, void* data)
+    {
+      return (core->*Handler)(environmentArgument<T>(data, std::is_pointer<T>()));
+    }
+  };
+}
 
-  case RETRO_ENVIRONMENT_GET_CORE_OPTIONS_VERSION:
-    ret = getCoreOptionsVersion((unsigned*)data);
-    break;
+#define ENV_CALL(name, handler) \
+  { RETRO_ENVIRONMENT_ ## name, #name, &EnvironmentAdapter<decltype(&Core::handler), &Core::handler>::call }
+
+/* for handlers that share their name with a getter */
+#define ENV_CALL_OVERLOAD(name, handler, type) \
+  { RETRO_ENVIRONMENT_ ## name, #name, &EnvironmentAdapter<type, &Core::handler>::call }
+
+#define ENV_NONE(name) \
+  { RETRO_ENVIRONMENT_ ## name, #name, NULL }
+
+#define ENV_UNDEFINED(cmd) \
+  { cmd, #cmd, NULL }
+
+/* indexed by the command number, without RETRO_ENVIRONMENT_EXPERIMENTAL */
+const libretro::Core::EnvironmentCall libretro::Core::s_environmentCalls[] =
+{
+  ENV_UNDEFINED(0),
+  ENV_CALL(SET_ROTATION, setRotation),
+  ENV_CALL(GET_OVERSCAN, getOverscan),
+  ENV_CALL(GET_CAN_DUPE, getCanDupe),
+  ENV_UNDEFINED(4),
+  ENV_UNDEFINED(5),
+  ENV_CALL(SET_MESSAGE, setMessage),
+  ENV_NONE(SHUTDOWN),
+  ENV_CALL(SET_PERFORMANCE_LEVEL, setPerformanceLevel),
+  ENV_CALL_OVERLOAD(GET_SYSTEM_DIRECTORY, getSystemDirectory, bool (Core::*)(const char**) const),
+  ENV_CALL(SET_PIXEL_FORMAT, setPixelFormat),                         // 10
+  ENV_CALL(SET_INPUT_DESCRIPTORS, setInputDescriptors),
+  ENV_CALL(SET_KEYBOARD_CALLBACK, setKeyboardCallback),
+  ENV_CALL(SET_DISK_CONTROL_INTERFACE, setDiskControlInterface),
+  ENV_CALL(SET_HW_RENDER, setHWRender),
+  ENV_CALL(GET_VARIABLE, getVariable),
+  ENV_CALL(SET_VARIABLES, setVariables),
+  ENV_CALL(GET_VARIABLE_UPDATE, getVariableUpdate),
+  ENV_CALL(SET_SUPPORT_NO_GAME, setSupportNoGame),
+  ENV_CALL_OVERLOAD(GET_LIBRETRO_PATH, getLibretroPath, bool (Core::*)(const char**) const),
+  ENV_UNDEFINED(20),
+  ENV_NONE(SET_FRAME_TIME_CALLBACK),
+  ENV_NONE(SET_AUDIO_CALLBACK),
+  ENV_CALL(GET_RUMBLE_INTERFACE, getRumbleInterface),
+  ENV_CALL(GET_INPUT_DEVICE_CAPABILITIES, getInputDeviceCapabilities),
+  ENV_NONE(GET_SENSOR_INTERFACE),
+  ENV_NONE(GET_CAMERA_INTERFACE),
+  ENV_CALL(GET_LOG_INTERFACE, getLogInterface),
+  ENV_NONE(GET_PERF_INTERFACE),
+  ENV_NONE(GET_LOCATION_INTERFACE),
+  ENV_CALL(GET_CORE_ASSETS_DIRECTORY, getCoreAssetsDirectory),        // 30
+  ENV_CALL(GET_SAVE_DIRECTORY, getSaveDirectory),
+  ENV_CALL(SET_SYSTEM_AV_INFO, setSystemAVInfo),
+  ENV_NONE(SET_PROC_ADDRESS_CALLBACK),
+  ENV_CALL(SET_SUBSYSTEM_INFO, setSubsystemInfo),
+  ENV_CALL(SET_CONTROLLER_INFO, setControllerInfo),
+  ENV_CALL(SET_MEMORY_MAPS, setMemoryMaps),
+  ENV_CALL(SET_GEOMETRY, setGeometry),
+  ENV_CALL(GET_USERNAME, getUsername),
+  ENV_CALL(GET_LANGUAGE, getLanguage),
+  ENV_NONE(GET_CURRENT_SOFTWARE_FRAMEBUFFER),                         // 40
+  ENV_NONE(GET_HW_RENDER_INTERFACE),
+  ENV_CALL(SET_SUPPORT_ACHIEVEMENTS, setSupportAchievements),
+  ENV_NONE(SET_HW_RENDER_CONTEXT_NEGOTIATION_INTERFACE),
+  ENV_NONE(SET_SERIALIZATION_QUIRKS),
+  ENV_CALL(GET_VFS_INTERFACE, getVfsInterface),
+  ENV_CALL(GET_LED_INTERFACE, getLEDInterface),
+  ENV_NONE(GET_AUDIO_VIDEO_ENABLE),
+  ENV_NONE(GET_MIDI_INTERFACE),
+  ENV_CALL(GET_FASTFORWARDING, getFastForwarding),
+  ENV_NONE(GET_TARGET_REFRESH_RATE),                                  // 50
+  ENV_CALL(GET_INPUT_BITMASKS, getInputBitmasks),
+  ENV_CALL(GET_CORE_OPTIONS_VERSION, getCoreOptionsVersion),
+  ENV_CALL(SET_CORE_OPTIONS, setCoreOptions),
+  ENV_CALL(SET_CORE_OPTIONS_INTL, setCoreOptionsIntl),
+  ENV_CALL(SET_CORE_OPTIONS_DISPLAY, setCoreOptionsDisplay),
+  ENV_CALL(GET_PREFERRED_HW_RENDER, getPreferredHWRender),
+  ENV_CALL(GET_DISK_CONTROL_INTERFACE_VERSION, getDiskControlInterfaceVersion),
+  ENV_CALL(SET_DISK_CONTROL_EXT_INTERFACE, setDiskControlExtInterface),
+  ENV_NONE(GET_MESSAGE_INTERFACE_VERSION),
+  ENV_NONE(SET_MESSAGE_EXT),                                          // 60
+  ENV_NONE(GET_INPUT_MAX_USERS),
+  ENV_NONE(SET_AUDIO_BUFFER_STATUS_CALLBACK),
+  ENV_NONE(SET_MINIMUM_AUDIO_LATENCY),
+  ENV_NONE(SET_FASTFORWARDING_OVERRIDE),
+  ENV_CALL(SET_CONTENT_INFO_OVERRIDE, setContentInfoOverride),
+  ENV_NONE(GET_GAME_INFO_EXT),
+  ENV_CALL(SET_CORE_OPTIONS_V2, setCoreOptionsV2),
+  ENV_CALL(SET_CORE_OPTIONS_V2_INTL, setCoreOptionsV2Intl),
+  ENV_NONE(SET_CORE_OPTIONS_UPDATE_DISPLAY_CALLBACK),
+  ENV_NONE(SET_VARIABLE),                                             // 70
+  ENV_NONE(GET_THROTTLE_STATE),
+  ENV_NONE(GET_SAVESTATE_CONTEXT),
+  ENV_NONE(GET_HW_RENDER_CONTEXT_NEGOTIATION_INTERFACE_SUPPORT),
+  ENV_NONE(GET_JIT_CAPABLE),
+  ENV_CALL(GET_MICROPHONE_INTERFACE, getMicrophoneInterface),
+  ENV_NONE(SET_NETPACKET_INTERFACE),
+  ENV_NONE(GET_DEVICE_POWER),
+};
 
-  case RETRO_ENVIRONMENT_SET_CORE_OPTIONS:
-    ret = setCoreOptions((const struct retro_core_option_definition*)data);
-    break;
+#undef ENV_CALL
+#undef ENV_CALL_OVERLOAD
+#undef ENV_NONE
+#undef ENV_UNDEFINED
 
-  case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_INTL:
-    ret = setCoreOptionsIntl((const struct retro_core_options_intl*)data);
-    break;
+#define ENV_COUNT (sizeof(s_environmentCalls) / sizeof(s_environmentCalls[0]))
 
-  case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY:
-    ret = setCoreOptionsDisplay((const struct retro_core_option_display*)data);
-    break;
+/* the table can't be checked at compile time in C++11, so make sure it's in order before it's used */
+bool libretro::Core::checkEnvironmentCalls(LoggerComponent* logger)
+{
+  for (unsigned i = 0; i < ENV_COUNT; i++)
+  {
+    if ((s_environmentCalls[i].cmd & ~RETRO_ENVIRONMENT_EXPERIMENTAL) != i)
+    {
+      logger->error(TAG "Environment call %s is at index %u instead of %u", s_environmentCalls[i].name, i,
+        s_environmentCalls[i].cmd & ~RETRO_ENVIRONMENT_EXPERIMENTAL);
+      return false;
+    }
+  }
 
-  case RETRO_ENVIRONMENT_GET_FASTFORWARDING:
-    ret = getFastForwarding((bool*)data);
-    break;
+  return true;
+}
 
-  case RETRO_ENVIRONMENT_GET_PREFERRED_HW_RENDER:
-    ret = getPreferredHWRender((unsigned*)data);
-    break;
+void libretro::Core::getEnvName(char* name, size_t size, unsigned cmd)
+{
+  cmd &= ~RETRO_ENVIRONMENT_EXPERIMENTAL;
 
-  case RETRO_ENVIRONMENT_GET_DISK_CONTROL_INTERFACE_VERSION:
-    ret = getDiskControlInterfaceVersion((unsigned*)data);
-    break;
+  if (cmd < ENV_COUNT)
+  {
+    snprintf(name, size, "%s (%u)", s_environmentCalls[cmd].name, cmd);
+  }
+  else
+  {
+    snprintf(name, size, "%u", cmd);
+  }
+}
 
-  case RETRO_ENVIRONMENT_SET_DISK_CONTROL_EXT_INTERFACE:
-    ret = setDiskControlExtInterface((const struct retro_disk_control_ext_callback*)data);
-    break;
+bool libretro::Core::environmentCallback(unsigned cmd, void* data)
+{
+  if (_traceEnvironment)
+    return traceEnvironment(cmd, data);
 
-  case RETRO_ENVIRONMENT_SET_CONTENT_INFO_OVERRIDE:
-    ret = setContentInfoOverride((const struct retro_system_content_info_override*)data);
-    break;
+  return callEnvironment(cmd, data);
+}
 
-  case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_V2:
-    ret = setCoreOptionsV2((const struct retro_core_options_v2*)data);
-    break;
+bool libretro::Core::callEnvironment(unsigned cmd, void* data)
+{
+  char name[128];
 
-  case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_V2_INTL:
-    ret = setCoreOptionsV2Intl((const struct retro_core_options_v2_intl*)data);
-    break;
+  const unsigned index = cmd & ~RETRO_ENVIRONMENT_EXPERIMENTAL;
+  if (index < ENV_COUNT && s_environmentCalls[index].cmd == cmd && s_environmentCalls[index].handler)
+  {
+    if (s_environmentCalls[index].handler(this, data))
+      return true;
 
-  case RETRO_ENVIRONMENT_GET_MICROPHONE_INTERFACE:
-    ret = getMicrophoneInterface((struct retro_microphone_interface*)data);
-    break;
+    getEnvName(name, sizeof(name), cmd);
+    _logger->warn(TAG "Called  %s -> %d", name, false);
+    return false;
+  }
 
+  switch (cmd)
+  {
   /* RETRO_ENVIRONMENT_SET_CORE_OPTIONS_UPDATE_DISPLAY_CALLBACK cannot be supported because
    * we don't update the variable values in real time. values are only updated when the config
    * dialog is closed.
@@ -2104,6 +2035,8 @@ bool libretro::Core::environmentCallback(unsigned cmd, void* data)
     if (cmd & RETRO_ENVIRONMENT_PRIVATE)
       return false;
 
+    getEnvName(name, sizeof(name), cmd);
+
     cmd &= ~RETRO_ENVIRONMENT_EXPERIMENTAL;
     if (cmd < sizeof(_calls) * 8)
     {
@@ -2121,21 +2054,77 @@ bool libretro::Core::environmentCallback(unsigned cmd, void* data)
 
     return false;
   }
+}
+
+bool libretro::Core::traceEnvironment(unsigned cmd, void* data)
+{
+  char name[128];
+  getEnvName(name, sizeof(name), cmd);
+  LOG_DEBUG(_logger, TAG "Calling %s", name);
+
+  const auto start = std::chrono::steady_clock::now();
+  const bool ret = callEnvironment(cmd, data);
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  unsigned index = cmd & ~RETRO_ENVIRONMENT_EXPERIMENTAL;
+  if (index >= 128)
+    index = 128;
+
+  _environmentTrace[index].count++;
+  _environmentTrace[index].nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
 
   if (ret)
   {
-    _logger->debug(TAG "Called  %s -> %d", name, ret);
+    LOG_DEBUG(_logger, TAG "Called  %s -> %d", name, ret);
   }
-  else
+
+  return ret;
+}
+
+void libretro::Core::logEnvironmentTrace()
+{
+  unsigned order[128 + 1];
+  unsigned count = 0;
+  uint64_t totalCount = 0;
+  uint64_t totalNanoseconds = 0;
+
+  for (unsigned i = 0; i <= 128; i++)
   {
-    _logger->warn(TAG "Called  %s -> %d", name, ret);
+    if (_environmentTrace[i].count != 0)
+    {
+      order[count++] = i;
+      totalCount += _environmentTrace[i].count;
+      totalNanoseconds += _environmentTrace[i].nanoseconds;
+    }
   }
 
-  return ret;
+  if (count == 0)
+    return;
+
+  /* most expensive commands first */
+  std::sort(order, order + count, [this](unsigned a, unsigned b) {
+    return _environmentTrace[a].nanoseconds > _environmentTrace[b].nanoseconds;
+  });
+
+  _logger->info(TAG "Environment calls: %llu calls, %.3f ms", (unsigned long long)totalCount, totalNanoseconds / 1000000.0);
+
+  for (unsigned i = 0; i < count; i++)
+  {
+    const EnvironmentTrace* trace = &_environmentTrace[order[i]];
+    char name[128];
+
+    if (order[i] == 128)
+      snprintf(name, sizeof(name), "other");
+    else
+      getEnvName(name, sizeof(name), order[i]);
+
+    _logger->info(TAG "  %-50s %10llu calls %10.3f ms", name, (unsigned long long)trace->count, trace->nanoseconds / 1000000.0);
+  }
 }
 
 void libretro::Core::videoRefreshCallback(const void* data, unsigned width, unsigned height, size_t pitch)
 {
+  PROFILE_PHASE(VideoRefresh);
   _video->refresh(data, width, height, pitch);
 }
 
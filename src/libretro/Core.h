@@ -112,6 +112,12 @@ namespace libretro
       return &_memoryMap;
     }
 
+    /* incremented every time the core provides a new memory map */
+    inline unsigned getMemoryMapVersion() const
+    {
+      return _memoryMapVersion;
+    }
+
     inline const std::string getSystemDirectory() const
     {
       return _config->getSystemPath();
@@ -181,6 +187,35 @@ namespace libretro
     bool getPreferredHWRender(unsigned* data);
     bool getMicrophoneInterface(struct retro_microphone_interface* data);
 
+    // Environment dispatch. Calls are looked up in a table indexed by their number, and
+    // names are only formatted when a call fails or when tracing is enabled.
+    typedef bool (*EnvironmentHandler)(Core* core, void* data);
+
+    struct EnvironmentCall
+    {
+      unsigned           cmd;
+      const char*        name;
+      EnvironmentHandler handler; // NULL if not supported
+    };
+
+    struct EnvironmentTrace
+    {
+      uint64_t count;
+      uint64_t nanoseconds;
+    };
+
+    // Converts the void* argument and calls the handler
+    template<typename F, F Handler> struct EnvironmentAdapter;
+
+    static const EnvironmentCall s_environmentCalls[];
+
+    static void getEnvName(char* name, size_t size, unsigned cmd);
+    static bool checkEnvironmentCalls(LoggerComponent* logger);
+
+    bool callEnvironment(unsigned cmd, void* data);
+    bool traceEnvironment(unsigned cmd, void* data);
+    void logEnvironmentTrace();
+
     // Callbacks
     bool                 environmentCallback(unsigned cmd, void* data);
     void                 videoRefreshCallback(const void* data, unsigned width, unsigned height, size_t pitch);
@@ -257,7 +292,13 @@ namespace libretro
     struct retro_disk_control_ext_callback _diskControlInterface;
 
     struct retro_memory_map         _memoryMap;
+    unsigned                        _memoryMapVersion;
 
     uint8_t                         _calls[128 / 8];
+
+    // Call counts and times per command (the last entry is for commands >= 128), only
+    // updated when the [COR] tag logs debug messages
+    bool                            _traceEnvironment;
+    EnvironmentTrace                _environmentTrace[128 + 1];
   };
 }